@@ -0,0 +1,84 @@
+# fhiclcpp_embed_config(<target> <name> <fcl file>
+#                       [FHICL_FILE_PATH <path>] [DEPENDS <files>...])
+#
+# Parses <fcl file> at build time and generates the header <name>.hxx, which
+# embeds the resolved document as a fhicl::snapshot, see
+# fhicl::snapshot::write_embedded. Including it in a source of <target> gives
+#
+#   fhicl::embedded::<name>()     the snapshot, built without parsing
+#   fhicl::embedded::<name>_id    its ParameterSet id
+#
+# The header is regenerated when <fcl file>, any file that it includes, or any
+# of DEPENDS changes. fhicl-dump writes the files that it read to a depfile
+# next to the header, which the build tool reads. Makefile generators only
+# read depfiles from CMake 3.20 on: with older versions the depfile of the
+# last build is read when configuring instead, and a change to it reruns
+# CMake, so includes are tracked from the second build on. FHICL_FILE_PATH is
+# the search path for includes, by default the directory of <fcl file>.
+
+# Depfile paths are taken relative to the current binary directory. fhicl-dump
+# writes absolute paths, so this only silences the policy warning.
+if(POLICY CMP0116)
+  cmake_policy(SET CMP0116 NEW)
+endif()
+
+function(fhiclcpp_embed_config TARGET NAME FCL_FILE)
+  cmake_parse_arguments(PARSE_ARGV 3 EMBED "" "FHICL_FILE_PATH" "DEPENDS")
+
+  get_filename_component(FCL_FILE_ABS ${FCL_FILE} ABSOLUTE)
+  if(NOT DEFINED EMBED_FHICL_FILE_PATH)
+    get_filename_component(EMBED_FHICL_FILE_PATH ${FCL_FILE_ABS} DIRECTORY)
+  endif()
+
+  if(TARGET fhicl-dump)
+    set(FHICL_DUMP $<TARGET_FILE:fhicl-dump>)
+    set(FHICL_DUMP_DEPENDS fhicl-dump)
+  else()
+    find_program(FHICLCPP_DUMP_EXECUTABLE fhicl-dump
+      HINTS ${fhiclcpp_PREFIX}/bin)
+    if(NOT FHICLCPP_DUMP_EXECUTABLE)
+      message(FATAL_ERROR "fhiclcpp_embed_config: could not find fhicl-dump")
+    endif()
+    set(FHICL_DUMP ${FHICLCPP_DUMP_EXECUTABLE})
+    set(FHICL_DUMP_DEPENDS ${FHICLCPP_DUMP_EXECUTABLE})
+  endif()
+
+  set(EMBED_DIR ${CMAKE_CURRENT_BINARY_DIR}/fhiclcpp_embedded)
+  set(EMBED_HEADER ${EMBED_DIR}/${NAME}.hxx)
+  set(EMBED_DEPFILE ${EMBED_DIR}/${NAME}.d)
+
+  if(CMAKE_GENERATOR MATCHES "Ninja" OR
+     NOT CMAKE_VERSION VERSION_LESS 3.21 OR
+     (CMAKE_GENERATOR MATCHES "Makefiles" AND
+      NOT CMAKE_VERSION VERSION_LESS 3.20))
+    set(EMBED_DEPFILE_ARGS DEPFILE ${EMBED_DEPFILE})
+  else()
+    set(EMBED_DEPFILE_ARGS)
+    if(EXISTS ${EMBED_DEPFILE})
+      # One prerequisite per line after the target, see fhicl-dump.
+      file(STRINGS ${EMBED_DEPFILE} EMBED_DEPFILE_LINES)
+      list(REMOVE_AT EMBED_DEPFILE_LINES 0)
+      foreach(LINE IN LISTS EMBED_DEPFILE_LINES)
+        string(REGEX REPLACE "^ +| *\\\\$" "" LINE "${LINE}")
+        string(REGEX REPLACE "\\\\([ #])" "\\1" LINE "${LINE}")
+        string(REPLACE "$$" "$" LINE "${LINE}")
+        list(APPEND EMBED_DEPENDS ${LINE})
+      endforeach()
+      set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS
+        ${EMBED_DEPFILE})
+    endif()
+  endif()
+
+  add_custom_command(OUTPUT ${EMBED_HEADER}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${EMBED_DIR}
+    COMMAND ${CMAKE_COMMAND} -E env FHICL_FILE_PATH=${EMBED_FHICL_FILE_PATH}
+      ${FHICL_DUMP} --write-embedded ${NAME} ${EMBED_HEADER}
+      --depfile ${EMBED_DEPFILE} ${FCL_FILE_ABS}
+    DEPENDS ${FCL_FILE_ABS} ${EMBED_DEPENDS} ${FHICL_DUMP_DEPENDS}
+    ${EMBED_DEPFILE_ARGS}
+    COMMENT "Embedding ${FCL_FILE} as fhicl::embedded::${NAME}"
+    VERBATIM)
+
+  target_sources(${TARGET} PRIVATE ${EMBED_HEADER})
+  target_include_directories(${TARGET} PRIVATE ${EMBED_DIR})
+endfunction()
@@ -4,6 +4,11 @@
 #include "fhiclcpp/types/Sequence.hxx"
 
 #include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+#include "fhiclcpp/types/FrozenParameterSet.hxx"
+#include "fhiclcpp/types/ParameterSetOverlay.hxx"
+#include "fhiclcpp/types/ParameterSetRegistry.hxx"
+#include "fhiclcpp/types/binding.hxx"
+#include "fhiclcpp/types/node_arena.hxx"
 
 #include "fhiclcpp/recursive_build_fhicl.hxx"
 
@@ -19,8 +24,7 @@ inline ParameterSet ParameterSet::make(std::string const &filename,
   ParameterSet prolog;
   ParameterSet working_doc;
 
-  fhicl::fhicl_doc doc = fhicl::read_doc(filename);
-  doc.resolve_includes();
+  fhicl::fhicl_doc doc = fhicl::read_resolved_doc(filename);
 
   return parse_fhicl_document(doc);
 }
@@ -30,4 +34,25 @@ inline ParameterSet make_ParameterSet(std::string const &filename) {
   return ParameterSet::make(filename, dummy);
 }
 
+inline ParameterSet make_ParameterSet(std::string const &filename,
+                                      parse_options const &options) {
+  return parse_fhicl_document(
+      std::make_shared<fhicl::fhicl_doc const>(
+          fhicl::read_resolved_doc(filename)),
+      options);
+}
+
+// As make_ParameterSet, but counts and times each phase of the parse, and
+// attributes the work to the files that were included, in stats.
+inline ParameterSet
+make_ParameterSet(std::string const &filename, parse_stats &stats,
+                  parse_options const &options = parse_options()) {
+  stats = parse_stats();
+  scoped_timer timer(&stats.total_ns);
+  return parse_fhicl_document(
+      std::make_shared<fhicl::fhicl_doc const>(
+          fhicl::read_resolved_doc(filename, &stats)),
+      options, &stats);
+}
+
 } // namespace fhicl
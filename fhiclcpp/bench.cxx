@@ -0,0 +1,379 @@
+#include "fhiclcpp/ParameterSet.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Unix
+#include <unistd.h>
+
+#ifndef FHICLCPP_VERSION
+#define FHICLCPP_VERSION "unknown"
+#endif
+
+// Generates synthetic documents, times the parser and the lookup path on them
+// and writes the results to stdout as JSON, so that they can be compared
+// across releases. Every allocation goes through the operator new below, which
+// counts it.
+
+namespace {
+std::atomic<uint64_t> n_allocs(0);
+std::atomic<uint64_t> n_alloc_bytes(0);
+
+// Not inlined, so that the compiler does not see malloc and free paired with
+// new and delete expressions.
+__attribute__((noinline)) void *counted_alloc(std::size_t size) {
+  n_allocs.fetch_add(1, std::memory_order_relaxed);
+  n_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *ptr = std::malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+__attribute__((noinline)) void counted_free(void *ptr) { std::free(ptr); }
+} // namespace
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void *ptr) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { counted_free(ptr); }
+
+namespace {
+
+// The shape of a generated document. Modules are spread over the top level
+// file, as physics.producers, and includes further files, each holding one
+// top level table of them.
+struct bench_case {
+  std::string name;
+  size_t modules;
+  // Depth of the chain of tables nested in each module.
+  size_t depth;
+  // Length of the numeric sequence in each module.
+  size_t seq_len;
+  // Every ref_every-th module uses @table and @local, 0 for none.
+  size_t ref_every;
+  size_t includes;
+};
+
+std::string module_text(size_t i, bench_case const &bc) {
+  std::stringstream ss;
+  bool refs = bc.ref_every && !(i % bc.ref_every);
+  ss << "  mod" << i << ": {" << std::endl;
+  if (refs) {
+    ss << "    @table::common" << std::endl;
+  }
+  ss << "    module_type: \"Producer" << (i % 17) << "\"" << std::endl
+     << "    id: " << i << " scale: " << (1.5 + i) << "e-3" << std::endl
+     << "    name: \"module_" << i << ", with {braces}\"" << std::endl
+     << "    flags: [true, false]" << std::endl
+     << "    vals: [";
+  for (size_t v = 0; v < bc.seq_len; ++v) {
+    ss << (v ? ", " : "") << (0.25 * double(v + i));
+  }
+  ss << "]" << std::endl;
+  if (refs) {
+    ss << "    bins: @local::binning" << std::endl;
+  }
+  ss << "    nested: ";
+  for (size_t d = 0; d < bc.depth; ++d) {
+    ss << "{ level" << d << ": ";
+  }
+  ss << i;
+  for (size_t d = 0; d < bc.depth; ++d) {
+    ss << " }";
+  }
+  ss << std::endl << "  }" << std::endl;
+  return ss.str();
+}
+
+// Writes the documents for bc into dir and returns the name of the top level
+// one, adds the number of bytes written to bytes.
+std::string generate(bench_case const &bc, std::string const &dir,
+                     size_t &bytes) {
+  size_t n_files = bc.includes + 1;
+  std::string top = dir + "/" + bc.name + ".fcl";
+  std::ofstream ofs(top);
+  std::stringstream ss;
+  ss << "BEGIN_PROLOG" << std::endl
+     << "common: { alpha: 1 beta: \"two, three\" gamma: [1, 2, 3] }"
+     << std::endl
+     << "binning: [";
+  for (size_t v = 0; v < 50; ++v) {
+    ss << (v ? ", " : "") << (0.5 * double(v));
+  }
+  ss << "]" << std::endl << "END_PROLOG" << std::endl;
+  for (size_t f = 1; f < n_files; ++f) {
+    std::string inc = dir + "/" + bc.name + ".inc" + std::to_string(f) + ".fcl";
+    std::stringstream inc_ss;
+    inc_ss << "extra" << f << ": {" << std::endl;
+    for (size_t i = f; i < bc.modules; i += n_files) {
+      inc_ss << module_text(i, bc);
+    }
+    inc_ss << "}" << std::endl;
+    std::ofstream(inc) << inc_ss.str();
+    bytes += inc_ss.str().size();
+    ss << "#include \"" << inc << "\"" << std::endl;
+  }
+  ss << "physics: {" << std::endl << " producers: {" << std::endl;
+  for (size_t i = 0; i < bc.modules; i += n_files) {
+    ss << module_text(i, bc);
+  }
+  ss << " }" << std::endl << "}" << std::endl;
+  ofs << ss.str();
+  bytes += ss.str().size();
+  return top;
+}
+
+struct measurement {
+  std::string op;
+  size_t iterations;
+  double total_ns;
+  double min_ns;
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  // Bytes processed per iteration, 0 if throughput is not meaningful.
+  size_t bytes;
+};
+
+class recorder {
+  std::vector<measurement> results;
+
+public:
+  // Times f(), iterations times, after an untimed call to setup() each time.
+  template <typename S, typename F>
+  void measure(std::string const &op, size_t iterations, size_t bytes,
+               S const &setup, F const &f) {
+    measurement m{op, iterations, 0, 0, 0, 0, bytes};
+    for (size_t it = 0; it < iterations; ++it) {
+      setup();
+      uint64_t allocs = n_allocs.load();
+      uint64_t alloc_bytes = n_alloc_bytes.load();
+      auto begin = std::chrono::steady_clock::now();
+      f();
+      auto end = std::chrono::steady_clock::now();
+      m.allocs += n_allocs.load() - allocs;
+      m.alloc_bytes += n_alloc_bytes.load() - alloc_bytes;
+      double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+      m.total_ns += ns;
+      m.min_ns = (it && (m.min_ns < ns)) ? m.min_ns : ns;
+    }
+    results.push_back(m);
+  }
+  template <typename F>
+  void measure(std::string const &op, size_t iterations, size_t bytes,
+               F const &f) {
+    measure(op, iterations, bytes, [] {}, f);
+  }
+
+  std::string to_json(std::string const &indent) const {
+    std::stringstream ss;
+    ss << "[";
+    for (size_t r = 0; r < results.size(); ++r) {
+      measurement const &m = results[r];
+      double n = double(m.iterations);
+      ss << (r ? "," : "") << std::endl
+         << indent << "  {\"op\": \"" << m.op << "\", \"iterations\": "
+         << m.iterations << ", \"wall_ns_per_op\": " << (m.total_ns / n)
+         << ", \"min_wall_ns\": " << m.min_ns;
+      if (m.bytes) {
+        ss << ", \"mb_per_s\": "
+           << ((double(m.bytes) * n) / (m.total_ns * 1E-9) / 1E6);
+      }
+      ss << ", \"allocs_per_op\": " << (double(m.allocs) / n)
+         << ", \"alloc_bytes_per_op\": " << (double(m.alloc_bytes) / n)
+         << "}";
+    }
+    ss << std::endl << indent << "]";
+    return ss.str();
+  }
+};
+
+void usage() {
+  std::cout
+      << "Usage: fhiclcpp_bench [--quick] [--repeat <n>] [--dir <dir>]"
+      << std::endl
+      << "  --quick   Generate documents a tenth of the default size."
+      << std::endl
+      << "  --repeat  How many times to parse and serialize each document, "
+         "default 5."
+      << std::endl
+      << "  --dir     Where to write the generated documents, default a "
+         "new directory in /tmp that is removed afterwards."
+      << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char const *argv[]) {
+  bool quick = false;
+  size_t repeat = 5;
+  std::string dir;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--quick") {
+      quick = true;
+    } else if ((arg == "--repeat") && ((i + 1) < argc)) {
+      repeat = std::max(size_t(std::strtoul(argv[++i], nullptr, 10)),
+                        size_t(1));
+    } else if ((arg == "--dir") && ((i + 1) < argc)) {
+      dir = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  bool remove_dir = !dir.size();
+  if (remove_dir) {
+    char tmpl[] = "/tmp/fhiclcpp_bench.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+      std::cerr << "[ERROR]: Failed to create a directory for the generated "
+                   "documents."
+                << std::endl;
+      return 1;
+    }
+    dir = tmpl;
+  }
+
+  size_t scale = quick ? 10 : 1;
+  size_t lookups = 100000 / scale;
+  std::vector<bench_case> cases{
+      {"small", 50, 2, 8, 0, 0},
+      {"large", 2000 / scale, 2, 8, 0, 0},
+      {"deep", 200 / scale, 32, 8, 0, 0},
+      {"long_sequences", 100 / scale, 2, 5000 / scale, 0, 0},
+      {"references", 1000 / scale, 2, 8, 1, 0},
+      {"include_fanout", 2000 / scale, 2, 8, 0, 32},
+      {"wide", 50000 / scale, 1, 2, 0, 0},
+  };
+
+  std::cout << "{" << std::endl
+            << "  \"fhiclcpp_version\": \"" << FHICLCPP_VERSION << "\","
+            << std::endl
+            << "  \"quick\": " << (quick ? "true" : "false") << ","
+            << std::endl
+            << "  \"cases\": [";
+
+  std::vector<std::string> generated;
+  for (size_t c = 0; c < cases.size(); ++c) {
+    bench_case const &bc = cases[c];
+    size_t bytes = 0;
+    std::string top = generate(bc, dir, bytes);
+    generated.push_back(top);
+    for (size_t f = 1; f <= bc.includes; ++f) {
+      generated.push_back(dir + "/" + bc.name + ".inc" + std::to_string(f) +
+                          ".fcl");
+    }
+
+    recorder rec;
+    fhicl::ParameterSet ps;
+    rec.measure("make_ParameterSet", repeat, bytes, [&] {
+      fhicl::clear_fhicl_file_cache();
+      ps = fhicl::make_ParameterSet(top);
+    });
+    fhicl::ParameterSetID id = 0;
+    fhicl::ParameterSet fresh;
+    rec.measure("id_uncached", repeat, 0,
+                [&] { fresh = fhicl::make_ParameterSet(top); },
+                [&] { id ^= fresh.id(); });
+    // The same with every digest computed on this thread, to compare with the
+    // parallel digest of wide tables in id_uncached.
+    rec.measure("id_uncached_serial", repeat, 0,
+                [&] { fresh = fhicl::make_ParameterSet(top); },
+                [&] {
+                  fhicl::parallel_digest_active() = true;
+                  id ^= fresh.id();
+                  fhicl::parallel_digest_active() = false;
+                });
+    id ^= ps.id();
+    rec.measure("id_cached", lookups, 0, [&] { id ^= ps.id(); });
+
+    // Hot keys on a module in the top level file.
+    std::string mod = "physics.producers.mod0.";
+    std::string leaf = mod + "nested";
+    for (size_t d = 0; d < bc.depth; ++d) {
+      leaf += ".level" + std::to_string(d);
+    }
+    fhicl::key_path id_key(mod + "id");
+    int64_t sum = 0;
+    rec.measure("get_int", lookups, 0,
+                [&] { sum += ps.get<int>(mod + "id"); });
+    rec.measure("get_int_key_path", lookups, 0,
+                [&] { sum += ps.get<int>(id_key); });
+    rec.measure("get_double", lookups, 0,
+                [&] { sum += int64_t(ps.get<double>(mod + "scale")); });
+    rec.measure("get_string", lookups, 0,
+                [&] { sum += ps.get<std::string>(mod + "name").size(); });
+    rec.measure("get_vector_double", lookups, 0, [&] {
+      sum += ps.get<std::vector<double>>(mod + "vals").size();
+    });
+    rec.measure("get_nested_leaf", lookups, 0,
+                [&] { sum += ps.get<int>(leaf); });
+
+    size_t str_size = ps.to_string().size();
+    rec.measure("to_string", repeat, str_size,
+                [&] { sum += ps.to_string().size(); });
+    size_t indented_size = ps.to_indented_string().size();
+    rec.measure("to_indented_string", repeat, indented_size,
+                [&] { sum += ps.to_indented_string().size(); });
+
+    rec.measure("copy", lookups, 0, [&] {
+      fhicl::ParameterSet cpy(ps);
+      sum += cpy.is_empty();
+    });
+    rec.measure("copy_and_modify", repeat, 0, [&] {
+      fhicl::ParameterSet cpy(ps);
+      cpy.put_or_replace(mod + "id", 7);
+      sum += cpy.is_empty();
+    });
+
+    // Building and trimming a table as wide as physics.producers.
+    rec.measure("put_keys", repeat, 0, [&] {
+      fhicl::ParameterSet wide;
+      for (size_t i = 0; i < bc.modules; ++i) {
+        wide.put_or_replace("key" + std::to_string(i), int(i));
+      }
+      sum += wide.get_names().size();
+    });
+    fhicl::ParameterSet producers;
+    rec.measure("erase_keys", repeat, 0,
+                [&] {
+                  producers = ps.get<fhicl::ParameterSet>("physics.producers");
+                  producers.put_or_replace("unshared", 1);
+                },
+                [&] {
+                  for (size_t i = 0; i < 10; ++i) {
+                    sum += producers.erase("mod" + std::to_string(i));
+                  }
+                });
+
+    std::cout << (c ? "," : "") << std::endl
+              << "    {\"name\": \"" << bc.name << "\", \"modules\": "
+              << bc.modules << ", \"depth\": " << bc.depth
+              << ", \"seq_len\": " << bc.seq_len
+              << ", \"ref_every\": " << bc.ref_every
+              << ", \"includes\": " << bc.includes << ", \"bytes\": " << bytes
+              << "," << std::endl
+              << "     \"checksum\": " << (sum ^ int64_t(id & 0xFFFF)) << ","
+              << std::endl
+              << "     \"results\": " << rec.to_json("     ") << "}";
+  }
+  std::cout << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+  for (std::string const &f : generated) {
+    std::remove(f.c_str());
+  }
+  if (remove_dir) {
+    rmdir(dir.c_str());
+  }
+}
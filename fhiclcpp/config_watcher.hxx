@@ -0,0 +1,414 @@
+#pragma once
+
+#include "fhiclcpp/ParameterSet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fhicl {
+
+// Keeps the ParameterSet built from a top-level file up to date as that file,
+// or any file that it includes, is edited. For example:
+//
+//   config_watcher watcher("monitor.fcl");
+//   watcher.subscribe([](std::shared_ptr<ParameterSet const> const &ps,
+//                        std::vector<std::string> const &changed_keys) {
+//     ...
+//   });
+//   watcher.start();
+//   ...
+//   std::shared_ptr<ParameterSet const> ps = watcher.current();
+//
+// The files watched are those of the include graph recorded when the
+// document was last read. On Linux, start watches their directories with
+// inotify, so that an edit is seen however an editor writes the file, and
+// elsewhere the files are polled. Only the files that changed are read again,
+// the others come from the include cache.
+//
+// As any value may be overridden, or referenced through @local or @table, by
+// the text after it, the flattened document is walked again as a whole. Only
+// the tables that may depend on what changed are parsed again though: a table
+// body without reference directives whose lines are unchanged is taken from
+// the previous parse, see table_body_cache. The new set then takes over every
+// other value of the previous one that is unchanged, so that those nodes, and
+// what they have cached, such as decoded atoms, packed sequences and table
+// ids, survive the reload. The keys whose values differ are passed to the
+// subscribers.
+//
+// A new set is published atomically: current() returns either the previous
+// set or the new one, and a published set is never modified. If the edited
+// document fails to parse, the previous set stays current and the error is
+// kept in last_error. So is an exception thrown by a subscriber when the
+// reload was made by the background thread, which has no caller to throw to.
+class config_watcher {
+public:
+  typedef std::function<void(std::shared_ptr<ParameterSet const> const &,
+                             std::vector<std::string> const &)>
+      subscriber;
+
+private:
+  std::string filename;
+  parse_options options;
+  std::chrono::milliseconds interval;
+
+  std::shared_ptr<ParameterSet const> published;
+  std::atomic<uint64_t> generation_;
+
+  // Held while reloading and publishing, but not while notifying the
+  // subscribers, so that they may call includes or last_error.
+  mutable std::mutex reload_mtx;
+  include_graph graph;
+  std::map<std::string, fhicl_file_stamp> stamps;
+  std::string error;
+  table_body_cache bodies;
+  parse_stats last_stats;
+
+  std::mutex subscribers_mtx;
+  std::map<size_t, subscriber> subscribers;
+  size_t next_subscriber;
+  // The generation whose subscribers were last notified. A reload waits for
+  // the one before its own, so that subscribers see the sets in the order
+  // they were published.
+  std::mutex notify_mtx;
+  std::condition_variable notify_cv;
+  uint64_t notified;
+
+  std::thread watcher;
+  std::atomic<bool> stopping;
+
+  static std::map<std::string, fhicl_file_stamp>
+  read_stamps(include_graph const &g) {
+    std::map<std::string, fhicl_file_stamp> st;
+    for (auto const &f : g.files) {
+      fhicl_file_stamp &stamp = st[f.first];
+      if (!fhicl_file_stamp::get(f.second.path, stamp)) { // deleted
+        stamp = {-1, -1, -1};
+      }
+    }
+    return st;
+  }
+
+  std::shared_ptr<ParameterSet> load(include_graph &g) {
+    parse_stats stats;
+    std::shared_ptr<ParameterSet> ps =
+        std::make_shared<ParameterSet>(parse_fhicl_document(
+            std::make_shared<fhicl_doc const>(
+                read_resolved_doc(filename, nullptr, &g)),
+            options, &stats, &bodies));
+    last_stats = std::move(stats);
+    return ps;
+  }
+
+  // Replaces each value of fresh that is the same as in old, compared by
+  // digest, with the node from old, and appends the keys, below prefix, that
+  // were added, removed or changed to changed. Tables that differ are merged
+  // in turn, so that only the values that changed are reported.
+  static void merge_unchanged(ParameterSet &fresh, ParameterSet const &old,
+                              std::string const &prefix,
+                              std::vector<std::string> &changed) {
+    fresh.unshare();
+    auto &fresh_rep = fresh.rep->internal_rep;
+    auto const &old_rep = old.rep->internal_rep;
+    for (auto const &kv : old_rep) {
+      if (fresh_rep.find(kv.first) == fresh_rep.end()) {
+        changed.push_back(prefix + kv.first);
+      }
+    }
+    for (auto &kv : fresh_rep) {
+      auto old_it = old_rep.find(kv.first);
+      if (old_it == old_rep.end()) {
+        changed.push_back(prefix + kv.first);
+        continue;
+      }
+      std::shared_ptr<Base> &slot = kv.second;
+      std::shared_ptr<Base> const &old_value = old_it->second;
+      if (!slot || !old_value || (slot->kind() != old_value->kind())) {
+        changed.push_back(prefix + kv.first);
+        continue;
+      }
+      if (slot->digest() == old_value->digest()) {
+        slot = old_value;
+        continue;
+      }
+      if (slot->kind() == node_kind::kTable) {
+        ParameterSet::unshare_value(slot);
+        merge_unchanged(static_cast<ParameterSet &>(*slot),
+                        static_cast<ParameterSet const &>(*old_value),
+                        prefix + kv.first + ".", changed);
+        continue;
+      }
+      changed.push_back(prefix + kv.first);
+    }
+  }
+
+  // Splits path into its directory and the name within it.
+  static std::pair<std::string, std::string> split_path(std::string const &p) {
+    size_t slash = p.find_last_of('/');
+    if (slash == std::string::npos) {
+      return {".", p};
+    }
+    return {slash ? p.substr(0, slash) : "/", p.substr(slash + 1)};
+  }
+
+  void done_notifying(uint64_t gen) {
+    std::lock_guard<std::mutex> lock(notify_mtx);
+    notified = gen;
+    notify_cv.notify_all();
+  }
+
+#ifdef __linux__
+  // Adds a watch for each directory holding a file of the include graph that
+  // is not watched yet, so that files newly included after a reload are
+  // watched too. Returns true if any was added.
+  bool watch_directories(int fd, std::map<int, std::string> &dirs) const {
+    bool added = false;
+    for (auto const &f : includes().files) {
+      std::string dir = split_path(f.second.path).first;
+      bool watched = false;
+      for (auto const &d : dirs) {
+        watched = watched || (d.second == dir);
+      }
+      if (watched) {
+        continue;
+      }
+      int wd = inotify_add_watch(fd, dir.c_str(),
+                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                     IN_CREATE | IN_DELETE);
+      if (wd >= 0) {
+        dirs[wd] = dir;
+        added = true;
+      }
+    }
+    return added;
+  }
+
+  // Waits up to interval for events, then returns the files of the include
+  // graph that they concern. Events that arrive together, as when an editor
+  // writes and renames a file, are collected in one go.
+  std::vector<std::string>
+  wait_for_events(int fd, std::map<int, std::string> const &dirs) const {
+    std::vector<std::string> touched;
+    pollfd pfd{fd, POLLIN, 0};
+    if (::poll(&pfd, 1, int(interval.count())) <= 0) {
+      return touched;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::vector<std::pair<std::string, std::string>> names;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char *ptr = buffer; ptr < (buffer + len);
+           ptr += sizeof(inotify_event) +
+                  reinterpret_cast<inotify_event *>(ptr)->len) {
+        inotify_event const *ev = reinterpret_cast<inotify_event *>(ptr);
+        auto dir_it = dirs.find(ev->wd);
+        if (ev->len && (dir_it != dirs.end())) {
+          names.emplace_back(dir_it->second, ev->name);
+        }
+      }
+    }
+    for (auto const &f : includes().files) {
+      if (std::find(names.begin(), names.end(), split_path(f.second.path)) !=
+          names.end()) {
+        touched.push_back(f.first);
+      }
+    }
+    return touched;
+  }
+#endif
+
+  // Reloads on the watcher thread, where an exception, such as one thrown by a
+  // subscriber, has no caller to go to and is kept in last_error instead.
+  void reload_in_background(std::vector<std::string> const &touched = {}) {
+    try {
+      reload_if_changed(touched);
+    } catch (std::exception &e) {
+      std::lock_guard<std::mutex> lock(reload_mtx);
+      error = e.what();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(reload_mtx);
+      error = "unknown exception while reloading";
+    }
+  }
+
+  void run() {
+#ifdef __linux__
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    std::map<int, std::string> dirs;
+    while (!stopping) {
+      if (fd < 0) { // fall back to polling
+        std::this_thread::sleep_for(interval);
+        reload_in_background();
+        continue;
+      }
+      if (watch_directories(fd, dirs)) {
+        // Catches up with edits made before the new watches were added.
+        reload_in_background();
+      }
+      std::vector<std::string> touched = wait_for_events(fd, dirs);
+      if (touched.size() && !stopping) {
+        reload_in_background(touched);
+      }
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+#else
+    while (!stopping) {
+      std::this_thread::sleep_for(interval);
+      reload_in_background();
+    }
+#endif
+  }
+
+public:
+  // Reads and parses filename, throwing as make_ParameterSet does if it
+  // cannot. interval is how often start polls the files, or checks whether it
+  // has been stopped.
+  explicit config_watcher(
+      std::string const &fname, parse_options const &opts = parse_options(),
+      std::chrono::milliseconds poll_interval = std::chrono::milliseconds(100))
+      : filename(fname), options(opts), interval(poll_interval), published(),
+        generation_(0), reload_mtx(), graph(), stamps(), error(), bodies(),
+        last_stats(), subscribers_mtx(), subscribers(), next_subscriber(0), notify_mtx(),
+        notify_cv(), notified(0), watcher(), stopping(false) {
+    published = load(graph);
+    stamps = read_stamps(graph);
+  }
+  config_watcher(config_watcher const &) = delete;
+  config_watcher &operator=(config_watcher const &) = delete;
+  ~config_watcher() { stop(); }
+
+  std::shared_ptr<ParameterSet const> current() const {
+    return std::atomic_load(&published);
+  }
+  // The number of sets published after the first.
+  uint64_t generation() const { return generation_.load(); }
+  include_graph includes() const {
+    std::lock_guard<std::mutex> lock(reload_mtx);
+    return graph;
+  }
+  // Why the last reload failed, empty if it did not.
+  std::string last_error() const {
+    std::lock_guard<std::mutex> lock(reload_mtx);
+    return error;
+  }
+  // The work done by the last parse, which shows how many tables were
+  // reused rather than parsed again.
+  parse_stats last_parse_stats() const {
+    std::lock_guard<std::mutex> lock(reload_mtx);
+    return last_stats;
+  }
+
+  // Calls s with each new set and the keys that differ from the set before,
+  // sorted, on the thread that reloaded, in the order the sets were
+  // published. s may call includes or last_error, but must not itself reload.
+  size_t subscribe(subscriber s) {
+    std::lock_guard<std::mutex> lock(subscribers_mtx);
+    subscribers[next_subscriber] = std::move(s);
+    return next_subscriber++;
+  }
+  void unsubscribe(size_t id) {
+    std::lock_guard<std::mutex> lock(subscribers_mtx);
+    subscribers.erase(id);
+  }
+
+  // Reloads if any file of the include graph has changed on disk since it was
+  // read, or is named in touched, as it is named in the graph. Returns true
+  // if a new set was published, which it is not if the document fails to
+  // parse or if no value changed, for example if only comments were edited.
+  bool reload_if_changed(std::vector<std::string> const &touched = {}) {
+    std::unique_lock<std::mutex> lock(reload_mtx);
+    std::map<std::string, fhicl_file_stamp> now = read_stamps(graph);
+    bool dirty = false;
+    for (auto const &st : now) {
+      bool named = std::find(touched.begin(), touched.end(), st.first) !=
+                   touched.end();
+      if (named || !(stamps[st.first] == st.second)) {
+        fhicl_file_cache::instance().forget(graph.files[st.first].path);
+        dirty = true;
+      }
+    }
+    if (!dirty) {
+      return false;
+    }
+
+    include_graph g;
+    std::shared_ptr<ParameterSet> fresh;
+    try {
+      fresh = load(g);
+    } catch (std::exception &e) {
+      error = e.what();
+      stamps = std::move(now); // not again until the next edit
+      return false;
+    }
+    error.clear();
+    graph = std::move(g);
+    stamps = read_stamps(graph);
+
+    std::vector<std::string> changed;
+    merge_unchanged(*fresh, *current(), "", changed);
+    if (!changed.size()) {
+      return false;
+    }
+    std::sort(changed.begin(), changed.end());
+    std::shared_ptr<ParameterSet const> next = std::move(fresh);
+    std::atomic_store(&published, next);
+    uint64_t gen = ++generation_;
+    lock.unlock();
+
+    {
+      std::unique_lock<std::mutex> notify_lock(notify_mtx);
+      notify_cv.wait(notify_lock, [&] { return notified == (gen - 1); });
+    }
+    std::map<size_t, subscriber> subs;
+    {
+      std::lock_guard<std::mutex> sub_lock(subscribers_mtx);
+      subs = subscribers;
+    }
+    try {
+      for (auto const &s : subs) {
+        s.second(next, changed);
+      }
+    } catch (...) {
+      done_notifying(gen);
+      throw;
+    }
+    done_notifying(gen);
+    return true;
+  }
+
+  // Watches for edits on a background thread until stop is called.
+  void start() {
+    if (watcher.joinable()) {
+      return;
+    }
+    stopping = false;
+    watcher = std::thread([this] { run(); });
+  }
+  void stop() {
+    stopping = true;
+    if (watcher.joinable()) {
+      watcher.join();
+    }
+  }
+  bool is_running() const { return watcher.joinable(); }
+};
+
+} // namespace fhicl
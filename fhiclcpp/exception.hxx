@@ -22,6 +22,7 @@ NEW_EXCEPT(file_does_not_exist);
 NEW_EXCEPT(include_loop);
 NEW_EXCEPT(internal_error);
 NEW_EXCEPT(malformed_document);
+NEW_EXCEPT(malformed_snapshot);
 
 #undef NEW_EXCEPT
 
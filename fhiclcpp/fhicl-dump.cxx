@@ -1,25 +1,153 @@
-
 #include "ParameterSet.h"
+#include "snapshot.hxx"
 
+#include <fstream>
 #include <iostream>
 
+#include <unistd.h>
+
 bool compact = false;
+bool from_snapshot = false;
+bool print_stats = false;
+bool json = false;
+bool arena = false;
+std::string snapshot_out;
+std::string embedded_name;
+std::string embedded_out;
+std::string depfile_out;
+
+void usage() {
+  std::cout << "[ERROR]: Expected to be passed an optional -c compact "
+               "specifier, an optional --snapshot specifier to read a "
+               "snapshot instead of a fcl file, an optional --write-snapshot "
+               "<file> to write the parsed fcl file as a snapshot, an "
+               "optional --write-embedded <name> <header> to write it as a "
+               "C++ header that embeds the snapshot, an optional --depfile "
+               "<file> to write the files that either of those was read "
+               "from as a Makefile rule, an optional --stats "
+               "specifier to print parse statistics to stderr, an optional "
+               "--json specifier to print JSON, an optional --arena "
+               "specifier to allocate the tree's nodes from an arena, and a "
+               "single file name."
+            << std::endl;
+}
+
+// path as a Makefile prerequisite, absolute so that it does not depend on
+// where the build tool reads the depfile from.
+std::string depfile_path(std::string const &path) {
+  std::string abs = path;
+  if (abs.empty() || (abs[0] != '/')) {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd))) {
+      abs = std::string(cwd) + "/" + abs;
+    }
+  }
+  std::string escaped;
+  for (char c : abs) {
+    if ((c == ' ') || (c == '#')) {
+      escaped += '\\';
+    } else if (c == '$') {
+      escaped += '$';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// Writes a Makefile rule making target depend on every file that fname
+// includes, directly or not, and on fname itself, so that a build tool can
+// regenerate target when any of them changes. One prerequisite per line.
+void write_depfile(std::string const &target, std::string const &fname) {
+  fhicl::include_graph graph;
+  fhicl::read_resolved_doc(fname, nullptr, &graph);
+  std::ofstream ofs(depfile_out, std::ios::trunc);
+  ofs << depfile_path(target) << ":";
+  for (auto const &f : graph.files) {
+    ofs << " \\\n  " << depfile_path(f.second.path);
+  }
+  ofs << "\n";
+  if (!ofs.good()) {
+    throw fhicl::file_does_not_exist()
+        << "[ERROR]: Failed to write depfile to " << std::quoted(depfile_out)
+        << ".";
+  }
+}
 
 int main(int argc, char const *argv[]) {
-  if ((argc != 2) && (argc != 3)) {
-    std::cout << "[ERROR]: Expected to be passed an option -c compact "
-                 "specifier and a single fcl file name."
-              << std::endl;
+  if (argc < 2) {
+    usage();
     return 1;
   }
 
+  for (int i = 1; i < (argc - 1); ++i) {
+    std::string arg = argv[i];
+    if (arg == "-c") {
+      compact = true;
+    } else if (arg == "--snapshot") {
+      from_snapshot = true;
+    } else if (arg == "--json") {
+      json = true;
+    } else if (arg == "--stats") {
+      print_stats = true;
+    } else if (arg == "--arena") {
+      arena = true;
+    } else if ((arg == "--write-snapshot") && ((i + 2) < argc)) {
+      snapshot_out = argv[++i];
+    } else if ((arg == "--write-embedded") && ((i + 3) < argc)) {
+      embedded_name = argv[++i];
+      embedded_out = argv[++i];
+    } else if ((arg == "--depfile") && ((i + 2) < argc)) {
+      depfile_out = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
   std::string fname = argv[argc - 1];
-  if ((argc == 3) && (std::string(argv[1]) == "-c")) {
-    compact = true;
+  if (depfile_out.size() &&
+      (from_snapshot || (snapshot_out.empty() && embedded_out.empty()))) {
+    usage();
+    return 1;
   }
 
-  fhicl::ParameterSet ps = fhicl::make_ParameterSet(fname);
+  fhicl::parse_stats stats;
+  fhicl::parse_options options;
+  options.arena = arena;
+  fhicl::ParameterSet ps =
+      from_snapshot
+          ? fhicl::snapshot(fname).to_ParameterSet()
+          : (print_stats ? fhicl::make_ParameterSet(fname, stats, options)
+                         : fhicl::make_ParameterSet(fname, options));
 
-  std::cout << (compact ? ps.to_string() : ps.to_indented_string(2))
-            << std::endl;
+  if (print_stats) {
+    if (!from_snapshot) {
+      std::cerr << stats.to_string();
+    }
+    std::cerr << "memory:     " << ps.memory_usage().to_string() << std::endl;
+  }
+
+  if (snapshot_out.size()) {
+    fhicl::snapshot::write(ps, snapshot_out);
+    if (depfile_out.size()) {
+      write_depfile(snapshot_out, fname);
+    }
+    return 0;
+  }
+  if (embedded_out.size()) {
+    fhicl::snapshot::write_embedded(ps, embedded_name, embedded_out, fname);
+    if (depfile_out.size()) {
+      write_depfile(embedded_out, fname);
+    }
+    return 0;
+  }
+
+  if (json) {
+    ps.write_json(std::cout);
+  } else if (compact) {
+    ps.write(std::cout);
+  } else {
+    ps.write_indented(std::cout, 2);
+  }
+  std::cout << std::endl;
 }
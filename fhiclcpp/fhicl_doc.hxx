@@ -1,6 +1,9 @@
 #pragma once
 
 #include "fhiclcpp/exception.hxx"
+#include "fhiclcpp/mapped_file.hxx"
+#include "fhiclcpp/parse_stats.hxx"
+#include "fhiclcpp/structural_index.hxx"
 
 #include "fhiclcpp/string_parsers/traits.hxx"
 #include "fhiclcpp/string_parsers/utility.hxx"
@@ -12,18 +15,35 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // Unix
 #include <dirent.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace fhicl {
 
 class fhicl_doc;
+struct include_graph;
 
 inline fhicl_doc read_doc(std::string const &filename);
+inline void append_resolved_doc(fhicl_doc &doc, std::string const &filename,
+                                std::vector<std::string> &include_chain,
+                                parse_stats *stats = nullptr,
+                                include_graph *graph = nullptr);
+[[noreturn]] inline void
+throw_include_not_found(fhicl_doc const &doc, size_t line_no,
+                        std::string const &inc_file_name,
+                        file_does_not_exist const &e);
+inline linedoc::doc_line_point find_matching_bracket_scan(
+    fhicl_doc const &doc, char open_bracket, char close_bracket,
+    linedoc::doc_line_point begin);
 inline linedoc::doc_line_point find_matching_bracket(
     fhicl_doc const &doc, char open_bracket = '{', char close_bracket = '}',
     linedoc::doc_line_point begin = linedoc::doc_line_point::begin());
@@ -39,66 +59,82 @@ class fhicl_doc : public linedoc::doc {
   friend std::vector<linedoc::doc_range>
   get_list_elements(fhicl_doc const &, linedoc::doc_range, bool);
 
+  mutable std::shared_ptr<structural_index const> index_cache;
+
 public:
+  // Any change to the lines invalidates the structural index.
+  template <typename... Args> void push_back(Args &&... args) {
+    index_cache.reset();
+    linedoc::doc::push_back(std::forward<Args>(args)...);
+  }
+  template <typename... Args> void insert(Args &&... args) {
+    index_cache.reset();
+    linedoc::doc::insert(std::forward<Args>(args)...);
+  }
+  template <typename... Args> void remove_line(Args &&... args) {
+    index_cache.reset();
+    linedoc::doc::remove_line(std::forward<Args>(args)...);
+  }
+
+  // Built on first use, after which bracket matching and searches for
+  // structural characters no longer rescan the document.
+  structural_index const &index() const {
+    if (!index_cache) {
+      index_cache = std::make_shared<structural_index const>(*this);
+    }
+    return *index_cache;
+  }
+
+  // Equivalent to linedoc::doc::find_first_of for a single character, but
+  // answered from the structural index where possible.
+  linedoc::doc_line_point
+  find_first_of_indexed(char c, linedoc::doc_line_point from,
+                        linedoc::doc_line_point to =
+                            linedoc::doc_line_point::end()) const {
+    if (!structural_index::is_indexed(c)) {
+      return find_first_of(c, from, to);
+    }
+    return index().find_first_of(c, from, to);
+  }
+
   // #define DEBUG_RESOLVE_INCLUDES
 
+  // Included files are read through the include cache and expanded with their
+  // own includes, so the inserted lines need not be searched again.
   void resolve_includes(std::vector<std::string> include_chain = {}) {
-    for (size_t i = 0; i < size(); ++i) {
+    size_t i = 0;
+    while (i < size()) {
 #ifdef DEBUG_RESOLVE_INCLUDES
       std::cout << "[dri]: Checking line: " << std::quoted(at(i).characters)
                 << " for include statements..." << std::endl;
 #endif
-      if (at(i).characters.find("#include \"") == 0) {
-#ifdef DEBUG_RESOLVE_INCLUDES
-        std::cout << "[dri]: Found one." << std::endl;
-#endif
-        size_t matchting_quote = at(i).characters.find_first_of('\"', 10);
-        std::string inc_file_name =
-            at(i).characters.substr(10, matchting_quote - 10);
-        if (std::find(include_chain.begin(), include_chain.end(),
-                      inc_file_name) != include_chain.end()) {
-
-          throw include_loop()
-              << "[ERROR]: Detected an include loop when trying to include: "
-              << std::quoted(inc_file_name) << ". Current include chain: "
-              << string_parsers::T2Str<std::vector<std::string>>(include_chain);
-        }
-        fhicl_doc inc;
-        try {
-          inc = read_doc(inc_file_name);
-        } catch (file_does_not_exist &e) {
-          throw file_does_not_exist()
-              << "[ERROR]: When attempting to resolving include statement, "
-                 "found at "
-              << get_line_info(linedoc::doc_line_point{i, 0}) << " = "
-              << std::quoted(get_line(linedoc::doc_line_point{i, 0}))
-              << " caught exception:\n  --" << e.what() << "\n\n File "
-              << std::quoted(inc_file_name)
-              << " not found, or FHICL_FILE_PATH (="
-              << (getenv("FHICL_FILE_PATH")
-                      ? std::quoted(std::string(getenv("FHICL_FILE_PATH")))
-                      : std::quoted(std::string("")))
-              << ") improperly defined.";
-        }
-        include_chain.push_back(inc_file_name);
-        inc.resolve_includes(include_chain);
-
-#ifdef DEBUG_RESOLVE_INCLUDES
-        std::cout << "[dri]: Loaded one with: " << inc.size() << " lines."
-                  << std::endl;
-#endif
+      if (at(i).characters.find("#include \"") != 0) {
+        ++i;
+        continue;
+      }
 #ifdef DEBUG_RESOLVE_INCLUDES
-        std::cout << "[dri]: Before insert: " << size() << std::endl;
+      std::cout << "[dri]: Found one." << std::endl;
 #endif
-        // remove the #include line
-        remove_line(i);
-        // add the rest of the other file, file ID remap is done in insert.
-        insert(std::move(inc), i);
+      size_t matchting_quote = at(i).characters.find_first_of('\"', 10);
+      std::string inc_file_name =
+          at(i).characters.substr(10, matchting_quote - 10);
+      fhicl_doc inc;
+      try {
+        append_resolved_doc(inc, inc_file_name, include_chain);
+      } catch (file_does_not_exist &e) {
+        throw_include_not_found(*this, i, inc_file_name, e);
+      }
+
 #ifdef DEBUG_RESOLVE_INCLUDES
-        std::cout << "[dri]: After insert: " << size() << std::endl;
+      std::cout << "[dri]: Loaded one with: " << inc.size() << " lines."
+                << std::endl;
 #endif
-      include_chain.pop_back();
-      }
+      size_t inc_size = inc.size();
+      // remove the #include line
+      remove_line(i);
+      // add the rest of the other file, file ID remap is done in insert.
+      insert(std::move(inc), i);
+      i += inc_size;
     }
   }
 
@@ -115,6 +151,21 @@ linedoc::doc_line_point find_matching_bracket(fhicl_doc const &doc,
                                               char open_bracket,
                                               char close_bracket,
                                               linedoc::doc_line_point begin) {
+  if (!doc.is_end(begin)) {
+    linedoc::doc_line_point match =
+        doc.index().find_matching_bracket(open_bracket, close_bracket, begin);
+    if (!doc.is_end(match)) {
+      return match;
+    }
+  }
+  // Not an opener that the index could resolve, this will either find the
+  // match by scanning or throw the appropriate exception.
+  return find_matching_bracket_scan(doc, open_bracket, close_bracket, begin);
+}
+
+linedoc::doc_line_point
+find_matching_bracket_scan(fhicl_doc const &doc, char open_bracket,
+                           char close_bracket, linedoc::doc_line_point begin) {
 
   if (doc.is_end(begin)) {
     throw internal_error()
@@ -270,10 +321,18 @@ get_list_elements(fhicl_doc const &doc, linedoc::doc_range range, bool trim) {
   static const std::map<char, char> type_care_brackets =
       string_rep_delim<std::vector<std::string>>::brackets();
 
+  // Searches stop at the end of the range, so that splitting a short list
+  // does not walk the rest of the document, the last element ends there.
+  auto next_comma = [&](linedoc::doc_line_point from) {
+    linedoc::doc_line_point comma =
+        doc.find_first_of_indexed(',', from, range.end);
+    return doc.is_end(comma) ? range.end : comma;
+  };
+
   while (doc.is_earlier(searchZero, range.end)) {
 
     linedoc::doc_line_point next_comment =
-        doc.find_first_of('#', searchZero, range.end);
+        doc.find_first_of_indexed('#', searchZero, range.end);
 
 #ifdef DEBUG_GET_LIST_ELEMENTS
     std::cout << "  Next comment character at " << next_comment << " -- "
@@ -306,7 +365,7 @@ get_list_elements(fhicl_doc const &doc, linedoc::doc_range range, bool trim) {
     std::cout << "  Searching for next comma after: " << searchZero << " -- "
               << std::quoted(doc.get_line(searchZero, true)) << std::endl;
 #endif
-    nextOccurence = doc.find_first_of(',', searchZero);
+    nextOccurence = next_comma(searchZero);
 
 #ifdef DEBUG_GET_LIST_ELEMENTS
     std::cout << "  Next comma at: " << nextOccurence << " -- "
@@ -325,8 +384,8 @@ get_list_elements(fhicl_doc const &doc, linedoc::doc_range range, bool trim) {
       linedoc::doc_line_point nextBracket = nextOccurence;
       std::pair<char, char> brackets{'\0', '\0'};
       for (auto const &bracket_pair : type_care_brackets) {
-        linedoc::doc_line_point f =
-            doc.find_first_of(bracket_pair.first, bracketSearchZero);
+        linedoc::doc_line_point f = doc.find_first_of_indexed(
+            bracket_pair.first, bracketSearchZero, nextOccurence);
 #ifdef DEBUG_GET_LIST_ELEMENTS
         std::cout << "  Next bracket of type " << bracket_pair.first
                   << " is at: " << f << " -- "
@@ -400,7 +459,7 @@ get_list_elements(fhicl_doc const &doc, linedoc::doc_range range, bool trim) {
                     << std::quoted(doc.get_line(bracketSearchZero, true))
                     << std::endl;
 #endif
-          nextOccurence = doc.find_first_of(',', bracketSearchZero);
+          nextOccurence = next_comma(bracketSearchZero);
 #ifdef DEBUG_GET_LIST_ELEMENTS
           std::cout << " Updated next comma occurence to: " << nextOccurence
                     << " -- " << std::quoted(doc.get_line(nextOccurence, true))
@@ -528,8 +587,173 @@ get_list_elements(fhicl_doc const &doc, linedoc::doc_range range, bool trim) {
 
 // #define DEBUG_OPEN_FHICL_FILE
 
-inline std::unique_ptr<std::ifstream>
-open_fhicl_file(std::string const &filename) {
+// Identifies the version of a file that a cached copy was read from.
+struct fhicl_file_stamp {
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  int64_t size;
+
+  // Returns false if path cannot be stat'ed.
+  static bool get(std::string const &path, fhicl_file_stamp &stamp) {
+    struct stat st;
+    if (stat(path.c_str(), &st)) {
+      return false;
+    }
+#ifdef __APPLE__
+    stamp.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    stamp.mtime_sec = int64_t(st.st_mtime);
+    stamp.size = int64_t(st.st_size);
+    return true;
+  }
+  bool operator==(fhicl_file_stamp const &other) const {
+    return (mtime_sec == other.mtime_sec) &&
+           (mtime_nsec == other.mtime_nsec) && (size == other.size);
+  }
+};
+
+// Maps file names to their location in the directories of a FHICL_FILE_PATH.
+// Each distinct search path is indexed with a single pass over its
+// directories, after which resolving a name only stats the directories that
+// could change the answer. As with a search, the first directory containing a
+// name wins.
+class fhicl_file_path_index {
+  struct directory {
+    std::string path;
+    // Whether the directory could be stat'ed when it was indexed, and the
+    // stamp that it had then.
+    bool has_stamp;
+    fhicl_file_stamp stamp;
+  };
+  struct index_t {
+    std::vector<directory> directories;
+    // The path that each name resolves to, and the position in directories
+    // of the directory that it was found in.
+    std::unordered_map<std::string, std::pair<std::string, size_t>> files;
+  };
+
+  std::mutex mtx;
+  std::map<std::string, std::shared_ptr<index_t const>> indices;
+
+  fhicl_file_path_index() {}
+
+  static std::shared_ptr<index_t const>
+  build_index(std::string const &search_path, parse_stats *stats) {
+    std::shared_ptr<index_t> index = std::make_shared<index_t>();
+    for (std::string const &path : string_parsers::ParseToVect<std::string>(
+             search_path, ":", false, true)) {
+#ifdef DEBUG_OPEN_FHICL_FILE
+      std::cout << "[open_fhicl_file]: Indexing directory from "
+                   "FHICL_FILE_PATH: "
+                << std::quoted(path) << std::endl;
+#endif
+      // Stamped before it is read, so that a file added while it is being
+      // read is picked up by the next resolve.
+      index->directories.push_back(directory{path, false, {0, 0, 0}});
+      directory &dir_info = index->directories.back();
+      dir_info.has_stamp = fhicl_file_stamp::get(path, dir_info.stamp);
+      DIR *dir = opendir(path.c_str());
+      if (dir == NULL) { // Couldn't open directory
+        std::cout << "[WARN]: Failed to search directory: "
+                  << std::quoted(path)
+                  << " found in FHICL_FILE_PATH. opendir failed with error: "
+                  << std::quoted(std::strerror(errno)) << std::endl;
+        continue;
+      }
+      if (stats) {
+        stats->directories_scanned++;
+      }
+      std::string dir_path = string_parsers::ensure_trailing_slash(path);
+      size_t position = index->directories.size() - 1;
+      struct dirent *ent;
+      while ((ent = readdir(dir)) != NULL) {
+        // emplace does not replace names found in earlier directories
+        index->files.emplace(ent->d_name,
+                             std::make_pair(dir_path + ent->d_name, position));
+      }
+      closedir(dir);
+    }
+    return index;
+  }
+
+  // Whether any of the first n directories of index has changed since it was
+  // built.
+  static bool is_stale(index_t const &index, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      directory const &dir = index.directories[i];
+      fhicl_file_stamp stamp{0, 0, 0};
+      bool has_stamp = fhicl_file_stamp::get(dir.path, stamp);
+      if ((has_stamp != dir.has_stamp) ||
+          (has_stamp && !(stamp == dir.stamp))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::shared_ptr<index_t const> get_index(std::string const &search_path,
+                                           bool rebuild, parse_stats *stats) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      auto it = indices.find(search_path);
+      if (!rebuild && (it != indices.end())) {
+        return it->second;
+      }
+    }
+    std::shared_ptr<index_t const> index = build_index(search_path, stats);
+    std::lock_guard<std::mutex> lock(mtx);
+    indices[search_path] = index;
+    return index;
+  }
+
+public:
+  static fhicl_file_path_index &instance() {
+    static fhicl_file_path_index idx;
+    return idx;
+  }
+
+  // Returns the path to filename, or an empty string if no directory in
+  // search_path contains it.
+  //
+  // The answer is taken from the index as long as none of the directories that
+  // could change it have been modified since it was built: those up to and
+  // including the one that filename was found in, or all of them for a name
+  // that was not found. Otherwise the search path is indexed again, so a file
+  // created in, or removed from, an earlier directory changes which directory
+  // wins just as it would for a search, and a repeated miss does not read any
+  // directory. Changes are detected by directory modification time, so on a
+  // filesystem with coarse timestamps a file created within the same tick as
+  // its directory was indexed may not be seen until the directory next
+  // changes.
+  std::string resolve(std::string const &search_path,
+                      std::string const &filename,
+                      parse_stats *stats = nullptr) {
+    for (bool rebuild : {false, true}) {
+      std::shared_ptr<index_t const> index =
+          get_index(search_path, rebuild, stats);
+      auto it = index->files.find(filename);
+      size_t n = (it != index->files.end()) ? (it->second.second + 1)
+                                            : index->directories.size();
+      if (!rebuild && is_stale(*index, n)) {
+        continue;
+      }
+      return (it != index->files.end()) ? it->second.first : "";
+    }
+    return "";
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    indices.clear();
+  }
+};
+
+// Returns the path that filename should be read from, or an empty string if it
+// cannot be found in FHICL_FILE_PATH.
+inline std::string resolve_fhicl_file(std::string const &filename,
+                                      parse_stats *stats = nullptr) {
 
 #ifdef DEBUG_OPEN_FHICL_FILE
   std::cout << "[open_fhicl_file]: Trying to resolve " << std::quoted(filename)
@@ -544,7 +768,7 @@ open_fhicl_file(std::string const &filename) {
                  "relative path."
               << std::endl;
 #endif
-    return std::make_unique<std::ifstream>(filename);
+    return filename;
   }
 
   char const *fhicl_file_path = getenv("FHICL_FILE_PATH");
@@ -555,45 +779,28 @@ open_fhicl_file(std::string const &filename) {
                  "treat it as a local filename."
               << std::endl;
 #endif
-    return std::make_unique<std::ifstream>(filename);
+    return filename;
   }
 
-  for (std::string const &path : string_parsers::ParseToVect<std::string>(
-           fhicl_file_path, ":", false, true)) {
-#ifdef DEBUG_OPEN_FHICL_FILE
-    std::cout << "[open_fhicl_file]: Searching directory from FHICL_FILE_PATH: "
-              << std::quoted(path) << std::endl;
-#endif
-    DIR *dir = opendir(path.c_str());
-    struct dirent *ent;
-    if (dir != NULL) {
-      while ((ent = readdir(dir)) != NULL) {
-#ifdef DEBUG_OPEN_FHICL_FILE
-        std::cout << "[open_fhicl_file]: Checking entry: "
-                  << std::quoted(ent->d_name) << std::endl;
-#endif
-        if (std::string(ent->d_name) == filename) {
+  return fhicl_file_path_index::instance().resolve(fhicl_file_path, filename,
+                                                  stats);
+}
+
+inline std::unique_ptr<std::ifstream>
+open_fhicl_file(std::string const &filename) {
+  std::string path = resolve_fhicl_file(filename);
+  if (!path.size()) {
+    return nullptr;
+  }
 #ifdef DEBUG_OPEN_FHICL_FILE
-          std::cout << "[open_fhicl_file]: Attempting to open : "
-                    << std::quoted(string_parsers::ensure_trailing_slash(path) +
-                                   filename)
-                    << std::endl;
+  std::cout << "[open_fhicl_file]: Attempting to open : " << std::quoted(path)
+            << std::endl;
 #endif
-          return std::make_unique<std::ifstream>(
-              string_parsers::ensure_trailing_slash(path) + filename);
-        }
-      }
-      closedir(dir);
-    } else { // Couldn't open directory
-      std::cout << "[WARN]: Failed to search directory: " << std::quoted(path)
-                << " found in FHICL_FILE_PATH. opendir failed with error: "
-                << std::quoted(std::strerror(errno)) << std::endl;
-    }
-  }
-  return nullptr;
+  return std::make_unique<std::ifstream>(path);
 }
 
-inline fhicl_doc read_doc(std::string const &filename) {
+inline std::unique_ptr<std::ifstream>
+open_fhicl_file_for_reading(std::string const &filename) {
   std::unique_ptr<std::ifstream> ifs = open_fhicl_file(filename);
   if (!ifs || !ifs->good()) {
     throw file_does_not_exist()
@@ -602,15 +809,252 @@ inline fhicl_doc read_doc(std::string const &filename) {
            "directory must be explicitly qualified with \"./\" to avoid "
            "confusion with files found in FHICL_FILE_PATH)";
   }
+  return ifs;
+}
+
+// Calls f(line, line_no) with each trimmed line of filename. Regular files are
+// read through a memory mapping, so that each line is copied once, straight
+// from the page cache into the string passed to f.
+template <typename F>
+inline void read_fhicl_file_lines(std::string const &filename, F &&f) {
+  std::string path = resolve_fhicl_file(filename);
+  if (path.size()) {
+    mapped_file mf(path);
+    if (mf.is_mapped()) {
+      size_t ctr = 0;
+      mf.for_each_trimmed_line([&](char const *begin, char const *end) {
+        f(std::string(begin, end), ctr++);
+      });
+      return;
+    }
+  }
+
+  std::unique_ptr<std::ifstream> ifs = open_fhicl_file_for_reading(filename);
   std::string line;
-  fhicl_doc doc;
   size_t ctr = 0;
   while (std::getline(*ifs, line)) {
     string_parsers::trim(line);
-    doc.push_back(line, filename, ctr);
-    ctr++;
+    f(std::move(line), ctr++);
   }
+}
+
+inline fhicl_doc read_doc(std::string const &filename) {
+  fhicl_doc doc;
+  read_fhicl_file_lines(filename, [&](std::string &&line, size_t line_no) {
+    doc.push_back(std::move(line), filename, line_no);
+  });
   return doc;
 }
 
+// In-process cache of the trimmed lines of fhicl files, keyed by the path that
+// they were read from. A file that is included many times is read once, and
+// is read again only if its modification time or size changes.
+class fhicl_file_cache {
+  typedef std::vector<std::string> lines_t;
+  struct entry {
+    fhicl_file_stamp stamp{0, 0, 0};
+    std::shared_ptr<lines_t const> lines;
+  };
+
+  std::mutex mtx;
+  std::map<std::string, entry> entries;
+
+  fhicl_file_cache() {}
+
+public:
+  static fhicl_file_cache &instance() {
+    static fhicl_file_cache cache;
+    return cache;
+  }
+
+  std::shared_ptr<lines_t const> read(std::string const &filename,
+                                      parse_stats *stats = nullptr) {
+    std::string path = resolve_fhicl_file(filename, stats);
+    fhicl_file_stamp stamp{0, 0, 0};
+    bool has_stamp = path.size() && fhicl_file_stamp::get(path, stamp);
+    if (has_stamp) {
+      std::lock_guard<std::mutex> lock(mtx);
+      auto it = entries.find(path);
+      if ((it != entries.end()) && (it->second.stamp == stamp)) {
+        if (stats) {
+          stats->file_cache_hits++;
+        }
+        return it->second.lines;
+      }
+    }
+
+    std::shared_ptr<lines_t> lines = std::make_shared<lines_t>();
+    uint64_t bytes = 0;
+    {
+      parse_stats::file_stats *fs = stats ? &stats->files[filename] : nullptr;
+      scoped_timer timer(fs ? &fs->read_ns : nullptr);
+      read_fhicl_file_lines(filename, [&](std::string &&line, size_t) {
+        bytes += line.size() + 1;
+        lines->push_back(std::move(line));
+      });
+    }
+    if (stats) {
+      // The size on disk, the lines have been trimmed.
+      bytes = has_stamp ? uint64_t(stamp.size) : bytes;
+      parse_stats::file_stats &fs = stats->files[filename];
+      fs.times_read++;
+      fs.bytes += bytes;
+      stats->files_opened++;
+      stats->bytes_read += bytes;
+    }
+
+    if (has_stamp) {
+      std::lock_guard<std::mutex> lock(mtx);
+      entries[path] = {stamp, lines};
+    }
+    return lines;
+  }
+
+  // Drops the cached copy of the file read from path, so that it is read
+  // again even if its stamp has not changed.
+  void forget(std::string const &path) {
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.erase(path);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.clear();
+  }
+};
+
+// The files that a document was read from and the files that each of them
+// includes, recorded by read_resolved_doc.
+struct include_graph {
+  struct file {
+    // Where the file was read from, see resolve_fhicl_file.
+    std::string path;
+    // The files named by its #include statements, in order.
+    std::vector<std::string> includes;
+  };
+
+  std::string root;
+  std::map<std::string, file> files;
+
+  // filename and every file that includes it, directly or through other
+  // includes: the documents whose text changes when filename does.
+  std::vector<std::string> affected_by(std::string const &filename) const {
+    std::vector<std::string> affected;
+    if (!files.count(filename)) {
+      return affected;
+    }
+    affected.push_back(filename);
+    for (size_t i = 0; i < affected.size(); ++i) {
+      for (auto const &f : files) {
+        if ((std::find(f.second.includes.begin(), f.second.includes.end(),
+                       affected[i]) != f.second.includes.end()) &&
+            (std::find(affected.begin(), affected.end(), f.first) ==
+             affected.end())) {
+          affected.push_back(f.first);
+        }
+      }
+    }
+    return affected;
+  }
+};
+
+inline void throw_include_not_found(fhicl_doc const &doc, size_t line_no,
+                                    std::string const &inc_file_name,
+                                    file_does_not_exist const &e) {
+  throw file_does_not_exist()
+      << "[ERROR]: When attempting to resolving include statement, "
+         "found at "
+      << doc.get_line_info(linedoc::doc_line_point{line_no, 0}) << " = "
+      << std::quoted(doc.get_line(linedoc::doc_line_point{line_no, 0}))
+      << " caught exception:\n  --" << e.what() << "\n\n File "
+      << std::quoted(inc_file_name) << " not found, or FHICL_FILE_PATH (="
+      << (getenv("FHICL_FILE_PATH")
+              ? std::quoted(std::string(getenv("FHICL_FILE_PATH")))
+              : std::quoted(std::string("")))
+      << ") improperly defined.";
+}
+
+// Appends the lines of filename to doc, expanding its includes in place as
+// they are found, so that a document is built in a single pass that is linear
+// in its resolved size. include_chain holds the files currently being
+// expanded, for loop detection. If graph is given, the files read and their
+// includes are recorded in it.
+inline void append_resolved_doc(fhicl_doc &doc, std::string const &filename,
+                                std::vector<std::string> &include_chain,
+                                parse_stats *stats,
+                                include_graph *graph) {
+  if (std::find(include_chain.begin(), include_chain.end(), filename) !=
+      include_chain.end()) {
+    throw include_loop()
+        << "[ERROR]: Detected an include loop when trying to include: "
+        << std::quoted(filename) << ". Current include chain: "
+        << string_parsers::T2Str<std::vector<std::string>>(include_chain);
+  }
+
+  std::shared_ptr<std::vector<std::string> const> lines =
+      fhicl_file_cache::instance().read(filename, stats);
+  if (stats) {
+    parse_stats::file_stats &fs = stats->files[filename];
+    fs.times_included++;
+    fs.lines += lines->size();
+  }
+  include_graph::file *node = nullptr;
+  if (graph) { // a file included more than once is recorded once
+    node = &graph->files[filename];
+    node->path = resolve_fhicl_file(filename);
+    node->includes.clear();
+  }
+  include_chain.push_back(filename);
+  for (size_t ctr = 0; ctr < lines->size(); ++ctr) {
+    std::string const &line = (*lines)[ctr];
+    if (line.find("#include \"") != 0) {
+      doc.push_back(line, filename, ctr);
+      continue;
+    }
+    size_t matchting_quote = line.find_first_of('\"', 10);
+    std::string inc_file_name = line.substr(10, matchting_quote - 10);
+    if (stats) {
+      stats->includes++;
+    }
+    if (node) {
+      node->includes.push_back(inc_file_name);
+    }
+    try {
+      append_resolved_doc(doc, inc_file_name, include_chain, stats, graph);
+    } catch (file_does_not_exist &e) {
+      fhicl_doc include_line;
+      include_line.push_back(line, filename, ctr);
+      throw_include_not_found(include_line, 0, inc_file_name, e);
+    }
+  }
+  include_chain.pop_back();
+}
+
+// Equivalent to read_doc followed by fhicl_doc::resolve_includes, but reads
+// each file through the include cache and expands includes in one pass. If
+// stats is given, the work done is added to it, and if graph is given, it is
+// replaced by the include graph of filename.
+inline fhicl_doc read_resolved_doc(std::string const &filename,
+                                   parse_stats *stats = nullptr,
+                                   include_graph *graph = nullptr) {
+  scoped_timer timer(stats ? &stats->read_ns : nullptr);
+  fhicl_doc doc;
+  std::vector<std::string> include_chain;
+  if (graph) {
+    *graph = include_graph();
+    graph->root = filename;
+  }
+  append_resolved_doc(doc, filename, include_chain, stats, graph);
+  if (stats) {
+    stats->lines += doc.size();
+  }
+  return doc;
+}
+
+// Drops all cached files and FHICL_FILE_PATH indices.
+inline void clear_fhicl_file_cache() {
+  fhicl_file_cache::instance().clear();
+  fhicl_file_path_index::instance().clear();
+}
+
 } // namespace fhicl
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// Unix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fhicl {
+
+// A read-only memory mapping of a whole regular file. Files that cannot be
+// mapped, such as pipes, are left unmapped so that callers can fall back to
+// reading them as streams.
+class mapped_file {
+  char const *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+
+public:
+  explicit mapped_file(std::string const &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode)) {
+      size_ = size_t(st.st_size);
+      if (!size_) { // mmap cannot map an empty file
+        mapped_ = true;
+      } else {
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+#ifdef POSIX_MADV_SEQUENTIAL
+          posix_madvise(addr, size_, POSIX_MADV_SEQUENTIAL);
+#endif
+          data_ = static_cast<char const *>(addr);
+          mapped_ = true;
+        }
+      }
+    }
+    close(fd);
+  }
+  mapped_file(mapped_file const &) = delete;
+  mapped_file &operator=(mapped_file const &) = delete;
+  ~mapped_file() {
+    if (data_) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  bool is_mapped() const { return mapped_; }
+  char const *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Calls f(begin, end) for each line of the file with surrounding whitespace
+  // excluded, splitting lines as std::getline would. The lines are read
+  // straight from the mapping, so the caller makes the only copy.
+  template <typename F> void for_each_trimmed_line(F &&f) const {
+    char const *pos = data_;
+    char const *file_end = data_ + size_;
+    while (pos < file_end) {
+      char const *line_end =
+          static_cast<char const *>(memchr(pos, '\n', size_t(file_end - pos)));
+      if (!line_end) {
+        line_end = file_end;
+      }
+      char const *b = pos;
+      char const *e = line_end;
+      while ((b < e) && std::isspace(static_cast<unsigned char>(*b))) {
+        ++b;
+      }
+      while ((e > b) && std::isspace(static_cast<unsigned char>(*(e - 1)))) {
+        --e;
+      }
+      f(b, e);
+      pos = line_end + 1;
+    }
+  }
+};
+
+} // namespace fhicl
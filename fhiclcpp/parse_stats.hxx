@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fhicl {
+
+// Counters and timers filled in by an instrumented parse, see
+// make_ParameterSet(filename, stats). Times are wall clock nanoseconds. The
+// work done by the worker threads of a parallel parse is added in, so the
+// phase times may then add up to more than total_ns.
+struct parse_stats {
+  struct file_stats {
+    // Each time the file was expanded, counting the top level file once.
+    uint64_t times_included = 0;
+    // Reads from disk, the other inclusions were served by the include cache.
+    uint64_t times_read = 0;
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    double read_ns = 0;
+    // Values parsed from lines of this file and the time spent on the
+    // statements written in it, not counting statements from other files
+    // nested within them.
+    uint64_t nodes = 0;
+    double parse_ns = 0;
+
+    void merge(file_stats const &other) {
+      times_included += other.times_included;
+      times_read += other.times_read;
+      bytes += other.bytes;
+      lines += other.lines;
+      read_ns += other.read_ns;
+      nodes += other.nodes;
+      parse_ns += other.parse_ns;
+    }
+  };
+
+  double total_ns = 0;
+  // Reading files and expanding includes.
+  double read_ns = 0;
+  // Building the structural index and matching brackets with it.
+  double bracket_ns = 0;
+  // Resolving @local, @table and @sequence directives.
+  double reference_ns = 0;
+  // The recursive descent, which includes bracket_ns and reference_ns.
+  double parse_ns = 0;
+
+  uint64_t files_opened = 0;
+  uint64_t file_cache_hits = 0;
+  uint64_t directories_scanned = 0;
+  uint64_t includes = 0;
+  uint64_t bytes_read = 0;
+  uint64_t lines = 0;
+  uint64_t nodes_created = 0;
+  // Tables taken unchanged from a table_body_cache instead of parsed.
+  uint64_t tables_reused = 0;
+  uint64_t references_resolved = 0;
+  // Values copied to resolve references. A copy shares structure with its
+  // original until either is modified, see copy_value.
+  uint64_t copies = 0;
+  // Memory reserved for nodes, and atoms shared instead of built, by the
+  // node_arena of an arena parse.
+  uint64_t arena_bytes = 0;
+  uint64_t atoms_shared = 0;
+
+  std::map<std::string, file_stats> files;
+
+  void merge(parse_stats const &other) {
+    total_ns += other.total_ns;
+    read_ns += other.read_ns;
+    bracket_ns += other.bracket_ns;
+    reference_ns += other.reference_ns;
+    parse_ns += other.parse_ns;
+    files_opened += other.files_opened;
+    file_cache_hits += other.file_cache_hits;
+    directories_scanned += other.directories_scanned;
+    includes += other.includes;
+    bytes_read += other.bytes_read;
+    lines += other.lines;
+    nodes_created += other.nodes_created;
+    tables_reused += other.tables_reused;
+    references_resolved += other.references_resolved;
+    copies += other.copies;
+    arena_bytes += other.arena_bytes;
+    atoms_shared += other.atoms_shared;
+    for (auto const &f : other.files) {
+      files[f.first].merge(f.second);
+    }
+  }
+
+  std::string to_string() const {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "total:      " << std::setw(10) << (total_ns * 1E-6) << " ms"
+       << std::endl
+       << "reading:    " << std::setw(10) << (read_ns * 1E-6) << " ms, "
+       << files_opened << " files opened, " << file_cache_hits
+       << " include cache hits, " << directories_scanned
+       << " directories scanned, " << includes << " includes, " << bytes_read
+       << " bytes, " << lines << " lines" << std::endl
+       << "parsing:    " << std::setw(10) << (parse_ns * 1E-6) << " ms, "
+       << nodes_created << " nodes created, " << tables_reused
+       << " tables reused" << std::endl
+       << "  brackets: " << std::setw(10) << (bracket_ns * 1E-6) << " ms"
+       << std::endl
+       << "  refs:     " << std::setw(10) << (reference_ns * 1E-6) << " ms, "
+       << references_resolved << " references resolved, " << copies
+       << " values copied" << std::endl;
+    if (arena_bytes) {
+      ss << "arena:      " << arena_bytes << " bytes reserved, "
+         << atoms_shared << " atoms shared" << std::endl;
+    }
+
+    std::vector<std::pair<std::string, file_stats>> by_time(files.begin(),
+                                                            files.end());
+    std::stable_sort(by_time.begin(), by_time.end(),
+                     [](std::pair<std::string, file_stats> const &l,
+                        std::pair<std::string, file_stats> const &r) {
+                       return (l.second.parse_ns + l.second.read_ns) >
+                              (r.second.parse_ns + r.second.read_ns);
+                     });
+    ss << "per file:" << std::endl
+       << "    parse ms     read ms  included   read      bytes     nodes  "
+          "file"
+       << std::endl;
+    for (auto const &f : by_time) {
+      file_stats const &fs = f.second;
+      ss << std::setw(12) << (fs.parse_ns * 1E-6) << std::setw(12)
+         << (fs.read_ns * 1E-6) << std::setw(10) << fs.times_included
+         << std::setw(7) << fs.times_read << std::setw(11) << fs.bytes
+         << std::setw(10) << fs.nodes << "  " << f.first << std::endl;
+    }
+    return ss.str();
+  }
+};
+
+// Adds the time from construction to destruction to *ns, unless ns is null.
+class scoped_timer {
+  double *ns;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit scoped_timer(double *n)
+      : ns(n), start(n ? std::chrono::steady_clock::now()
+                       : std::chrono::steady_clock::time_point()) {}
+  scoped_timer(scoped_timer const &) = delete;
+  scoped_timer &operator=(scoped_timer const &) = delete;
+  ~scoped_timer() {
+    if (ns) {
+      *ns += std::chrono::duration<double, std::nano>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+    }
+  }
+};
+
+} // namespace fhicl
@@ -4,14 +4,583 @@
 
 #include "fhiclcpp/fhicl_doc.hxx"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace fhicl {
 
-inline ParameterSet parse_fhicl_document(fhicl_doc const &,
-                                         ParameterSet const &,
-                                         ParameterSet const &,
-                                         linedoc::doc_range, key_t const &);
+// Options that control how a document is built into a ParameterSet.
+struct parse_options {
+  // Record where each value was read from, as reported by
+  // ParameterSet::history_to_string. Turning this off saves the time and
+  // memory spent on provenance when only the values are needed.
+  bool track_history = true;
+  // The number of threads to parse with. With more than one, the bodies of
+  // tables that do not use reference directives are parsed ahead of time on
+  // worker threads, see table_prefetcher. The result, including history and
+  // any exception thrown, is the same as for a serial parse.
+  size_t threads = 1;
+  // Defer parsing the bodies of tables that do not use reference directives
+  // until they are first used, see lazy_document. The result is the same as
+  // for an eager parse, except that an error in a deferred table is only
+  // thrown when the table is first used, or by ParameterSet::validate_all.
+  // Tables are deferred instead of prefetched, so threads is then ignored.
+  bool lazy = false;
+  // Allocate the table, sequence and atom nodes of the tree from a node_arena,
+  // which interns atoms with the same text. Keys, atom text and the contents
+  // of tables and sequences are still allocated from the heap, see node_arena
+  // and ParameterSet::memory_usage for the effect.
+  bool arena = false;
+};
+
+// Which lines of a document hold a reference directive, used to find the
+// table bodies that depend only on their own text. The directives are looked
+// for anywhere on a line, including in strings and comments, so a body is
+// never wrongly taken to have none.
+class reference_line_index {
+  // Prefix sums over lines of whether the line holds a reference directive.
+  std::vector<size_t> counts;
+
+public:
+  explicit reference_line_index(fhicl_doc const &doc) : counts() {
+    counts.reserve(doc.size() + 1);
+    counts.push_back(0);
+    for (size_t l = 0; l < doc.size(); ++l) {
+      std::string const &line = doc.at(l).characters;
+      bool refs = (line.find("@local::") != std::string::npos) ||
+                  (line.find("@table::") != std::string::npos) ||
+                  (line.find("@sequence::") != std::string::npos);
+      counts.push_back(counts.back() + (refs ? 1 : 0));
+    }
+  }
+
+  bool has_references(size_t first_line, size_t last_line) const {
+    return counts[last_line + 1] != counts[first_line];
+  }
+};
+
+// The tables built by one parse of a document, kept so that the next parse of
+// an edited version of it can reuse them, as config_watcher does. As for
+// table_prefetcher, a table body that contains no reference directives
+// depends only on its own text and key. One whose text, and the file and
+// line number that each of its lines was read from, are unchanged is taken
+// from the previous parse, sharing its nodes, instead of being parsed again.
+// A table that changed is parsed, but the unchanged tables nested in it are
+// still reused. Tables that are deferred by a lazy parse are not kept. Only one
+// parse may use a cache at a time.
+class table_body_cache {
+  struct entry {
+    std::shared_ptr<ParameterSet const> table;
+    // The signatures of the tables that were kept while parsing this one, so
+    // that they are kept along with it when it is reused.
+    std::vector<std::string> nested;
+  };
+
+  std::map<std::string, entry> previous;
+  std::map<std::string, entry> current;
+  std::vector<std::vector<std::string>> building;
+  fhicl_doc const *doc;
+  std::unique_ptr<reference_line_index> reference_lines;
+
+  void keep(std::string const &signature, entry const &e) {
+    current[signature] = e;
+    for (std::string const &n : e.nested) {
+      auto it = previous.find(n);
+      if (it != previous.end()) {
+        keep(n, it->second);
+      }
+    }
+  }
+  void note(std::string const &signature) {
+    if (building.size()) {
+      building.back().push_back(signature);
+    }
+  }
+
+public:
+  table_body_cache()
+      : previous(), current(), building(), doc(nullptr), reference_lines() {}
+
+  // Called by parse_fhicl_document around a parse of d. Only the tables of
+  // the last parse to finish are kept.
+  void begin(fhicl_doc const &d) {
+    doc = &d;
+    reference_lines.reset(new reference_line_index(d));
+    current.clear();
+    building.clear();
+  }
+  void finish() {
+    previous.swap(current);
+    current.clear();
+    doc = nullptr;
+    reference_lines.reset();
+  }
+
+  size_t size() const { return previous.size(); }
+
+  // Identifies the body at range for key by its text and where that was
+  // read from, or returns an empty string if it has reference directives.
+  std::string signature(linedoc::doc_range range, key_t const &key) const {
+    size_t first_line = range.begin.line_no;
+    size_t last_line = std::min(range.end.line_no, doc->size() - 1);
+    if (reference_lines->has_references(first_line, last_line)) {
+      return "";
+    }
+    std::stringstream ss;
+    ss << key << '\n';
+    for (size_t l = first_line; l <= last_line; ++l) {
+      ss << doc->get_line_info({l, 0}) << '\n';
+    }
+    ss << doc->substr(range);
+    return ss.str();
+  }
+
+  // A copy of the table with signature from the previous parse, or nullptr.
+  std::shared_ptr<ParameterSet> find(std::string const &signature) {
+    auto it = previous.find(signature);
+    if (it == previous.end()) {
+      return nullptr;
+    }
+    keep(signature, it->second);
+    note(signature);
+    return std::make_shared<ParameterSet>(*it->second.table);
+  }
+
+  // Brackets parsing the table with signature, which is then kept.
+  void enter() { building.emplace_back(); }
+  void leave(std::string const &signature,
+             std::shared_ptr<ParameterSet> const &table) {
+    entry e{std::make_shared<ParameterSet const>(*table),
+            std::move(building.back())};
+    building.pop_back();
+    current[signature] = std::move(e);
+    note(signature);
+  }
+};
+
+class table_prefetcher;
+class lazy_document;
+
+// The state that is shared by reference across the recursive descent of a
+// single document: the document built so far (working_set), the PROLOG, and
+// the stack of tables that are still being parsed. In-progress tables are not
+// inserted into their parent until they are complete, but are visible to
+// reference directives under their fully qualified keys.
+class parse_context {
+  struct scope {
+    key_t key;
+    std::shared_ptr<Base> table;
+  };
+  std::vector<scope> scopes;
+
+public:
+  ParameterSet working_set;
+  ParameterSet PROLOG;
+  parse_options options;
+  // Tables parsed ahead of time, if this is a parallel parse.
+  table_prefetcher *prefetch;
+  // Where to count the work done, if anywhere.
+  parse_stats *stats;
+  // The document that tables are deferred from, if this is a lazy parse.
+  std::shared_ptr<lazy_document const> lazy;
+  // Where unchanged tables are reused from, if anywhere.
+  table_body_cache *reuse;
+  // Where nodes are allocated from, if anywhere, see parse_options::arena.
+  std::shared_ptr<node_arena> arena;
+  // Set between BEGIN_PROLOG and END_PROLOG, including in the tables defined
+  // there. PROLOG tables are parsed eagerly even in a lazy parse, as an error
+  // in one that is never referenced would otherwise never be reported.
+  bool in_prolog;
+
+  parse_context()
+      : scopes(), working_set(), PROLOG(), options(), prefetch(nullptr),
+        stats(nullptr), lazy(), reuse(nullptr), arena(), in_prolog(false),
+        file_stats_by_id(), in_file(no_file), in_file_since() {}
+  parse_context(ParameterSet const &_working_set, ParameterSet const &_PROLOG,
+                parse_options const &_options = parse_options())
+      : scopes(), working_set(_working_set), PROLOG(_PROLOG), options(_options),
+        prefetch(nullptr), stats(nullptr), lazy(), reuse(nullptr), arena(),
+        in_prolog(false), file_stats_by_id(), in_file(no_file),
+        in_file_since() {
+    working_set.set_track_history(options.track_history);
+    PROLOG.set_track_history(options.track_history);
+  }
+
+  std::shared_ptr<ParameterSet> new_table() const {
+    return arena ? arena->table() : std::make_shared<ParameterSet>();
+  }
+  std::shared_ptr<Sequence> new_sequence() const {
+    return arena ? arena->sequence() : std::make_shared<Sequence>();
+  }
+  std::shared_ptr<Atom> new_atom(std::string const &text) const {
+    return arena ? arena->atom(text) : std::make_shared<Atom>(text);
+  }
+
+  // The entry in stats for the file that line_no of doc was read from.
+  parse_stats::file_stats &file_stats_for(fhicl_doc const &doc,
+                                          size_t line_no) {
+    size_t id = doc.at(line_no).file_id;
+    if (id >= file_stats_by_id.size()) {
+      file_stats_by_id.resize(id + 1, nullptr);
+    }
+    if (!file_stats_by_id[id]) {
+      std::string info = doc.get_line_info({line_no, 0});
+      file_stats_by_id[id] = &stats->files[info.substr(0, info.rfind(':'))];
+    }
+    return *file_stats_by_id[id];
+  }
+
+  // Charges the time since the parse last moved between files to the file it
+  // was in, and moves it to the file that line_no of doc was read from. The
+  // clock is only read when the file changes.
+  void enter_file(fhicl_doc const &doc, size_t line_no) {
+    size_t id = doc.at(line_no).file_id;
+    if (id == in_file) {
+      return;
+    }
+    file_stats_for(doc, line_no);
+    leave_file();
+    in_file = id;
+  }
+  void leave_file() {
+    auto now = std::chrono::steady_clock::now();
+    if (in_file != no_file) {
+      file_stats_by_id[in_file]->parse_ns +=
+          std::chrono::duration<double, std::nano>(now - in_file_since)
+              .count();
+    }
+    in_file = no_file;
+    in_file_since = now;
+  }
+  // Called once the whole document has been parsed, to add the time spent in
+  // the last file and the memory taken from the arena to stats.
+  void finish_stats() {
+    leave_file();
+    if (arena) {
+      stats->arena_bytes += arena->bytes_reserved();
+      stats->atoms_shared += arena->atoms_shared();
+    }
+  }
+
+private:
+  enum : size_t { no_file = size_t(-1) };
+  std::vector<parse_stats::file_stats *> file_stats_by_id;
+  size_t in_file;
+  std::chrono::steady_clock::time_point in_file_since;
+
+public:
+
+  // Resolves a fully qualified key against the working set, including any
+  // in-progress tables, innermost first.
+  std::shared_ptr<Base> const &resolve(key_t const &key) const {
+    if (!key.size()) {
+      throw null_key();
+    }
+    if (!working_set.valid_key(key)) {
+      throw invalid_key() << "[ERROR]: Invalid key " << std::quoted(key);
+    }
+    for (auto s_it = scopes.rbegin(); s_it != scopes.rend(); ++s_it) {
+      key_t const &skey = s_it->key;
+      if ((key.size() < skey.size()) || key.compare(0, skey.size(), skey)) {
+        continue;
+      }
+      if (key.size() == skey.size()) {
+        return s_it->table;
+      }
+      if (key[skey.size()] == '.') {
+        return static_cast<ParameterSet const &>(*s_it->table)
+            .get_value_recursive(key.substr(skey.size() + 1));
+      }
+    }
+    return working_set.get_value_recursive(key);
+  }
+
+  struct scope_guard {
+    parse_context &ctx;
+    scope_guard(parse_context &c, key_t const &key,
+                std::shared_ptr<ParameterSet> const &table)
+        : ctx(c) {
+      ctx.scopes.push_back({key, table});
+    }
+    ~scope_guard() { ctx.scopes.pop_back(); }
+  };
+};
+
+inline void parse_fhicl_document(fhicl_doc const &, parse_context &,
+                                 ParameterSet &, linedoc::doc_range,
+                                 key_t const &);
+
+// Parses the bodies of tables that cannot depend on the rest of the document
+// on a pool of worker threads, while the document itself is parsed serially
+// as usual. A table body can be parsed out of order if it contains no
+// @local, @table or @sequence directives: everything else that it produces,
+// including the history of its keys and any exception, depends only on its
+// own text. When the serial parse reaches a table, parse_table takes the
+// prefetched result for that exact body and key, if there is one, after
+// making the usual checks against the document so far. The table bodies are
+// found by a light scan of the document that is never trusted for anything
+// but where the work is, so a body that is scanned wrongly is just parsed
+// serially.
+//
+// Tasks are claimed in document order, by the workers or by the serial parse
+// when it reaches a table that no worker has started, so the serial parse
+// only ever waits for a table that is already being parsed.
+class table_prefetcher {
+  struct task {
+    linedoc::doc_range range;
+    key_t key;
+    std::atomic<bool> claimed;
+    bool done;
+    std::shared_ptr<ParameterSet> table;
+    std::exception_ptr error;
+    parse_stats stats;
+
+    task(linedoc::doc_range r, key_t const &k)
+        : range(r), key(k), claimed(false), done(false), table(), error(),
+          stats() {}
+  };
+
+  fhicl_doc const &doc;
+  parse_options options;
+  bool collect_stats;
+  std::shared_ptr<node_arena> arena;
+  std::deque<task> tasks;
+  std::map<std::pair<size_t, size_t>, size_t> task_at;
+  reference_line_index reference_lines;
+  size_t split_lines;
+
+  std::atomic<size_t> next_task;
+  std::atomic<bool> stopping;
+  std::mutex mtx;
+  std::condition_variable task_done;
+  std::vector<std::thread> workers;
+
+  // Notes the table at key with body range. Bodies that may refer to the
+  // rest of the document, or are big enough to be worth splitting up, are
+  // parsed serially and searched for smaller tables instead.
+  void add_table(linedoc::doc_range range, key_t const &key) {
+    size_t first_line = range.begin.line_no;
+    size_t last_line = std::min(range.end.line_no, doc.size() - 1);
+    if (reference_lines.has_references(first_line, last_line) ||
+        ((last_line - first_line) > split_lines)) {
+      find_tables(range, key);
+      return;
+    }
+    task_at[{range.begin.line_no, range.begin.character}] = tasks.size();
+    tasks.emplace_back(range, key);
+  }
+
+  // Skims the key: value pairs in range as parse_fhicl_document would, and
+  // adds each table value. Stops at anything unexpected, which the serial
+  // parse will report.
+  void find_tables(linedoc::doc_range range, key_t const &current_key) {
+    linedoc::doc_line_point read_ptr =
+        doc.find_first_not_of(" \n", range.begin, range.end);
+    while (doc.is_earlier(read_ptr, range.end)) {
+      if ((doc.get_char(read_ptr) == '#') ||
+          (doc.substr(read_ptr, doc.advance(read_ptr, 2)) == "//")) {
+        read_ptr = doc.find_first_not_of(" \n", read_ptr.get_EOL(), range.end);
+        continue;
+      }
+      linedoc::doc_line_point next_break =
+          doc.find_first_of(" \n:", read_ptr, range.end);
+      if (doc.is_end(next_break)) {
+        return;
+      }
+      linedoc::doc_line_point next = next_break;
+      if (doc.get_char(next_break) == ':') {
+        key_t key = doc.substr(read_ptr, next_break);
+        linedoc::doc_line_point value = doc.find_first_not_of(
+            " \n", doc.advance(next_break), range.end);
+        if (!doc.is_earlier(value, range.end)) {
+          return;
+        }
+        char value_char = doc.get_char(value);
+        if ((value_char == '{') || (value_char == '[')) {
+          linedoc::doc_line_point match = find_matching_bracket(
+              doc, value_char, (value_char == '{') ? '}' : ']', value);
+          if (doc.is_end(match)) {
+            return;
+          }
+          if (value_char == '{') {
+            add_table({doc.advance(value), match},
+                      (current_key.size() ? (current_key + ".") : current_key) +
+                          key);
+          }
+          next = doc.advance(match);
+        } else if ((value_char == '\"') || (value_char == '\'')) {
+          next = doc.find_first_of(value_char, doc.advance(value),
+                                   value.get_EOL());
+          if (doc.is_end(next)) {
+            return;
+          }
+          next = doc.advance(next);
+        } else {
+          next = doc.find_first_of(" \n", value, range.end);
+        }
+      }
+      if (doc.is_end(next)) {
+        return;
+      }
+      read_ptr = doc.find_first_not_of(" \n", next, range.end);
+    }
+  }
+
+  void run(task &t);
+
+  void finish(task &t) {
+    run(t);
+    std::lock_guard<std::mutex> lock(mtx);
+    t.done = true;
+    task_done.notify_all();
+  }
+
+  void work() {
+    while (!stopping) {
+      size_t idx = next_task++;
+      if (idx >= tasks.size()) {
+        return;
+      }
+      if (!tasks[idx].claimed.exchange(true)) {
+        finish(tasks[idx]);
+      }
+    }
+  }
+
+public:
+  // If collect_stats is set, each table counts its work for take to hand on.
+  // The tables are allocated from a, if given.
+  table_prefetcher(fhicl_doc const &d, parse_options const &opts,
+                   bool collect = false,
+                   std::shared_ptr<node_arena> a = nullptr)
+      : doc(d), options(opts), collect_stats(collect), arena(std::move(a)),
+        tasks(), task_at(),
+        reference_lines(d), split_lines(0), next_task(0), stopping(false),
+        mtx(), task_done(), workers() {
+    options.threads = 1;
+    if (!doc.size()) {
+      return;
+    }
+    size_t nthreads = std::max(opts.threads, size_t(1));
+    split_lines = doc.size() / (4 * nthreads);
+    try {
+      find_tables(linedoc::doc_range::whole_doc(), "");
+    } catch (fhicl_cpp_simple_except &e) { // left for the serial parse
+    }
+    // The structural index is built lazily, so build it before sharing doc.
+    doc.index();
+    for (size_t i = 1; (i < nthreads) && (i < tasks.size()); ++i) {
+      workers.emplace_back(&table_prefetcher::work, this);
+    }
+  }
+  table_prefetcher(table_prefetcher const &) = delete;
+  table_prefetcher &operator=(table_prefetcher const &) = delete;
+  ~table_prefetcher() {
+    stopping = true;
+    for (std::thread &w : workers) {
+      w.join();
+    }
+  }
+
+  // Returns the table parsed from the body at range for key, or nullptr if it
+  // was not prefetched. Rethrows anything thrown while parsing it. The work
+  // done on it is added to stats, if given.
+  std::shared_ptr<ParameterSet> take(linedoc::doc_range range,
+                                     key_t const &key,
+                                     parse_stats *stats = nullptr) {
+    auto it = task_at.find({range.begin.line_no, range.begin.character});
+    if (it == task_at.end()) {
+      return nullptr;
+    }
+    task &t = tasks[it->second];
+    if ((t.key != key) || (t.range.end.line_no != range.end.line_no) ||
+        (t.range.end.character != range.end.character)) {
+      return nullptr;
+    }
+    if (!t.claimed.exchange(true)) {
+      run(t);
+    } else {
+      std::unique_lock<std::mutex> lock(mtx);
+      task_done.wait(lock, [&t] { return t.done; });
+    }
+    task_at.erase(it);
+    if (stats) {
+      stats->merge(t.stats);
+    }
+    if (t.error) {
+      std::rethrow_exception(t.error);
+    }
+    return std::move(t.table);
+  }
+};
+
+// The shared state of a lazy parse, see parse_options::lazy. As for
+// table_prefetcher, a table body that contains no reference directives
+// depends only on its own text. Instead of being parsed it is recorded, by
+// its extent in the document and its key, as a deferred table. It is then
+// parsed when it is first used, with its own nested tables deferred in turn.
+// The document is held until every table deferred from it is destroyed.
+class lazy_document : public std::enable_shared_from_this<lazy_document> {
+  class body : public deferred_table {
+    std::shared_ptr<lazy_document const> source;
+    linedoc::doc_range range;
+    key_t key;
+
+  public:
+    body(std::shared_ptr<lazy_document const> s, linedoc::doc_range r,
+         key_t const &k)
+        : source(std::move(s)), range(r), key(k) {}
+    void build(ParameterSet &into, bool eager) const;
+    uint64_t position() const {
+      return (uint64_t(range.begin.line_no) << 32) |
+             uint64_t(range.begin.character);
+    }
+  };
+
+  std::shared_ptr<fhicl_doc const> doc;
+  parse_options options;
+  reference_line_index reference_lines;
+  std::shared_ptr<node_arena> arena;
+
+public:
+  lazy_document(std::shared_ptr<fhicl_doc const> d,
+                parse_options const &opts,
+                std::shared_ptr<node_arena> a = nullptr)
+      : doc(std::move(d)), options(opts), reference_lines(*doc),
+        arena(std::move(a)) {
+    options.threads = 1;
+    // The structural index is built lazily, so build it before tables may be
+    // materialized on several threads.
+    doc->index();
+  }
+
+  // Returns the table with body range for key, still to be parsed, or
+  // nullptr if the body may refer to the rest of the document so must be
+  // parsed now.
+  std::shared_ptr<ParameterSet> defer(linedoc::doc_range range,
+                                      key_t const &key) const {
+    size_t first_line = range.begin.line_no;
+    size_t last_line = std::min(range.end.line_no, doc->size() - 1);
+    if (reference_lines.has_references(first_line, last_line)) {
+      return nullptr;
+    }
+    return std::make_shared<ParameterSet>(ParameterSet::deferred_set(
+        std::make_shared<body>(shared_from_this(), range, key),
+        options.track_history));
+  }
+};
 
 // #define FHICLCPP_SIMPLE_PARSERS_DEBUG
 
@@ -21,18 +590,22 @@ std::string indent = "";
 
 template <typename T>
 inline std::shared_ptr<T>
-deep_copy_resolved_reference_value(key_t const &key,
-                                   ParameterSet const &working_set,
-                                   ParameterSet const &PROLOG) {
+copy_resolved_reference_value(key_t const &key, parse_context const &ctx) {
+
+  scoped_timer timer(ctx.stats ? &ctx.stats->reference_ns : nullptr);
+  if (ctx.stats) {
+    ctx.stats->references_resolved++;
+  }
 
-  std::shared_ptr<Base> base_val = working_set.get_value_recursive(key);
-  std::shared_ptr<Base> PROLOG_val = PROLOG.get_value_recursive(key);
+  std::shared_ptr<Base> base_val = ctx.resolve(key);
+  std::shared_ptr<Base> PROLOG_val = ctx.PROLOG.get_value_recursive(key);
 
   if ((!base_val) && (!PROLOG_val)) {
     std::stringstream ss("");
     ss << std::endl
-       << "\t PROLOG: { " << PROLOG.to_string() << "}" << std::endl
-       << "\t working_set: { " << working_set.to_string() << "}" << std::endl;
+       << "\t PROLOG: { " << ctx.PROLOG.to_string() << "}" << std::endl
+       << "\t working_set: { " << ctx.working_set.to_string() << "}"
+       << std::endl;
     throw nonexistant_key()
         << "[ERROR]: Failed to resolve reference directive as key: "
         << std::quoted(key)
@@ -42,39 +615,128 @@ deep_copy_resolved_reference_value(key_t const &key,
   }
 
   // Non-PROLOG takes precedence
-  std::shared_ptr<T> value_for_ref =
-      std::dynamic_pointer_cast<T>(working_set.get_value_recursive(key));
+  std::shared_ptr<T> value_for_ref = node_pointer_cast<T>(base_val);
   if (value_for_ref) {
-    return std::dynamic_pointer_cast<T>(deep_copy_value(value_for_ref));
+    if (ctx.stats) {
+      ctx.stats->copies++;
+    }
+    return node_pointer_cast<T>(copy_value(value_for_ref));
   } else if (base_val) {
     throw wrong_fhicl_category()
         << "[ERROR]: Attempted to resolve reference to key: "
         << std::quoted(key)
         << " as fhicl category: " << fhicl_type<T>::category_string()
         << " but resolved key is of type: "
-        << working_set.get_fhicl_category_string(key);
+        << get_fhicl_category_string(base_val);
   }
 
   std::shared_ptr<T> PROLOG_value_for_ref =
-      std::dynamic_pointer_cast<T>(PROLOG.get_value_recursive(key));
+      node_pointer_cast<T>(PROLOG_val);
   if (PROLOG_value_for_ref) {
-    return std::dynamic_pointer_cast<T>(deep_copy_value(PROLOG_value_for_ref));
+    if (ctx.stats) {
+      ctx.stats->copies++;
+    }
+    return node_pointer_cast<T>(copy_value(PROLOG_value_for_ref));
   } else if (PROLOG_val) {
     throw wrong_fhicl_category()
         << "[ERROR]: Attempted to resolve reference to key: "
         << std::quoted(key)
         << " as fhicl category: " << fhicl_type<T>::category_string()
         << " but resolved key is of type: "
-        << PROLOG.get_fhicl_category_string(key);
+        << get_fhicl_category_string(PROLOG_val);
   }
 
   return nullptr;
 }
 
+// Parses the body of a table that will live at current_key in place, without
+// checking for a duplicate key or handing it off to be deferred or prefetched.
+inline std::shared_ptr<ParameterSet>
+parse_table_body(fhicl_doc const &doc, parse_context &ctx,
+                 linedoc::doc_range range, key_t const &current_key) {
+  std::shared_ptr<ParameterSet> table = ctx.new_table();
+  table->set_track_history(ctx.options.track_history);
+  parse_context::scope_guard in_scope(ctx, current_key, table);
+  parse_fhicl_document(doc, ctx, *table, range, current_key);
+  return table;
+}
+
+// Parses the body of a table that will live at current_key. The table is
+// registered with the context while it is being built so that references to
+// keys within it resolve, it is the caller's responsibility to insert it.
+inline std::shared_ptr<ParameterSet> parse_table(fhicl_doc const &doc,
+                                                 parse_context &ctx,
+                                                 linedoc::doc_range range,
+                                                 key_t const &current_key) {
+  if (ctx.resolve(current_key)) {
+    throw cant_insert() << "[ERROR]: Cannot put with key: "
+                        << std::quoted(current_key)
+                        << " as that key already exists.";
+  }
+  std::string signature;
+  if (ctx.reuse) {
+    signature = ctx.reuse->signature(range, current_key);
+    std::shared_ptr<ParameterSet> reused =
+        signature.size() ? ctx.reuse->find(signature) : nullptr;
+    if (reused) {
+      if (ctx.stats) {
+        ctx.stats->tables_reused++;
+      }
+      return reused;
+    }
+  }
+  if (ctx.lazy && !ctx.in_prolog) {
+    std::shared_ptr<ParameterSet> deferred =
+        ctx.lazy->defer(range, current_key);
+    if (deferred) {
+      return deferred;
+    }
+  }
+  if (signature.size()) {
+    ctx.reuse->enter();
+  }
+  std::shared_ptr<ParameterSet> table;
+  if (ctx.prefetch) {
+    table = ctx.prefetch->take(range, current_key, ctx.stats);
+  }
+  if (!table) {
+    table = parse_table_body(doc, ctx, range, current_key);
+  }
+  if (signature.size()) {
+    ctx.reuse->leave(signature, table);
+  }
+  return table;
+}
+
+// Parses a table body on its own, it contains no reference directives so the
+// rest of the document is not needed.
+inline void table_prefetcher::run(task &t) {
+  try {
+    parse_context ctx(ParameterSet(), ParameterSet(), options);
+    ctx.arena = arena;
+    scoped_timer timer(collect_stats ? &t.stats.parse_ns : nullptr);
+    ctx.stats = collect_stats ? &t.stats : nullptr;
+    t.table = parse_table(doc, ctx, t.range, t.key);
+    if (collect_stats) {
+      ctx.leave_file();
+    }
+  } catch (...) {
+    t.error = std::current_exception();
+  }
+}
+
+inline void lazy_document::body::build(ParameterSet &into, bool eager) const {
+  parse_context ctx(ParameterSet(), ParameterSet(), source->options);
+  if (!eager) {
+    ctx.lazy = source;
+  }
+  ctx.arena = source->arena;
+  into = std::move(*parse_table_body(*source->doc, ctx, range, key));
+}
+
 inline std::shared_ptr<Base>
 parse_object(fhicl_doc const &doc, linedoc::doc_range range,
-             linedoc::doc_line_point &next_character,
-             ParameterSet const &working_set, ParameterSet const &PROLOG,
+             linedoc::doc_line_point &next_character, parse_context &ctx,
              key_t const &current_key, bool build_sequence = false) {
 
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
@@ -91,12 +753,21 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
   std::cout << indent << "[INFO]: Next not space found at: "
             << std::quoted(doc.get_line(next_not_break, true)) << std::endl;
 #endif
+  if (ctx.stats) {
+    ctx.stats->nodes_created++;
+    ctx.file_stats_for(doc, next_not_break.line_no).nodes++;
+  }
+  double *bracket_ns = ctx.stats ? &ctx.stats->bracket_ns : nullptr;
+
   char next_not_break_char = doc.get_char(next_not_break);
   switch (next_not_break_char) {
   case '{': {
     // table member
-    linedoc::doc_line_point matching_bracket =
-        find_matching_bracket(doc, '{', '}', next_not_break);
+    linedoc::doc_line_point matching_bracket;
+    {
+      scoped_timer timer(bracket_ns);
+      matching_bracket = find_matching_bracket(doc, '{', '}', next_not_break);
+    }
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
     std::cout << indent << "[INFO]: Found table KV: {"
               << std::quoted(current_key) << ": {"
@@ -105,10 +776,9 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
               << "} } at " << doc.get_line_info(next_not_break) << std::endl;
     indent += "  ";
 #endif
-    std::shared_ptr<ParameterSet> table =
-        std::make_shared<ParameterSet>(parse_fhicl_document(
-            doc, working_set, PROLOG,
-            {doc.advance(next_not_break), matching_bracket}, current_key));
+    std::shared_ptr<ParameterSet> table = parse_table(
+        doc, ctx, {doc.advance(next_not_break), matching_bracket},
+        current_key);
 
     next_character = doc.advance(matching_bracket);
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
@@ -118,8 +788,11 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
   }
   case '[': {
     // list member
-    linedoc::doc_line_point seq_end =
-        find_matching_bracket(doc, '[', ']', next_not_break);
+    linedoc::doc_line_point seq_end;
+    {
+      scoped_timer timer(bracket_ns);
+      seq_end = find_matching_bracket(doc, '[', ']', next_not_break);
+    }
 
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
     std::cout << indent << "[INFO]: Found sequence object: "
@@ -128,9 +801,13 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
               << " from " << doc.get_line_info(next_not_break) << std::endl;
 #endif
 
-    std::shared_ptr<Sequence> seq = std::make_shared<Sequence>();
-    auto const &seq_element_str_reps =
-        get_list_elements(doc, {doc.advance(next_not_break), seq_end}, true);
+    std::shared_ptr<Sequence> seq = ctx.new_sequence();
+    std::vector<linedoc::doc_range> seq_element_str_reps;
+    {
+      scoped_timer timer(bracket_ns);
+      seq_element_str_reps =
+          get_list_elements(doc, {doc.advance(next_not_break), seq_end}, true);
+    }
 
     for (size_t el_it = 0; el_it < seq_element_str_reps.size(); ++el_it) {
       linedoc::doc_range el_range = seq_element_str_reps[el_it];
@@ -142,7 +819,11 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
                 << std::quoted(doc.substr(el_range)) << std::endl;
       indent += "  ";
 #endif
-      if (!doc.substr(el_range).size()) {
+      // Elements are trimmed, so one with no non-whitespace characters is
+      // empty. Checked in place as elements can be whole tables.
+      linedoc::doc_line_point el_first =
+          doc.find_first_not_of(" \t\n", el_range.begin, el_range.end);
+      if (!doc.is_earlier(el_first, el_range.end)) {
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
         std::cout << indent << " -- Skipping!" << std::endl;
         indent = indent.substr(2);
@@ -150,8 +831,8 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
         continue;
       }
       std::shared_ptr<Base> el_obj =
-          parse_object(doc, el_range, last_parsed_char, working_set, PROLOG,
-                       current_key, true);
+          parse_object(doc, el_range, last_parsed_char, ctx, current_key,
+                       true);
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
       indent = indent.substr(2);
 #endif
@@ -178,11 +859,10 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
 #endif
       // Handle the result of @sequence directives.
       std::shared_ptr<Sequence> child_seq =
-          std::dynamic_pointer_cast<Sequence>(el_obj);
+          node_pointer_cast<Sequence>(el_obj);
       if (child_seq) {
-        std::string str_rep = doc.substr(el_range);
-        string_parsers::trim(str_rep);
-        if (str_rep.find("@sequence") == 0) { // is sequence directive, splice
+        if (doc.substr(el_first, doc.advance(el_first, 9)) ==
+            "@sequence") { // is sequence directive, splice
           seq->splice(std::move(*child_seq));
         } else {
           seq->put(std::move(el_obj));
@@ -191,6 +871,7 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
         seq->put(std::move(el_obj));
       }
     }
+    seq->pack();
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
     std::cout << indent << "[INFO]: Parsed sequence = " << seq->to_string()
               << std::endl;
@@ -229,7 +910,7 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
               << ":" << std::quoted(value) << "}. at "
               << doc.get_line_info(next_not_break) << std::endl;
 #endif
-    return std::make_shared<Atom>(value);
+    return ctx.new_atom(value);
   }
   case '@': {
     if (next_not_break.line_no != range.begin.line_no) {
@@ -270,7 +951,7 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
       std::cout << indent << "[INFO]: Found nil directive at "
                 << std::quoted(doc.get_line(next_not_break, true)) << std::endl;
 #endif
-      return std::make_shared<Atom>("@nil");
+      return ctx.new_atom("@nil");
     } else {
       std::string dc =
           doc.substr(directive_range.end, doc.advance(directive_range.end, 2));
@@ -317,8 +998,7 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
                   << std::quoted(doc.get_line(directive_range.begin, true))
                   << std::endl;
 #endif
-        return deep_copy_resolved_reference_value<Base>(directive_key,
-                                                        working_set, PROLOG);
+        return copy_resolved_reference_value<Base>(directive_key, ctx);
       } else if (directive == "table") {
         throw malformed_document()
             << "[ERROR]: Found @table directive "
@@ -343,8 +1023,7 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
                   << std::quoted(directive_key) << " at "
                   << doc.get_line_info(next_not_break) << std::endl;
 #endif
-        return deep_copy_resolved_reference_value<Sequence>(
-            directive_key, working_set, PROLOG);
+        return copy_resolved_reference_value<Sequence>(directive_key, ctx);
       } else {
         throw malformed_document()
             << "[ERROR]: Unknown fhicl directive: " << std::quoted(directive)
@@ -386,41 +1065,16 @@ parse_object(fhicl_doc const &doc, linedoc::doc_range range,
               << doc.get_line_info(next_character) << std::endl;
 #endif
     next_character = next_break;
-    return std::make_shared<Atom>(value);
+    return ctx.new_atom(value);
   }
   }
 }
 
-ParameterSet
-parse_fhicl_document(fhicl_doc const &doc,
-                     ParameterSet const &_working_set = ParameterSet(),
-                     ParameterSet const &_PROLOG = ParameterSet(),
-                     linedoc::doc_range range = linedoc::doc_range::whole_doc(),
-                     key_t const &current_key = "") {
+void parse_fhicl_document(fhicl_doc const &doc, parse_context &ctx,
+                          ParameterSet &ps, linedoc::doc_range range,
+                          key_t const &current_key) {
 
   bool in_prolog = false;
-  std::shared_ptr<ParameterSet> PROLOG =
-      std::make_shared<ParameterSet>(_PROLOG);
-  std::shared_ptr<ParameterSet> working_set =
-      std::make_shared<ParameterSet>(_working_set);
-  std::shared_ptr<ParameterSet> ps;
-
-  if (current_key
-          .size()) { // if we have recursed into a child, the working set will
-                     // contain information and the currently building parameter
-                     // set should be correctly placed within it
-    working_set->put(current_key, ParameterSet());
-    ps = std::dynamic_pointer_cast<ParameterSet>(
-        working_set->get_value_recursive(current_key));
-    if (!ps) {
-      throw internal_error()
-          << "[ERROR]: When attempting to add working ParameterSet to "
-             "working_set.";
-    }
-  } else { // if this is the top level, then we don't really care and
-           // _working_set should be empty.
-    ps = working_set;
-  }
 
   linedoc::doc_line_point read_ptr = doc.find_first_not_of(" \n", range.begin);
 
@@ -439,6 +1093,10 @@ parse_fhicl_document(fhicl_doc const &doc,
       continue;
     }
 
+    if (ctx.stats) {
+      ctx.enter_file(doc, read_ptr.line_no);
+    }
+
     linedoc::doc_line_point next_char;
     linedoc::doc_line_point next_break_char =
         doc.find_first_of(" \n:", read_ptr, range.end);
@@ -464,10 +1122,12 @@ parse_fhicl_document(fhicl_doc const &doc,
 
     // A few special cases.
     if (token == "BEGIN_PROLOG") {
-      if (working_set->get_names().size() || ps->get_names().size()) {
+      if (current_key.size() || ctx.working_set.get_names().size() ||
+          ps.get_names().size()) {
         std::stringstream ss("");
-        for (auto const &name : working_set->get_names()) {
-          ss << name << ": " << working_set->get_src_info(name) << std::endl;
+        for (auto const &name : ctx.working_set.get_names()) {
+          ss << name << ": " << ctx.working_set.get_src_info(name)
+             << std::endl;
         }
         throw malformed_document()
             << "[ERROR]: Found BEGIN_PROLOG directive at "
@@ -475,15 +1135,15 @@ parse_fhicl_document(fhicl_doc const &doc,
             << " after non-prolog key: value pairs have been defined: "
             << ss.str();
       }
-      in_prolog = true;
+      in_prolog = ctx.in_prolog = true;
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
       std::cout << indent << "[INFO]: In prolog." << std::endl;
 #endif
     } else if (token == "END_PROLOG") {
-      in_prolog = false;
+      in_prolog = ctx.in_prolog = false;
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
       std::cout << indent
-                << "[INFO]: No longer in prolog: " << PROLOG->to_string()
+                << "[INFO]: No longer in prolog: " << ctx.PROLOG.to_string()
                 << std::endl;
 #endif
     } else if (token.front() == '@') {
@@ -528,9 +1188,8 @@ parse_fhicl_document(fhicl_doc const &doc,
 #endif
 
         std::shared_ptr<ParameterSet> table_for_splice =
-            deep_copy_resolved_reference_value<ParameterSet>(
-                table_key, *working_set, *PROLOG);
-        (in_prolog ? PROLOG : ps)->splice(std::move(*table_for_splice));
+            copy_resolved_reference_value<ParameterSet>(table_key, ctx);
+        (in_prolog ? ctx.PROLOG : ps).splice(std::move(*table_for_splice));
 
         next_char = table_directive_key.end;
       } else {
@@ -591,13 +1250,17 @@ parse_fhicl_document(fhicl_doc const &doc,
                 << std::endl;
 #endif
 
-      std::shared_ptr<Base> new_obj =
-          parse_object(doc, {next_break_char, range.end}, next_char,
-                       *working_set, *PROLOG, new_object_key);
+      std::shared_ptr<Base> new_obj = parse_object(
+          doc, {next_break_char, range.end}, next_char, ctx, new_object_key);
+      if (ctx.stats) { // back from any statements nested in the value
+        ctx.enter_file(doc, read_ptr.line_no);
+      }
 
-      (in_prolog ? PROLOG : ps)
-          ->put_with_custom_history(key, std::move(new_obj),
-                                    doc.get_line_info(read_ptr));
+      (in_prolog ? ctx.PROLOG : ps)
+          .put_with_custom_history(key, std::move(new_obj),
+                                   ctx.options.track_history
+                                       ? doc.get_line_info(read_ptr)
+                                       : std::string());
     }
 #ifdef FHICLCPP_SIMPLE_PARSERS_DEBUG
     std::cout << indent << "After reading value, next_char = " << next_char
@@ -617,7 +1280,98 @@ parse_fhicl_document(fhicl_doc const &doc,
               << "." << std::endl;
 #endif
   }
+}
 
-  return (*ps);
+ParameterSet
+parse_fhicl_document(fhicl_doc const &doc,
+                     ParameterSet const &_working_set = ParameterSet(),
+                     ParameterSet const &_PROLOG = ParameterSet(),
+                     linedoc::doc_range range = linedoc::doc_range::whole_doc(),
+                     key_t const &current_key = "") {
+  parse_context ctx(_working_set, _PROLOG);
+  if (current_key.size()) { // parse as the body of a child of _working_set
+    return std::move(*parse_table(doc, ctx, range, current_key));
+  }
+  parse_fhicl_document(doc, ctx, ctx.working_set, range, current_key);
+  return std::move(ctx.working_set);
+}
+
+inline ParameterSet
+parse_fhicl_document(std::shared_ptr<fhicl_doc const> const &doc,
+                     parse_options const &options,
+                     parse_stats *stats = nullptr,
+                     table_body_cache *reuse = nullptr);
+
+// If stats is given, the work done is added to it. If reuse is given, tables
+// that are unchanged since the last parse with it are taken from there, see
+// table_body_cache. A lazy parse takes a copy of doc, which the overload below
+// avoids.
+inline ParameterSet parse_fhicl_document(fhicl_doc const &doc,
+                                         parse_options const &options,
+                                         parse_stats *stats = nullptr,
+                                         table_body_cache *reuse = nullptr) {
+  if (options.lazy) {
+    return parse_fhicl_document(std::make_shared<fhicl_doc const>(doc),
+                                options, stats, reuse);
+  }
+  scoped_timer timer(stats ? &stats->parse_ns : nullptr);
+  parse_context ctx(ParameterSet(), ParameterSet(), options);
+  ctx.stats = stats;
+  ctx.reuse = reuse;
+  if (reuse) {
+    reuse->begin(doc);
+  }
+  if (options.arena) {
+    ctx.arena = std::make_shared<node_arena>();
+  }
+  if (stats) { // otherwise built on first use
+    scoped_timer index_timer(&stats->bracket_ns);
+    doc.index();
+  }
+  std::unique_ptr<table_prefetcher> prefetch;
+  if (options.threads > 1) {
+    prefetch.reset(
+        new table_prefetcher(doc, options, bool(stats), ctx.arena));
+    ctx.prefetch = prefetch.get();
+  }
+  parse_fhicl_document(doc, ctx, ctx.working_set,
+                       linedoc::doc_range::whole_doc(), "");
+  if (stats) {
+    ctx.finish_stats();
+  }
+  if (reuse) {
+    reuse->finish();
+  }
+  return std::move(ctx.working_set);
+}
+
+// For a lazy parse, the tables that are deferred share ownership of doc.
+inline ParameterSet
+parse_fhicl_document(std::shared_ptr<fhicl_doc const> const &doc,
+                     parse_options const &options, parse_stats *stats,
+                     table_body_cache *reuse) {
+  if (!options.lazy) {
+    return parse_fhicl_document(*doc, options, stats, reuse);
+  }
+  scoped_timer timer(stats ? &stats->parse_ns : nullptr);
+  parse_context ctx(ParameterSet(), ParameterSet(), options);
+  ctx.stats = stats;
+  ctx.reuse = reuse;
+  if (reuse) {
+    reuse->begin(*doc);
+  }
+  if (options.arena) {
+    ctx.arena = std::make_shared<node_arena>();
+  }
+  ctx.lazy = std::make_shared<lazy_document>(doc, options, ctx.arena);
+  parse_fhicl_document(*doc, ctx, ctx.working_set,
+                       linedoc::doc_range::whole_doc(), "");
+  if (stats) {
+    ctx.finish_stats();
+  }
+  if (reuse) {
+    reuse->finish();
+  }
+  return std::move(ctx.working_set);
 }
 } // namespace fhicl
@@ -0,0 +1,691 @@
+#pragma once
+
+#include "fhiclcpp/ParameterSet.h"
+#include "fhiclcpp/exception.hxx"
+#include "fhiclcpp/mapped_file.hxx"
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fhicl {
+
+// A compact binary serialization of a resolved ParameterSet, and a reader
+// that answers lookups straight from a read-only mapping of it. Opening a
+// snapshot only validates its header, each lookup then reads just the tables
+// on the path to the requested key, so its cost does not depend on the size
+// of the document.
+//
+// A snapshot is written in the byte order of the host that wrote it, and is
+// rejected by hosts of the other byte order. All offsets are from the start
+// of the file and every node starts on an 8 byte boundary:
+//
+//   header       see snapshot::header
+//   nodes        children are written before their parents
+//     atom:      u32 kAtom, u32 string id, u32 Atom::value_kind, u32 0,
+//                u64 decoded value bits
+//     sequence:  u32 kSequence, u32 size, u64 element offsets[size]
+//     packed:    u32 kIntegerSequence or kFloatSequence, u32 size,
+//                int64_t or double values[size], u32 string ids[size]
+//     table:     u32 kTable, u32 size, u64 digest,
+//                {u32 key string id, u32 0, u64 value offset}[size] in
+//                key order
+//   strings      u64 offsets[nstrings + 1] into the string data, followed by
+//                the string data. Keys and atoms share the string table.
+class snapshot {
+public:
+  enum : uint32_t { version = 1 };
+
+private:
+  struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t root;
+    uint64_t nstrings;
+    uint64_t string_offsets;
+    uint64_t string_data;
+    uint64_t reserved;
+  };
+  static char const *magic() { return "FHICLSNP"; }
+  enum : uint32_t { byte_order_mark = 0x01020304 };
+
+  enum node_kind : uint32_t {
+    kAtom = 1,
+    kSequence,
+    kIntegerSequence,
+    kFloatSequence,
+    kTable
+  };
+
+  static constexpr uint64_t npos = std::numeric_limits<uint64_t>::max();
+
+  // A value in the snapshot: the node at offset, or for elements of packed
+  // sequences, element number element of the packed node at offset.
+  struct node {
+    uint64_t offset;
+    uint64_t element;
+    bool exists() const { return offset != 0; }
+  };
+
+  std::shared_ptr<mapped_file const> file;
+  char const *data;
+  size_t size;
+  header hdr;
+  node root;
+
+  template <typename T> T load(uint64_t offset) const {
+    if ((offset > size) || ((size - offset) < sizeof(T))) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot read at offset " << offset
+          << " runs past the end of the " << size << " byte snapshot.";
+    }
+    T v;
+    std::memcpy(&v, data + offset, sizeof(T));
+    return v;
+  }
+
+  void get_string(uint32_t id, char const *&str, size_t &len) const {
+    if (id >= hdr.nstrings) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot refers to string " << id << " of "
+          << hdr.nstrings << ".";
+    }
+    uint64_t begin = load<uint64_t>(hdr.string_offsets + (8 * uint64_t(id)));
+    uint64_t end = load<uint64_t>(hdr.string_offsets + (8 * uint64_t(id)) + 8);
+    if ((begin > end) || (end > (size - hdr.string_data))) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot string " << id << " is out of bounds.";
+    }
+    str = data + hdr.string_data + begin;
+    len = size_t(end - begin);
+  }
+  std::string get_string(uint32_t id) const {
+    char const *str;
+    size_t len;
+    get_string(id, str, len);
+    return std::string(str, len);
+  }
+
+  uint32_t kind(node n) const {
+    return (n.element == npos) ? load<uint32_t>(n.offset) : uint32_t(kAtom);
+  }
+  uint32_t node_size(node n) const { return load<uint32_t>(n.offset + 4); }
+  bool is_sequence(node n) const {
+    uint32_t k = kind(n);
+    return (k == kSequence) || (k == kIntegerSequence) ||
+           (k == kFloatSequence);
+  }
+
+  // Children are always written before their parents, checking that keeps
+  // corrupt snapshots from sending lookups round in circles.
+  node child(node parent, uint64_t offset) const {
+    if (offset >= parent.offset) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot node at offset " << parent.offset
+          << " refers forward to offset " << offset << ".";
+    }
+    return {offset, npos};
+  }
+
+  node element(node seq, size_t idx) const {
+    if (idx >= node_size(seq)) {
+      return {0, npos};
+    }
+    if (kind(seq) == kSequence) {
+      return child(seq, load<uint64_t>(seq.offset + 8 + (8 * idx)));
+    }
+    return {seq.offset, idx};
+  }
+
+  // Finds key in the table at table, returns a node that does not exist if
+  // it is not there.
+  node find(node table, char const *key, size_t len) const {
+    uint64_t entries = table.offset + 16;
+    size_t lo = 0;
+    size_t hi = node_size(table);
+    while (lo < hi) {
+      size_t mid = lo + ((hi - lo) / 2);
+      char const *mid_key;
+      size_t mid_len;
+      get_string(load<uint32_t>(entries + (16 * mid)), mid_key, mid_len);
+      int cmp = std::memcmp(mid_key, key, std::min(mid_len, len));
+      if (!cmp && (mid_len != len)) {
+        cmp = (mid_len < len) ? -1 : 1;
+      }
+      if (!cmp) {
+        return child(table, load<uint64_t>(entries + (16 * mid) + 8));
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return {0, npos};
+  }
+
+  // Reads the kind and value bits of an atom, returns false if n is not one.
+  bool atom_value(node n, Atom::value_kind &vk, uint64_t &bits) const {
+    if (!n.exists()) {
+      return false;
+    }
+    if (n.element != npos) {
+      vk = (load<uint32_t>(n.offset) == kIntegerSequence)
+               ? Atom::value_kind::kInteger
+               : Atom::value_kind::kFloat;
+      bits = load<uint64_t>(n.offset + 8 + (8 * n.element));
+      return true;
+    }
+    if (load<uint32_t>(n.offset) != kAtom) {
+      return false;
+    }
+    vk = Atom::value_kind(load<uint32_t>(n.offset + 8));
+    bits = load<uint64_t>(n.offset + 16);
+    return true;
+  }
+
+  std::string get_fhicl_category_string(node n) const {
+    switch (kind(n)) {
+    case kAtom: {
+      Atom::value_kind vk;
+      uint64_t bits;
+      atom_value(n, vk, bits);
+      return (vk == Atom::value_kind::kNil) ? "@nil" : "Atom";
+    }
+    case kTable: {
+      return "Table";
+    }
+    default: { return "Sequence"; }
+    }
+  }
+
+  // Mirrors ParameterSet::get_value_recursive(key_path const &).
+  node lookup(key_path const &path) const {
+    node table = root;
+    for (size_t i = 0; i < path.size(); ++i) {
+      key_path::segment const &seg = path[i];
+      node value = find(table, path.name_data(i), seg.name_length);
+      if (!value.exists()) {
+        return value;
+      }
+
+      if (seg.has_index()) {
+        if (!is_sequence(value)) {
+          throw wrong_fhicl_category()
+              << "[ERROR]: Attempted to access index of a sequence with key: "
+              << std::quoted(path.prefix(i))
+              << ", however the value is of fhicl type "
+              << std::quoted(get_fhicl_category_string(value));
+        }
+        value = element(value, seg.index);
+      }
+
+      if (((i + 1) == path.size()) || !value.exists()) {
+        return value;
+      }
+
+      if (kind(value) != kTable) {
+        throw wrong_fhicl_category()
+            << "[ERROR]: Attempted to recurse into fhicl table: "
+            << std::quoted(path.prefix(i))
+            << " for resolution of: " << std::quoted(path.str())
+            << ", however the value is of fhicl type "
+            << std::quoted(get_fhicl_category_string(value));
+      }
+      table = value;
+    }
+    return {0, npos};
+  }
+
+  // Builds the value at n as it was in the ParameterSet that was written.
+  std::shared_ptr<Base> materialize(node n) const {
+    if (!n.exists()) {
+      return nullptr;
+    }
+    if (n.element != npos) {
+      uint64_t ids = n.offset + 8 + (8 * uint64_t(node_size(n)));
+      return std::make_shared<Atom>(
+          get_string(load<uint32_t>(ids + (4 * n.element))));
+    }
+    switch (kind(n)) {
+    case kAtom: {
+      return std::make_shared<Atom>(get_string(load<uint32_t>(n.offset + 4)));
+    }
+    case kSequence:
+    case kIntegerSequence:
+    case kFloatSequence: {
+      std::shared_ptr<Sequence> seq = std::make_shared<Sequence>();
+      for (size_t i = 0; i < node_size(n); ++i) {
+        seq->put(materialize(element(n, i)));
+      }
+      if (kind(n) != kSequence) {
+        seq->pack();
+      }
+      return seq;
+    }
+    case kTable: {
+      std::shared_ptr<ParameterSet> ps = std::make_shared<ParameterSet>();
+      ps->unshare();
+      uint64_t entries = n.offset + 16;
+      for (size_t i = 0; i < node_size(n); ++i) {
+        ps->rep->internal_rep[get_string(load<uint32_t>(entries + (16 * i)))] =
+            materialize(child(n, load<uint64_t>(entries + (16 * i) + 8)));
+      }
+      return ps;
+    }
+    default: {
+      throw malformed_snapshot() << "[ERROR]: Snapshot node at offset "
+                                 << n.offset << " has unknown kind " << kind(n)
+                                 << ".";
+    }
+    }
+  }
+
+  // Like ParameterSet::get_decoded, reads numbers, bools and sequences of them
+  // directly from the snapshot, returns false if the caller should fall back
+  // to ParameterSet::value_as on the materialized value.
+  template <typename T>
+  typename std::enable_if<is_atom_decodable<T>::value, bool>::type
+  get_decoded(node n, T &rtn) const {
+    Atom::value_kind vk;
+    uint64_t bits;
+    return atom_value(n, vk, bits) && Atom::convert_decoded(vk, bits, rtn);
+  }
+  template <typename T>
+  typename std::enable_if<is_sequence_decodable<T>::value, bool>::type
+  get_decoded(node n, T &rtn) const {
+    if (!n.exists() || !is_sequence(n)) {
+      return false;
+    }
+    T decoded;
+    if (!resize_decoded(decoded, node_size(n))) {
+      return false;
+    }
+    for (size_t i = 0; i < node_size(n); ++i) {
+      typename T::value_type el;
+      if (!get_decoded(element(n, i), el)) {
+        return false;
+      }
+      decoded[i] = el;
+    }
+    rtn = std::move(decoded);
+    return true;
+  }
+  template <typename T>
+  typename std::enable_if<!is_atom_decodable<T>::value &&
+                              !is_sequence_decodable<T>::value,
+                          bool>::type
+  get_decoded(node, T &) const {
+    return false;
+  }
+
+  template <typename T>
+  static bool resize_decoded(std::vector<T> &v, size_t n) {
+    v.resize(n);
+    return true;
+  }
+  template <typename T, size_t N>
+  static bool resize_decoded(std::array<T, N> &, size_t n) {
+    return n == N;
+  }
+
+  // Serializes a ParameterSet, see the layout above.
+  class writer {
+    std::string out;
+    std::unordered_map<std::string, uint32_t> string_ids;
+    std::vector<std::string const *> strings;
+
+    template <typename T> void put(T v) {
+      out.append(reinterpret_cast<char const *>(&v), sizeof(T));
+    }
+    uint64_t begin_node() {
+      out.append((8 - (out.size() % 8)) % 8, '\0');
+      return out.size();
+    }
+    uint32_t intern(std::string const &str) {
+      auto it = string_ids.find(str);
+      if (it != string_ids.end()) {
+        return it->second;
+      }
+      if (strings.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw bizare_error()
+            << "[ERROR]: Too many distinct strings to write a snapshot.";
+      }
+      uint32_t id = uint32_t(strings.size());
+      strings.push_back(&string_ids.emplace(str, id).first->first);
+      return id;
+    }
+    static uint32_t checked_size(size_t size) {
+      if (size > std::numeric_limits<uint32_t>::max()) {
+        throw bizare_error() << "[ERROR]: Cannot write a snapshot of a "
+                                "sequence or table with "
+                             << size << " elements.";
+      }
+      return uint32_t(size);
+    }
+
+    uint64_t write(Base const *value) {
+      Atom const *atm = node_cast<Atom>(value);
+      if (atm) {
+        uint32_t id = intern(atm->string_rep());
+        Atom::value_kind vk = atm->decode();
+        uint64_t offset = begin_node();
+        put(uint32_t(kAtom));
+        put(id);
+        put(uint32_t(vk));
+        put(uint32_t(0));
+        put(atm->decoded_value_bits());
+        return offset;
+      }
+      Sequence const *seq = node_cast<Sequence>(value);
+      if (seq) {
+        uint32_t n = checked_size(seq->size());
+        if (seq->is_packed()) {
+          bool integers = (seq->packed_kind() == Atom::value_kind::kInteger);
+          std::vector<uint32_t> ids;
+          for (size_t i = 0; i < n; ++i) {
+            ids.push_back(intern(seq->packed_element_string(i)));
+          }
+          uint64_t offset = begin_node();
+          put(uint32_t(integers ? kIntegerSequence : kFloatSequence));
+          put(n);
+          if (integers) {
+            for (int64_t v : seq->as_span<int64_t>()) {
+              put(v);
+            }
+          } else {
+            for (double v : seq->as_span<double>()) {
+              put(v);
+            }
+          }
+          for (uint32_t id : ids) {
+            put(id);
+          }
+          return offset;
+        }
+        std::vector<uint64_t> elements;
+        for (size_t i = 0; i < n; ++i) {
+          elements.push_back(write(seq->get(i).get()));
+        }
+        uint64_t offset = begin_node();
+        put(uint32_t(kSequence));
+        put(n);
+        for (uint64_t el : elements) {
+          put(el);
+        }
+        return offset;
+      }
+      ParameterSet const *ps = node_cast<ParameterSet>(value);
+      if (ps) {
+        std::vector<std::pair<uint32_t, uint64_t>> entries;
+        for (auto const &kv : ps->rep->internal_rep) {
+          entries.emplace_back(intern(kv.first), write(kv.second.get()));
+        }
+        uint64_t offset = begin_node();
+        put(uint32_t(kTable));
+        put(checked_size(entries.size()));
+        put(uint64_t(ps->digest()));
+        for (auto const &entry : entries) {
+          put(entry.first);
+          put(uint32_t(0));
+          put(entry.second);
+        }
+        return offset;
+      }
+      throw bizare_error()
+          << "[ERROR]: When writing snapshot, failed to cast value as any "
+             "known type.";
+    }
+
+  public:
+    std::string operator()(ParameterSet const &ps) {
+      out.assign(sizeof(header), '\0');
+      header hdr;
+      std::memcpy(hdr.magic, magic(), sizeof(hdr.magic));
+      hdr.version = version;
+      hdr.byte_order = byte_order_mark;
+      hdr.root = write(&ps);
+      hdr.nstrings = strings.size();
+      hdr.string_offsets = begin_node();
+      uint64_t string_end = 0;
+      put(string_end);
+      for (std::string const *str : strings) {
+        string_end += str->size();
+        put(string_end);
+      }
+      hdr.string_data = out.size();
+      for (std::string const *str : strings) {
+        out += *str;
+      }
+      hdr.file_size = out.size();
+      hdr.reserved = 0;
+      std::memcpy(&out[0], &hdr, sizeof(hdr));
+      return std::move(out);
+    }
+  };
+
+  // A view of the table at r that shares the data of parent.
+  snapshot(snapshot const &parent, node r)
+      : file(parent.file), data(parent.data), size(parent.size),
+        hdr(parent.hdr), root(r) {}
+
+  // Validates the header, filename names the snapshot in errors.
+  void open(char const *filename) {
+    if (size < sizeof(header)) {
+      throw malformed_snapshot()
+          << "[ERROR]: File: " << std::quoted(filename)
+          << " is too short to be a fhicl snapshot.";
+    }
+    std::memcpy(&hdr, data, sizeof(header));
+    if (std::memcmp(hdr.magic, magic(), sizeof(hdr.magic))) {
+      throw malformed_snapshot() << "[ERROR]: File: " << std::quoted(filename)
+                                 << " is not a fhicl snapshot.";
+    }
+    if (hdr.byte_order != byte_order_mark) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot: " << std::quoted(filename)
+          << " was written on a host of a different byte order.";
+    }
+    if (hdr.version != version) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot: " << std::quoted(filename) << " has version "
+          << hdr.version << ", expected " << uint32_t(version) << ".";
+    }
+    if ((hdr.file_size != size) || (hdr.string_data > size) ||
+        (hdr.string_offsets > hdr.string_data) ||
+        (((hdr.string_data - hdr.string_offsets) / 8) <= hdr.nstrings)) {
+      throw malformed_snapshot()
+          << "[ERROR]: Snapshot: " << std::quoted(filename)
+          << " is truncated or corrupt.";
+    }
+    root = {hdr.root, npos};
+    if ((kind(root) != kTable)) {
+      throw malformed_snapshot() << "[ERROR]: Snapshot: "
+                                 << std::quoted(filename)
+                                 << " does not hold a table.";
+    }
+  }
+
+  static bool is_identifier(std::string const &name) {
+    if (!name.size() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+      return false;
+    }
+    for (char c : name) {
+      if (!std::isalnum(static_cast<unsigned char>(c)) && (c != '_')) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  // Maps the snapshot at filename and validates its header.
+  explicit snapshot(std::string const &filename)
+      : file(std::make_shared<mapped_file>(filename)), data(file->data()),
+        size(file->size()), hdr(), root{0, npos} {
+    if (!file->is_mapped()) {
+      throw file_does_not_exist()
+          << "[ERROR]: Snapshot file: " << std::quoted(filename)
+          << " could not be opened and mapped for reading.";
+    }
+    open(filename.c_str());
+  }
+  // A snapshot of bytes that outlive it, such as one embedded in the program
+  // by write_embedded. Validates the header, but neither copies nor
+  // allocates.
+  snapshot(char const *bytes, size_t nbytes,
+           char const *name = "<in memory>")
+      : file(), data(bytes), size(nbytes), hdr(), root{0, npos} {
+    open(name);
+  }
+
+  static std::string serialize(ParameterSet const &ps) { return writer()(ps); }
+  static void write(ParameterSet const &ps, std::string const &filename) {
+    std::string bytes = serialize(ps);
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    ofs.write(bytes.data(), std::streamsize(bytes.size()));
+    if (!ofs.good()) {
+      throw file_does_not_exist()
+          << "[ERROR]: Failed to write snapshot to " << std::quoted(filename)
+          << ".";
+    }
+  }
+
+  // Writes ps as a C++ header that embeds its snapshot, so that a program
+  // that includes it can use ps without reading or parsing anything, see
+  // fhiclcpp_embed_config in cmake/Modules/fhiclcppEmbed.cmake. The header
+  // defines, in namespace fhicl::embedded,
+  //
+  //   constexpr ParameterSetID <name>_id; // ps.id()
+  //   snapshot const &<name>();
+  //
+  // The bytes are a constant initialized array, and the snapshot over them
+  // is built on first use, which only checks the header.
+  static void write_embedded(ParameterSet const &ps, std::string const &name,
+                             std::string const &filename,
+                             std::string const &source = "") {
+    if (!is_identifier(name)) {
+      throw invalid_key() << "[ERROR]: Cannot embed a snapshot as "
+                          << std::quoted(name)
+                          << ", which is not a C++ identifier.";
+    }
+    std::string bytes = serialize(ps);
+    std::ofstream ofs(filename, std::ios::trunc);
+    ofs << "#pragma once\n\n// Generated by snapshot::write_embedded"
+        << (source.size() ? (" from " + source) : std::string())
+        << ", do not edit.\n\n#include \"fhiclcpp/snapshot.hxx\"\n\n"
+        << "namespace fhicl {\nnamespace embedded {\n\n"
+        << "constexpr ParameterSetID " << name << "_id = 0x" << std::hex
+        << ps.id() << std::dec << "ULL;\n\n"
+        << "inline snapshot const &" << name << "() {\n"
+        << "  alignas(8) static constexpr unsigned char bytes[] = {";
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      ofs << (i % 16 ? " " : "\n      ") << "0x" << std::hex << std::setw(2)
+          << std::setfill('0') << unsigned(static_cast<unsigned char>(bytes[i]))
+          << std::dec << ",";
+    }
+    ofs << "\n  };\n"
+        << "  static snapshot const snap(reinterpret_cast<char const *>(bytes),\n"
+        << "                             sizeof(bytes), \"" << name
+        << "\");\n"
+        << "  return snap;\n}\n\n} // namespace embedded\n} // namespace fhicl\n";
+    if (!ofs.good()) {
+      throw file_does_not_exist()
+          << "[ERROR]: Failed to write embedded snapshot to "
+          << std::quoted(filename) << ".";
+    }
+  }
+
+  // The ParameterSet::id of the table that was written.
+  ParameterSetID id() const { return load<uint64_t>(root.offset + 8); }
+
+  std::vector<key_t> get_names() const {
+    std::vector<key_t> names;
+    for (size_t i = 0; i < node_size(root); ++i) {
+      names.push_back(get_string(load<uint32_t>(root.offset + 16 + (16 * i))));
+    }
+    return names;
+  }
+
+  bool has_key(key_path const &path) const {
+    return lookup(path).exists();
+  }
+  bool has_key(key_t const &key) const { return has_key(key_path(key)); }
+
+  template <typename T> T get(key_path const &path) const {
+    node n = lookup(path);
+    T rtn;
+    if (get_decoded(n, rtn)) {
+      return rtn;
+    }
+    return ParameterSet::value_as<T>(materialize(n), path.str());
+  }
+  template <typename T> T get(key_t const &key) const {
+    return get<T>(key_path(key));
+  }
+
+  template <typename T> T get(key_path const &path, T def) const {
+    try {
+      return get<T>(path);
+    } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) { // parser fail
+      return def;
+    } catch (fhicl::fhicl_cpp_simple_except &e) { // type fail
+      return def;
+    }
+  }
+  template <typename T> T get(key_t const &key, T def) const {
+    if (!key_path::is_valid(key)) {
+      return def;
+    }
+    return get<T>(key_path(key), def);
+  }
+
+  template <typename T> bool get_if_present(key_t const &key, T &rtn) const {
+    key_path path(key);
+    if (!has_key(path)) {
+      return false;
+    }
+    try {
+      rtn = get<T>(path);
+    } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) { // parser fail
+      return false;
+    } catch (fhicl::fhicl_cpp_simple_except &e) { // type fail
+      return false;
+    }
+    return true;
+  }
+
+  // A view of the table at key that shares this snapshot's mapping.
+  snapshot get_table(key_t const &key) const {
+    key_path path(key);
+    node n = lookup(path);
+    if (!n.exists()) {
+      throw nonexistant_key() << "[ERROR]: Key " << std::quoted(key)
+                              << " does not exist in snapshot.";
+    }
+    if (kind(n) != kTable) {
+      throw wrong_fhicl_category()
+          << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
+          << " as a fhicl table, but it corresponds to a "
+          << std::quoted(get_fhicl_category_string(n));
+    }
+    return snapshot(*this, n);
+  }
+
+  // Builds the whole ParameterSet, without history.
+  ParameterSet to_ParameterSet() const {
+    return std::move(static_cast<ParameterSet &>(*materialize(root)));
+  }
+};
+
+} // namespace fhicl
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#if (__cplusplus >= 201703L) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+namespace fhicl {
+namespace string_parsers {
+
+enum class number_kind { kNotANumber, kInteger, kFloat };
+
+namespace detail {
+
+inline bool is_digit(char c) { return (c >= '0') && (c <= '9'); }
+
+inline int hex_digit_value(char c) {
+  if (is_digit(c)) {
+    return c - '0';
+  }
+  if ((c >= 'a') && (c <= 'f')) {
+    return 10 + (c - 'a');
+  }
+  if ((c >= 'A') && (c <= 'F')) {
+    return 10 + (c - 'A');
+  }
+  return -1;
+}
+
+// Accumulates the digits in [first, last) in the given base into rtn, returns
+// false if any character is not a digit or the value would exceed max.
+inline bool accumulate_digits(char const *first, char const *last,
+                              uint64_t base, uint64_t max, uint64_t &rtn) {
+  if (first == last) {
+    return false;
+  }
+  rtn = 0;
+  for (; first != last; ++first) {
+    int dv = (base == 16) ? hex_digit_value(*first)
+                          : (is_digit(*first) ? (*first - '0') : -1);
+    if ((dv < 0) || (uint64_t(dv) >= base)) {
+      return false;
+    }
+    if (rtn > ((max - uint64_t(dv)) / base)) {
+      return false;
+    }
+    rtn = (rtn * base) + uint64_t(dv);
+  }
+  return true;
+}
+
+// Checks that [first, last) matches
+//   [+-]? (digits ('.' digits?)? | '.' digits) ([eE] [+-]? digits)?
+inline bool is_decimal_float(char const *first, char const *last) {
+  if ((first != last) && ((*first == '+') || (*first == '-'))) {
+    ++first;
+  }
+  size_t n_mantissa_digits = 0;
+  for (; (first != last) && is_digit(*first); ++first) {
+    n_mantissa_digits++;
+  }
+  if ((first != last) && (*first == '.')) {
+    ++first;
+    for (; (first != last) && is_digit(*first); ++first) {
+      n_mantissa_digits++;
+    }
+  }
+  if (!n_mantissa_digits) {
+    return false;
+  }
+  if ((first != last) && ((*first == 'e') || (*first == 'E'))) {
+    ++first;
+    if ((first != last) && ((*first == '+') || (*first == '-'))) {
+      ++first;
+    }
+    if ((first == last) || !is_digit(*first)) {
+      return false;
+    }
+    for (; (first != last) && is_digit(*first); ++first) {
+    }
+  }
+  return first == last;
+}
+
+inline bool decimal_to_double(char const *first, char const *last,
+                              double &rtn) {
+  if (*first == '+') {
+    ++first;
+  }
+#if defined(__cpp_lib_to_chars)
+  std::from_chars_result res = std::from_chars(first, last, rtn);
+  // std::stod reports subnormal results as out of range, keep the same domain
+  return (res.ec == std::errc()) && (res.ptr == last) &&
+         (std::fpclassify(rtn) != FP_SUBNORMAL);
+#else
+  char buf[64];
+  std::string long_buf;
+  char const *cstr = buf;
+  size_t len = size_t(last - first);
+  if (len < sizeof(buf)) {
+    std::copy(first, last, buf);
+    buf[len] = '\0';
+  } else {
+    long_buf.assign(first, last);
+    cstr = long_buf.c_str();
+  }
+  char *end = nullptr;
+  int saved_errno = errno;
+  errno = 0;
+  rtn = std::strtod(cstr, &end);
+  bool ok = (errno != ERANGE) && (end == (cstr + len));
+  errno = saved_errno;
+  return ok;
+#endif
+}
+
+} // namespace detail
+
+// Decodes the whole of [first, last) as a fhicl number without allocating.
+//
+// Recognises decimal integers with an optional sign, unsigned hexadecimal
+// (0x...) and binary (0b...) integer constants, and decimal floating point
+// numbers with an optional exponent in either case. Integers that do not fit
+// in an int64_t are decoded as floating point if they are decimal. Anything
+// else, including surrounding whitespace, is kNotANumber and should be handled
+// by str2T.
+inline number_kind parse_number(char const *first, char const *last,
+                                int64_t &i, double &d) {
+  if (first == last) {
+    return number_kind::kNotANumber;
+  }
+  uint64_t const i64max = uint64_t(std::numeric_limits<int64_t>::max());
+  if (((last - first) > 2) && (first[0] == '0')) {
+    uint64_t base = 0;
+    if ((first[1] == 'x') || (first[1] == 'X')) {
+      base = 16;
+    } else if ((first[1] == 'b') || (first[1] == 'B')) {
+      base = 2;
+    }
+    if (base) {
+      uint64_t u;
+      if (!detail::accumulate_digits(first + 2, last, base, i64max, u)) {
+        return number_kind::kNotANumber;
+      }
+      i = int64_t(u);
+      return number_kind::kInteger;
+    }
+  }
+
+  char const *digits = first;
+  bool isneg = false;
+  if ((*digits == '+') || (*digits == '-')) {
+    isneg = (*digits == '-');
+    ++digits;
+  }
+  uint64_t u;
+  if (detail::accumulate_digits(digits, last, 10, i64max + (isneg ? 1 : 0),
+                                u)) {
+    i = isneg ? ((u == (i64max + 1)) ? std::numeric_limits<int64_t>::min()
+                                     : -int64_t(u))
+              : int64_t(u);
+    return number_kind::kInteger;
+  }
+
+  if (!detail::is_decimal_float(first, last)) {
+    return number_kind::kNotANumber;
+  }
+  return detail::decimal_to_double(first, last, d) ? number_kind::kFloat
+                                                   : number_kind::kNotANumber;
+}
+
+// Decodes the spellings of true and false accepted by str2T<bool>, other than
+// "1" and "0" which parse_number already decodes as integers.
+inline bool parse_bool_literal(char const *first, char const *last,
+                               bool &rtn) {
+  std::string::size_type const len = std::string::size_type(last - first);
+  static char const *const trues[] = {"true", "True", "TRUE"};
+  static char const *const falses[] = {"false", "False", "FALSE"};
+  if (len == 4) {
+    for (char const *t : trues) {
+      if (std::equal(first, last, t)) {
+        rtn = true;
+        return true;
+      }
+    }
+  } else if (len == 5) {
+    for (char const *f : falses) {
+      if (std::equal(first, last, f)) {
+        rtn = false;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+} // namespace string_parsers
+} // namespace fhicl
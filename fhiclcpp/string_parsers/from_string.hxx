@@ -48,7 +48,8 @@ inline
             continue;
           }
           rtn = rtn << 1;
-        } else if (cpy[ptr] == '0') {
+        } else if (cpy[ptr] == '1') {
+          leadingZeros = false;
           rtn = rtn << 1;
           rtn += 1;
         } else {
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "fhiclcpp/string_parsers/exception.hxx"
+#include "fhiclcpp/string_parsers/from_chars.hxx"
 #include "fhiclcpp/string_parsers/from_string.hxx"
 #include "fhiclcpp/string_parsers/to_string.hxx"
 #include "fhiclcpp/string_parsers/utility.hxx"
@@ -60,7 +61,10 @@ int main() {
     long test_l = str2T<long>("5555555555555");
     operator_assert(test_l, ==, 5555555555555l);
 
-    std::cout << "[PASSED] 5/5 int parsing tests." << std::endl;
+    int test_b = str2T<int>("0b00101");
+    operator_assert(test_b, ==, 5);
+
+    std::cout << "[PASSED] 6/6 int parsing tests." << std::endl;
 
     bool test_true = str2T<bool>("true");
     assert((test_true == true));
@@ -108,6 +112,31 @@ int main() {
 
     std::cout << "[PASSED] 10/10 double parsing tests." << std::endl;
   }
+  {
+    auto kind_of = [](std::string const &str, int64_t &i, double &d) {
+      return parse_number(str.data(), str.data() + str.size(), i, d);
+    };
+    int64_t i;
+    double d;
+    assert((kind_of("-5", i, d) == number_kind::kInteger) && (i == -5));
+    assert((kind_of("0xdeadb33f", i, d) == number_kind::kInteger) &&
+           (i == 0xdeadb33f));
+    assert((kind_of("0b1101", i, d) == number_kind::kInteger) && (i == 13));
+    assert((kind_of("-9223372036854775808", i, d) == number_kind::kInteger) &&
+           (i == std::numeric_limits<int64_t>::min()));
+    assert((kind_of("18446744073709551616", i, d) == number_kind::kFloat) &&
+           (d == 18446744073709551616.0));
+    assert((kind_of("-123.456E-5", i, d) == number_kind::kFloat) &&
+           (d == -123.456E-5));
+    assert((kind_of("5e5", i, d) == number_kind::kFloat) && (d == 5E5));
+    assert((kind_of(".5", i, d) == number_kind::kFloat) && (d == 0.5));
+    assert(kind_of("1E", i, d) == number_kind::kNotANumber);
+    assert(kind_of(" 5", i, d) == number_kind::kNotANumber);
+    assert(kind_of("0x", i, d) == number_kind::kNotANumber);
+    assert(kind_of("nan", i, d) == number_kind::kNotANumber);
+    assert(kind_of("1.0e999", i, d) == number_kind::kNotANumber);
+    std::cout << "[PASSED] 13/13 parse_number tests." << std::endl;
+  }
   {
     std::string test_str = str2T<std::string>("bla");
     assert((test_str == "bla"));
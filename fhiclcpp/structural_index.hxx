@@ -0,0 +1,269 @@
+#pragma once
+
+#include "linedoc/doc.hxx"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace fhicl {
+
+// A single-pass index of every character that carries structure in a fhicl
+// document: brackets, quotes, separators and comment starts. Positions are
+// stored in document order, bucketed by line, so that 'next occurrence of c'
+// queries are a short binary search within one line and bracket/quote matches
+// are precomputed.
+//
+// The precomputed matches reproduce the semantics of the scanning
+// find_matching_bracket exactly: '{' and '[' skip nested brackets of their own
+// kind and double-quoted strings, '\'' skips double-quoted strings and '"'
+// matches the next '"'. A match is only recorded for openers that are at
+// 'top level' of the corresponding automaton when the document is scanned from
+// the beginning; anything else is left to the scanning implementation.
+class structural_index {
+public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  static size_t slot(char c) {
+    switch (c) {
+    case '{': {
+      return 0;
+    }
+    case '}': {
+      return 1;
+    }
+    case '[': {
+      return 2;
+    }
+    case ']': {
+      return 3;
+    }
+    case '\"': {
+      return 4;
+    }
+    case '\'': {
+      return 5;
+    }
+    case ',': {
+      return 6;
+    }
+    case ':': {
+      return 7;
+    }
+    case '#': {
+      return 8;
+    }
+    case '/': {
+      return 9;
+    }
+    default: { return npos; }
+    }
+  }
+  static bool is_indexed(char c) { return slot(c) != npos; }
+
+  structural_index() : n_lines(0) {}
+  explicit structural_index(linedoc::doc const &doc) : n_lines(doc.size()) {
+    for (size_t s = 0; s < kNSlots; ++s) {
+      line_begin[s].reserve(n_lines + 1);
+    }
+
+    automata_state st;
+    for (size_t l = 0; l < n_lines; ++l) {
+      for (size_t s = 0; s < kNSlots; ++s) {
+        line_begin[s].push_back(positions[s].size());
+      }
+      std::string const &line = doc.at(l).characters;
+      scan_line(line.data(), line.size(), [&](size_t c) {
+        add(linedoc::doc_line_point{l, c}, line[c], st);
+      });
+    }
+    for (size_t s = 0; s < kNSlots; ++s) {
+      line_begin[s].push_back(positions[s].size());
+    }
+  }
+
+  // Returns the first occurrence of the indexed character c in [from, to), or
+  // linedoc::doc_line_point::end() if there is none. Equivalent to
+  // linedoc::doc::find_first_of(c, from, to) for indexed characters.
+  linedoc::doc_line_point
+  find_first_of(char c, linedoc::doc_line_point from,
+                linedoc::doc_line_point to =
+                    linedoc::doc_line_point::end()) const {
+    size_t s = slot(c);
+    if ((s == npos) || (from.line_no >= n_lines)) {
+      return linedoc::doc_line_point::end();
+    }
+    std::vector<linedoc::doc_line_point> const &pos = positions[s];
+    size_t idx = lower_bound(s, from);
+    if (idx == pos.size()) {
+      return linedoc::doc_line_point::end();
+    }
+    if (!is_before(pos[idx], to)) {
+      return linedoc::doc_line_point::end();
+    }
+    return pos[idx];
+  }
+
+  // Returns the precomputed match for the opener at begin, or
+  // linedoc::doc_line_point::end() if none was recorded, in which case the
+  // caller should fall back to scanning.
+  linedoc::doc_line_point
+  find_matching_bracket(char open_bracket, char close_bracket,
+                        linedoc::doc_line_point begin) const {
+    size_t s = slot(open_bracket);
+    if ((s == npos) || (begin.line_no >= n_lines)) {
+      return linedoc::doc_line_point::end();
+    }
+    size_t idx = lower_bound(s, begin);
+    std::vector<linedoc::doc_line_point> const &pos = positions[s];
+    if ((idx == pos.size()) || (pos[idx].line_no != begin.line_no) ||
+        (pos[idx].character != begin.character)) {
+      return linedoc::doc_line_point::end();
+    }
+    if ((open_bracket == '{') && (close_bracket == '}')) {
+      return matches[kBrace][idx];
+    } else if ((open_bracket == '[') && (close_bracket == ']')) {
+      return matches[kSquare][idx];
+    } else if ((open_bracket == '\'') && (close_bracket == '\'')) {
+      return matches[kSingle][idx];
+    } else if ((open_bracket == '\"') && (close_bracket == '\"')) {
+      return ((idx + 1) < pos.size()) ? pos[idx + 1]
+                                      : linedoc::doc_line_point::end();
+    }
+    return linedoc::doc_line_point::end();
+  }
+
+  size_t count(char c) const {
+    size_t s = slot(c);
+    return (s == npos) ? 0 : positions[s].size();
+  }
+
+private:
+  static constexpr size_t kNSlots = 10;
+  enum match_kind { kBrace = 0, kSquare, kSingle, kNMatchKinds };
+
+  struct automata_state {
+    bool in_double_quote = false;
+    std::vector<size_t> brace_stack;
+    std::vector<size_t> square_stack;
+    size_t single_quote_open = npos;
+  };
+
+  size_t n_lines;
+  std::vector<linedoc::doc_line_point> positions[kNSlots];
+  std::vector<size_t> line_begin[kNSlots];
+  std::vector<linedoc::doc_line_point> matches[kNMatchKinds];
+
+  static bool is_before(linedoc::doc_line_point const &p,
+                        linedoc::doc_line_point const &to) {
+    return (p.line_no < to.line_no) ||
+           ((p.line_no == to.line_no) && (p.character < to.character));
+  }
+
+  size_t lower_bound(size_t s, linedoc::doc_line_point const &from) const {
+    std::vector<linedoc::doc_line_point> const &pos = positions[s];
+    auto b = pos.begin() + line_begin[s][from.line_no];
+    auto e = pos.begin() + line_begin[s][from.line_no + 1];
+    auto it = std::lower_bound(b, e, from.character,
+                               [](linedoc::doc_line_point const &p, size_t c) {
+                                 return p.character < c;
+                               });
+    return size_t(std::distance(pos.begin(), it));
+  }
+
+  void add(linedoc::doc_line_point p, char c, automata_state &st) {
+    size_t s = slot(c);
+    size_t idx = positions[s].size();
+    positions[s].push_back(p);
+    switch (c) {
+    case '{': {
+      matches[kBrace].push_back(linedoc::doc_line_point::end());
+      if (!st.in_double_quote) {
+        st.brace_stack.push_back(idx);
+      }
+      break;
+    }
+    case '}': {
+      if (!st.in_double_quote && st.brace_stack.size()) {
+        matches[kBrace][st.brace_stack.back()] = p;
+        st.brace_stack.pop_back();
+      }
+      break;
+    }
+    case '[': {
+      matches[kSquare].push_back(linedoc::doc_line_point::end());
+      if (!st.in_double_quote) {
+        st.square_stack.push_back(idx);
+      }
+      break;
+    }
+    case ']': {
+      if (!st.in_double_quote && st.square_stack.size()) {
+        matches[kSquare][st.square_stack.back()] = p;
+        st.square_stack.pop_back();
+      }
+      break;
+    }
+    case '\'': {
+      matches[kSingle].push_back(linedoc::doc_line_point::end());
+      if (!st.in_double_quote) {
+        if (st.single_quote_open == npos) {
+          st.single_quote_open = idx;
+        } else {
+          matches[kSingle][st.single_quote_open] = p;
+          st.single_quote_open = npos;
+        }
+      }
+      break;
+    }
+    case '\"': {
+      st.in_double_quote = !st.in_double_quote;
+      break;
+    }
+    default: {
+    }
+    }
+  }
+
+  // Calls f(offset) for every structural character in str[0, len), in order.
+  template <typename F>
+  static void scan_line(char const *str, size_t len, F const &f) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    static char const set[kNSlots] = {'{', '}', '[',  ']', '\"',
+                                      '\'', ',', ':', '#', '/'};
+    __m128i needles[kNSlots];
+    for (size_t s = 0; s < kNSlots; ++s) {
+      needles[s] = _mm_set1_epi8(set[s]);
+    }
+    for (; (i + 16) <= len; i += 16) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<__m128i const *>(str + i));
+      __m128i hits = _mm_setzero_si128();
+      for (size_t s = 0; s < kNSlots; ++s) {
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[s]));
+      }
+      unsigned mask = unsigned(_mm_movemask_epi8(hits));
+      while (mask) {
+        unsigned bit = unsigned(__builtin_ctz(mask));
+        f(i + bit);
+        mask &= mask - 1;
+      }
+    }
+#endif
+    for (; i < len; ++i) {
+      if (is_indexed(str[i])) {
+        f(i);
+      }
+    }
+  }
+};
+
+} // namespace fhicl
@@ -1,8 +1,23 @@
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "fhiclcpp/exception.hxx"
 #include "fhiclcpp/ParameterSet.h"
+#include "fhiclcpp/config_watcher.hxx"
+#include "fhiclcpp/snapshot.hxx"
+
+#ifdef FHICLCPP_TEST_EMBEDDED
+#include "example_config.hxx"
+#endif
 
 using namespace fhicl;
 using namespace linedoc;
@@ -65,6 +80,55 @@ int main() {
     assert_are_equiv(test_doc, match_2, (doc_line_point{3, 19}));
     std::cout << "[PASSED]: 2/2 find_matching_bracket tests" << std::endl;
   }
+  {
+    fhicl_doc idx_doc;
+    idx_doc.push_back("a: { b: \"}{\" c: [1, '[', \"]\"] d: {e: [[f], g]} }");
+    idx_doc.push_back("h: [ 'i\"', \"j'\" ]");
+
+    size_t nchecked = 0;
+    for (size_t l = 0; l < idx_doc.n_lines(); ++l) {
+      std::string const &line = idx_doc.at(l).characters;
+      for (size_t c = 0; c < line.size(); ++c) {
+        char close = '\0';
+        switch (line[c]) {
+        case '{': {
+          close = '}';
+          break;
+        }
+        case '[': {
+          close = ']';
+          break;
+        }
+        case '\"':
+        case '\'': {
+          close = line[c];
+          break;
+        }
+        default: { continue; }
+        }
+        doc_line_point from{l, c};
+        doc_line_point indexed =
+            idx_doc.index().find_matching_bracket(line[c], close, from);
+        if (idx_doc.is_end(indexed)) {
+          continue;
+        }
+        assert_are_equiv(
+            idx_doc, indexed,
+            find_matching_bracket_scan(idx_doc, line[c], close, from));
+        nchecked++;
+      }
+    }
+    assert(nchecked > 0);
+    assert_are_equiv(idx_doc, idx_doc.find_first_of_indexed(',', {0, 0}),
+                     idx_doc.find_first_of(',', {0, 0}));
+    assert_are_equiv(idx_doc, idx_doc.find_first_of_indexed(',', {0, 22}),
+                     idx_doc.find_first_of(',', {0, 22}));
+    assert(idx_doc.is_end(idx_doc.find_first_of_indexed('#', {0, 0})));
+
+    idx_doc.push_back("# bla");
+    assert(!idx_doc.is_end(idx_doc.find_first_of_indexed('#', {0, 0})));
+    std::cout << "[PASSED]: 5/5 structural_index tests" << std::endl;
+  }
   {
     bool threw = false;
     try {
@@ -87,6 +151,86 @@ int main() {
     assert(!threw);
     std::cout << "[PASSED]: 1/1 multi-include (non-loop) tests" << std::endl;
   }
+  {
+    fhicl_doc doc = read_doc("fhiclcpp-simple.multi-include.fcl");
+    doc.resolve_includes();
+    fhicl_doc resolved = read_resolved_doc("fhiclcpp-simple.multi-include.fcl");
+    operator_assert(resolved.size(), ==, doc.size());
+    for (size_t l = 0; l < doc.size(); ++l) {
+      operator_assert(resolved.at(l).characters, ==, doc.at(l).characters);
+      operator_assert(resolved.get_line_info(doc_line_point{l, 0}), ==,
+                      doc.get_line_info(doc_line_point{l, 0}));
+    }
+
+    // Modifying an included file invalidates the cached includer
+    std::ofstream("./fhiclcpp-simple.cache.top.fcl")
+        << "#include \"./fhiclcpp-simple.cache.inc.fcl\"\nb: 2\n";
+    std::ofstream("./fhiclcpp-simple.cache.inc.fcl") << "a: 1\n";
+    ParameterSet ps = make_ParameterSet("./fhiclcpp-simple.cache.top.fcl");
+    operator_assert(ps.get<int>("a"), ==, 1);
+    std::ofstream("./fhiclcpp-simple.cache.inc.fcl") << "a: 10\n";
+    ps = make_ParameterSet("./fhiclcpp-simple.cache.top.fcl");
+    operator_assert(ps.get<int>("a"), ==, 10);
+    operator_assert(ps.get<int>("b"), ==, 2);
+    std::remove("./fhiclcpp-simple.cache.top.fcl");
+    std::remove("./fhiclcpp-simple.cache.inc.fcl");
+    std::cout << "[PASSED]: 4/4 include cache tests" << std::endl;
+  }
+  {
+    mkdir("./fhiclcpp-simple.index.a", 0755);
+    mkdir("./fhiclcpp-simple.index.b", 0755);
+    std::string search_path =
+        "./fhiclcpp-simple.index.a:./fhiclcpp-simple.index.b";
+    std::ofstream("./fhiclcpp-simple.index.b/x.fcl") << "a: 1\n";
+    fhicl_file_path_index &index = fhicl_file_path_index::instance();
+    parse_stats stats;
+    operator_assert(index.resolve(search_path, "x.fcl", &stats), ==,
+                    "./fhiclcpp-simple.index.b/x.fcl");
+    operator_assert(stats.directories_scanned, ==, 2);
+
+    // A repeated miss does not read the directories again
+    operator_assert(index.resolve(search_path, "y.fcl", &stats), ==, "");
+    operator_assert(index.resolve(search_path, "y.fcl", &stats), ==, "");
+    operator_assert(stats.directories_scanned, ==, 2);
+
+    // A file created in an earlier directory wins. The directory's mtime is
+    // set well into the past, so that the change is seen however coarse the
+    // filesystem's timestamps are.
+    std::ofstream("./fhiclcpp-simple.index.a/x.fcl") << "a: 2\n";
+    struct timespec past[2] = {{1000000000, 0}, {1000000000, 0}};
+    operator_assert(
+        utimensat(AT_FDCWD, "./fhiclcpp-simple.index.a", past, 0), ==, 0);
+    operator_assert(index.resolve(search_path, "x.fcl", &stats), ==,
+                    "./fhiclcpp-simple.index.a/x.fcl");
+    operator_assert(stats.directories_scanned, ==, 4);
+
+    std::remove("./fhiclcpp-simple.index.a/x.fcl");
+    std::remove("./fhiclcpp-simple.index.b/x.fcl");
+    std::remove("./fhiclcpp-simple.index.a");
+    std::remove("./fhiclcpp-simple.index.b");
+    std::cout << "[PASSED]: 6/6 FHICL_FILE_PATH index tests" << std::endl;
+  }
+  {
+    std::vector<std::string> contents{"", "\n", "  a: 1 \r\n\n\tb: 2",
+                                      "a: 1\nb: [1,\n 2]\n"};
+    for (std::string const &content : contents) {
+      std::ofstream("./fhiclcpp-simple.mapped.fcl") << content;
+      std::vector<std::string> expected;
+      std::stringstream ss(content);
+      std::string line;
+      while (std::getline(ss, line)) {
+        string_parsers::trim(line);
+        expected.push_back(line);
+      }
+      fhicl_doc doc = read_doc("./fhiclcpp-simple.mapped.fcl");
+      operator_assert(doc.size(), ==, expected.size());
+      for (size_t l = 0; l < doc.size(); ++l) {
+        operator_assert(doc.at(l).characters, ==, expected[l]);
+      }
+    }
+    std::remove("./fhiclcpp-simple.mapped.fcl");
+    std::cout << "[PASSED]: 4/4 mapped file line splitting tests" << std::endl;
+  }
   {
     doc_line_point begin{0, 0};
     doc_line_point eol{0, std::string::npos};
@@ -299,4 +443,426 @@ int main() {
       std::cout << i.to_string() << std::endl;
     }
   }
+  {
+    fhicl_doc ctx_doc;
+    ctx_doc.push_back("outer: {");
+    ctx_doc.push_back("  a: 1");
+    ctx_doc.push_back("  inner: {b: @local::outer.a c: {d: @local::outer.a}}");
+    ctx_doc.push_back("}");
+    ParameterSet ps = parse_fhicl_document(ctx_doc);
+    operator_assert(ps.get<int>("outer.inner.b"), ==, 1);
+    operator_assert(ps.get<int>("outer.inner.c.d"), ==, 1);
+
+    bool threw = false;
+    try {
+      fhicl_doc redef_doc;
+      redef_doc.push_back("a: {b: 1}");
+      redef_doc.push_back("a: {c: 2}");
+      parse_fhicl_document(redef_doc);
+    } catch (cant_insert &e) {
+      threw = true;
+    }
+    assert(threw);
+    std::cout << "[PASSED]: 2/2 nested table parse context tests" << std::endl;
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("BEGIN_PROLOG");
+    doc.push_back("p: {a: 1}");
+    doc.push_back("END_PROLOG");
+    doc.push_back("t: @local::p");
+    doc.push_back("t.b: [1, {c: 2}]");
+    ParameterSet tracked = parse_fhicl_document(doc);
+    ParameterSet untracked = parse_fhicl_document(doc, parse_options{false});
+    operator_assert(untracked.to_string(), ==, tracked.to_string());
+    assert(tracked.history_to_string().size());
+    assert(!untracked.history_to_string().size());
+    assert(!untracked.get<ParameterSet>("t").history_to_string().size());
+    std::cout << "[PASSED]: 3/3 parse without history tests" << std::endl;
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("a: 1 b: [1, 2, 3] c: [1.5, 2e3] d: \"str\"");
+    doc.push_back("f: {g: [{h: true}, [x, 2]] i: {j: -7}}");
+    ParameterSet ps = parse_fhicl_document(doc);
+    snapshot::write(ps, "./fhiclcpp-simple.snapshot.bin");
+    snapshot snap("./fhiclcpp-simple.snapshot.bin");
+    operator_assert(snap.id(), ==, ps.id());
+    operator_assert(snap.to_ParameterSet().to_string(), ==, ps.to_string());
+    operator_assert(snap.to_ParameterSet().id(), ==, ps.id());
+    operator_assert(snap.get<int>("a"), ==, 1);
+    operator_assert(snap.get<std::vector<double>>("c")[1], ==, 2e3);
+    operator_assert(snap.get<std::string>("d"), ==, "str");
+    operator_assert(snap.get<std::string>("b[2]"), ==, "3");
+    operator_assert(snap.get<int>("f.i.j"), ==, -7);
+    assert(snap.get<bool>("f.g[0].h"));
+    operator_assert(
+        snap.get_table("f").get<std::vector<std::string>>("g[1]")[0], ==, "x");
+    operator_assert(snap.get<ParameterSet>("f").to_string(), ==,
+                    ps.get<ParameterSet>("f").to_string());
+    operator_assert(snap.get<int>("z", 5), ==, 5);
+    assert(!snap.has_key("f.i.k"));
+
+    bool threw = false;
+    try {
+      snap.get<int>("z");
+    } catch (nonexistant_key &e) {
+      threw = true;
+    }
+    assert(threw);
+    threw = false;
+    try {
+      snap.get<int>("a.b");
+    } catch (wrong_fhicl_category &e) {
+      threw = true;
+    }
+    assert(threw);
+    threw = false;
+    try {
+      std::ofstream("./fhiclcpp-simple.snapshot.bin") << "a: 1\n";
+      snapshot bad("./fhiclcpp-simple.snapshot.bin");
+    } catch (malformed_snapshot &e) {
+      threw = true;
+    }
+    assert(threw);
+    std::remove("./fhiclcpp-simple.snapshot.bin");
+    std::cout << "[PASSED]: 16/16 snapshot tests" << std::endl;
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("a: 1 b: {c: [1, 2] d: \"str\"}");
+    ParameterSet ps = parse_fhicl_document(doc);
+    std::string bytes = snapshot::serialize(ps);
+    snapshot snap(bytes.data(), bytes.size());
+    operator_assert(snap.id(), ==, ps.id());
+    operator_assert(snap.get<int>("b.c[1]"), ==, 2);
+    operator_assert(snap.get_table("b").get<std::string>("d"), ==, "str");
+
+    ParameterSet overridden = snap.to_ParameterSet();
+    overridden.put_or_replace("a", 2);
+    operator_assert(overridden.get<int>("a"), ==, 2);
+    operator_assert(snap.get<int>("a"), ==, 1);
+
+    bool threw = false;
+    try {
+      snapshot bad(bytes.data(), bytes.size() / 2);
+    } catch (malformed_snapshot &e) {
+      threw = true;
+    }
+    assert(threw);
+#ifdef FHICLCPP_TEST_EMBEDDED
+    ParameterSet example =
+        make_ParameterSet("fhiclcpp-simple.example.fcl", parse_options{false});
+    snapshot const &embedded = fhicl::embedded::example_config();
+    operator_assert(fhicl::embedded::example_config_id, ==, example.id());
+    operator_assert(embedded.id(), ==, example.id());
+    operator_assert(embedded.to_ParameterSet().to_string(), ==,
+                    example.to_string());
+    std::cout << "[PASSED]: 9/9 in memory and embedded snapshot tests"
+              << std::endl;
+#else
+    std::cout << "[PASSED]: 6/6 in memory snapshot tests" << std::endl;
+#endif
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("BEGIN_PROLOG");
+    doc.push_back("p: {a: 1 b: {c: [1, 2]}}");
+    doc.push_back("END_PROLOG");
+    for (size_t i = 0; i < 20; ++i) {
+      doc.push_back("m" + std::to_string(i) + ": {");
+      doc.push_back("  x: " + std::to_string(i) + " y: \"s\" // comment");
+      doc.push_back("  z: {w: [{v: 1}, 2]}");
+      doc.push_back((i % 3) ? "}" : "  r: @local::p.b }");
+    }
+    doc.push_back("m1.x: 10");
+    doc.push_back("t: {@table::p d: {e: 3}}");
+    parse_options serial_opts;
+    parse_options parallel_opts;
+    parallel_opts.threads = 4;
+    ParameterSet serial = parse_fhicl_document(doc, serial_opts);
+    ParameterSet parallel = parse_fhicl_document(doc, parallel_opts);
+    operator_assert(parallel.to_string(), ==, serial.to_string());
+    operator_assert(parallel.history_to_string(), ==,
+                    serial.history_to_string());
+    operator_assert(parallel.get<ParameterSet>("m5").history_to_string(), ==,
+                    serial.get<ParameterSet>("m5").history_to_string());
+    operator_assert(parallel.id(), ==, serial.id());
+
+    std::vector<std::string> errors;
+    for (parse_options const &opts : {serial_opts, parallel_opts}) {
+      fhicl_doc bad_doc = doc;
+      bad_doc.push_back("n: {a: 1}");
+      bad_doc.push_back("n: {a: [1, 2}");
+      try {
+        parse_fhicl_document(bad_doc, opts);
+      } catch (fhicl_cpp_simple_except &e) {
+        errors.push_back(e.what());
+      }
+    }
+    operator_assert(errors.size(), ==, 2);
+    operator_assert(errors[1], ==, errors[0]);
+    std::cout << "[PASSED]: 6/6 parallel parse tests" << std::endl;
+  }
+  {
+    std::ofstream("./fhiclcpp-simple.stats.top.fcl")
+        << "#include \"./fhiclcpp-simple.stats.inc.fcl\"\nb: @local::a\n"
+           "c: [1, 2, 3]\n";
+    std::ofstream("./fhiclcpp-simple.stats.inc.fcl") << "a: {x: 1 y: [1, 2]}\n";
+    parse_stats stats;
+    ParameterSet ps =
+        make_ParameterSet("./fhiclcpp-simple.stats.top.fcl", stats);
+    operator_assert(stats.files_opened, ==, 2);
+    operator_assert(stats.includes, ==, 1);
+    operator_assert(stats.lines, ==, 3);
+    operator_assert(stats.references_resolved, ==, 1);
+    operator_assert(stats.copies, ==, 1);
+    operator_assert(stats.nodes_created, ==, 10);
+    parse_stats::file_stats const &inc =
+        stats.files.at("./fhiclcpp-simple.stats.inc.fcl");
+    operator_assert(inc.times_included, ==, 1);
+    operator_assert(inc.bytes, ==, 20);
+    operator_assert(inc.nodes, ==, 5);
+    operator_assert(stats.files.at("./fhiclcpp-simple.stats.top.fcl").nodes, ==,
+                    5);
+
+    // Parsed again from the include cache, and on worker threads.
+    parse_options parallel_opts;
+    parallel_opts.threads = 4;
+    ParameterSet parallel =
+        make_ParameterSet("./fhiclcpp-simple.stats.top.fcl", stats,
+                          parallel_opts);
+    operator_assert(parallel.to_string(), ==, ps.to_string());
+    operator_assert(stats.files_opened, ==, 0);
+    operator_assert(stats.file_cache_hits, ==, 2);
+    operator_assert(stats.nodes_created, ==, 10);
+    operator_assert(stats.files.at("./fhiclcpp-simple.stats.inc.fcl").nodes,
+                    ==, 5);
+    std::remove("./fhiclcpp-simple.stats.top.fcl");
+    std::remove("./fhiclcpp-simple.stats.inc.fcl");
+    std::cout << "[PASSED]: 15/15 parse stats tests" << std::endl;
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("BEGIN_PROLOG");
+    doc.push_back("p: {a: 1}");
+    doc.push_back("END_PROLOG");
+    doc.push_back("m: {x: 1 y: {z: [1, {w: 2}]}}");
+    doc.push_back("r: {q: @local::p}");
+    doc.push_back("m.x: 2");
+    parse_options lazy_opts;
+    lazy_opts.lazy = true;
+    ParameterSet eager = parse_fhicl_document(doc);
+    ParameterSet lazy = parse_fhicl_document(doc, lazy_opts);
+    ParameterSet y = lazy.get<ParameterSet>("m.y");
+    operator_assert(y.is_materialized(), ==, false);
+    operator_assert(y.get<int>("z[1].w"), ==, 2);
+    operator_assert(y.is_materialized(), ==, true);
+    operator_assert(lazy.to_string(), ==, eager.to_string());
+    operator_assert(lazy.history_to_string(), ==, eager.history_to_string());
+    operator_assert(lazy.id(), ==, eager.id());
+
+    // A mistake in a deferred table is reported when it is first read.
+    doc.push_back("n: {x 1}");
+    ParameterSet bad = parse_fhicl_document(doc, lazy_opts);
+    operator_assert(bad.get<int>("m.x"), ==, 2);
+    std::vector<std::string> errors;
+    try {
+      bad.validate_all();
+    } catch (fhicl_cpp_simple_except &e) {
+      errors.push_back(e.what());
+    }
+    try {
+      parse_fhicl_document(doc);
+    } catch (fhicl_cpp_simple_except &e) {
+      errors.push_back(e.what());
+    }
+    operator_assert(errors.size(), ==, 2);
+    operator_assert(errors[0], ==, errors[1]);
+    std::cout << "[PASSED]: 9/9 lazy parse tests" << std::endl;
+  }
+  {
+    parse_options lazy_opts;
+    lazy_opts.lazy = true;
+    // Errors are reported as by an eager parse: those in the PROLOG when
+    // parsing, as nothing may read it later, and the rest by validate_all in
+    // document order rather than key order.
+    std::vector<std::vector<std::string>> docs{
+        {"BEGIN_PROLOG",
+         "p1: { a1: [[abc], @nil, { b1: +4 b: [] }, 1] }", "END_PROLOG",
+         "x: 1"},
+        {"x: 1", "z: {y: {w 3}}", "a: {v 2}"}};
+    for (std::vector<std::string> const &lines : docs) {
+      fhicl_doc doc;
+      for (std::string const &line : lines) {
+        doc.push_back(line);
+      }
+      std::vector<std::string> errors;
+      try {
+        parse_fhicl_document(doc);
+      } catch (fhicl_cpp_simple_except &e) {
+        errors.push_back(e.what());
+      }
+      try {
+        parse_fhicl_document(doc, lazy_opts).validate_all();
+      } catch (fhicl_cpp_simple_except &e) {
+        errors.push_back(e.what());
+      }
+      operator_assert(errors.size(), ==, 2);
+      operator_assert(errors[0], ==, errors[1]);
+    }
+
+    // A table that fails to parse stays pending, every later use of it, on
+    // any thread, throws again.
+    fhicl_doc doc;
+    doc.push_back("n: {x 1}");
+    ParameterSet bad = parse_fhicl_document(doc, lazy_opts);
+    std::atomic<size_t> n_threw(0);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < 4; ++t) {
+      readers.emplace_back([&] {
+        for (size_t i = 0; i < 2; ++i) {
+          try {
+            bad.get<int>("n.x");
+          } catch (fhicl_cpp_simple_except &e) {
+            n_threw++;
+          }
+        }
+      });
+    }
+    for (std::thread &t : readers) {
+      t.join();
+    }
+    size_t threw = n_threw;
+    operator_assert(threw, ==, 8);
+    std::cout << "[PASSED]: 5/5 lazy parse error tests" << std::endl;
+  }
+  {
+    fhicl_doc doc;
+    doc.push_back("BEGIN_PROLOG");
+    doc.push_back("p: {a: 1 b: \"str\"}");
+    doc.push_back("END_PROLOG");
+    doc.push_back("m: {x: 1 y: [1, 1, {z: \"str\"}] q: @local::p}");
+    doc.push_back("n: {x: 1 y: \"str\"}");
+    parse_options arena_opts;
+    arena_opts.arena = true;
+    parse_stats stats;
+    ParameterSet eager = parse_fhicl_document(doc);
+    ParameterSet arena = parse_fhicl_document(doc, arena_opts, &stats);
+    operator_assert(arena.to_string(), ==, eager.to_string());
+    operator_assert(arena.history_to_string(), ==, eager.history_to_string());
+    operator_assert(arena.id(), ==, eager.id());
+    operator_assert(stats.atoms_shared, >, 0);
+    // Interned atoms are counted once.
+    operator_assert(arena.memory_usage().shared, >,
+                    eager.memory_usage().shared);
+    std::cout << "[PASSED]: 5/5 arena parse tests" << std::endl;
+  }
+  {
+    fhicl_doc v1, v2;
+    v1.push_back("s: {a: {v: 1} b: {v: [1, 2]}}");
+    v2.push_back("s: {a: {v: 2} b: {v: [1, 2]}}");
+    for (fhicl_doc *doc : {&v1, &v2}) {
+      doc->push_back("t: {w: 1}");
+      doc->push_back("r: {q: @local::t}");
+      doc->push_back("s.a.v: 3");
+    }
+
+    table_body_cache cache;
+    size_t reused[4];
+    fhicl_doc const *docs[4] = {&v1, &v2, &v2, &v1};
+    for (size_t i = 0; i < 4; ++i) {
+      parse_stats stats;
+      ParameterSet ps =
+          parse_fhicl_document(*docs[i], parse_options(), &stats, &cache);
+      ParameterSet fresh = parse_fhicl_document(*docs[i]);
+      operator_assert(ps.to_string(), ==, fresh.to_string());
+      operator_assert(ps.history_to_string(), ==, fresh.history_to_string());
+      reused[i] = stats.tables_reused;
+    }
+    // s.b and t are unchanged, r has a reference so is always parsed.
+    operator_assert(reused[0], ==, 0);
+    operator_assert(reused[1], ==, 2);
+    // s as a whole, and then s.b again, as it is kept along with s.
+    operator_assert(reused[2], ==, 2);
+    operator_assert(reused[3], ==, 2);
+    std::cout << "[PASSED]: 6/6 table body cache tests" << std::endl;
+  }
+  {
+    std::ofstream("./fhiclcpp-simple.watch.top.fcl")
+        << "#include \"./fhiclcpp-simple.watch.inc.fcl\"\n"
+           "b: {x: 1 y: [1, 2, 3]}\nc: @local::a\n";
+    std::ofstream("./fhiclcpp-simple.watch.inc.fcl") << "a: {v: 1}\n";
+    config_watcher watcher("./fhiclcpp-simple.watch.top.fcl");
+    std::shared_ptr<ParameterSet const> first = watcher.current();
+    operator_assert(first->get<int>("c.v"), ==, 1);
+    include_graph graph = watcher.includes();
+    operator_assert(graph.files.size(), ==, 2);
+    operator_assert(
+        graph.affected_by("./fhiclcpp-simple.watch.inc.fcl").size(), ==, 2);
+    bool reloaded = watcher.reload_if_changed();
+    operator_assert(reloaded, ==, false);
+
+    std::vector<std::string> notified;
+    watcher.subscribe([&](std::shared_ptr<ParameterSet const> const &,
+                          std::vector<std::string> const &changed) {
+      notified = changed;
+    });
+    // The edit reaches c through @local, b is untouched and kept.
+    std::ofstream("./fhiclcpp-simple.watch.inc.fcl") << "a: {v: 2}\n";
+    reloaded = watcher.reload_if_changed({"./fhiclcpp-simple.watch.inc.fcl"});
+    operator_assert(reloaded, ==, true);
+    std::shared_ptr<ParameterSet const> second = watcher.current();
+    operator_assert(second->get<int>("c.v"), ==, 2);
+    operator_assert(first->get<int>("c.v"), ==, 1);
+    operator_assert(notified.size(), ==, 2);
+    operator_assert(notified[0], ==, "a.v");
+    operator_assert(notified[1], ==, "c.v");
+    operator_assert(second->get_span<int64_t>("b.y").data(), ==,
+                    first->get_span<int64_t>("b.y").data());
+    operator_assert(watcher.last_parse_stats().tables_reused, ==, 1);
+
+    // A broken edit keeps the current set, as does one that changes no value.
+    std::ofstream("./fhiclcpp-simple.watch.inc.fcl") << "a: {v: }\n";
+    reloaded = watcher.reload_if_changed({"./fhiclcpp-simple.watch.inc.fcl"});
+    operator_assert(reloaded, ==, false);
+    operator_assert(watcher.last_error().size(), >, 0);
+    std::ofstream("./fhiclcpp-simple.watch.inc.fcl") << "a: {v: 2} # same\n";
+    reloaded = watcher.reload_if_changed({"./fhiclcpp-simple.watch.inc.fcl"});
+    operator_assert(reloaded, ==, false);
+    operator_assert(watcher.current(), ==, second);
+    operator_assert(watcher.generation(), ==, 1);
+
+    // Edits are picked up in the background, subscribers may look at the
+    // watcher.
+    size_t n_included = 0;
+    watcher.subscribe([&](std::shared_ptr<ParameterSet const> const &,
+                          std::vector<std::string> const &) {
+      n_included = watcher.includes().files.size();
+    });
+    // One that throws is reported through last_error.
+    watcher.subscribe([](std::shared_ptr<ParameterSet const> const &,
+                         std::vector<std::string> const &) {
+      throw std::runtime_error("bad subscriber");
+    });
+    watcher.start();
+    // Written as an editor would, so that it is never seen half written.
+    std::ofstream("./fhiclcpp-simple.watch.top.fcl.new")
+        << "#include \"./fhiclcpp-simple.watch.inc.fcl\"\n"
+           "b: {x: 5 y: [1, 2, 3]}\nc: @local::a\n";
+    std::rename("./fhiclcpp-simple.watch.top.fcl.new",
+                "./fhiclcpp-simple.watch.top.fcl");
+    for (size_t i = 0; (i < 100) && (watcher.generation() < 2); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    watcher.stop();
+    operator_assert(watcher.current()->get<int>("b.x"), ==, 5);
+    operator_assert(notified.size(), ==, 1);
+    operator_assert(notified[0], ==, "b.x");
+    operator_assert(n_included, ==, 2);
+    operator_assert(watcher.last_error(), ==, "bad subscriber");
+    std::remove("./fhiclcpp-simple.watch.top.fcl");
+    std::remove("./fhiclcpp-simple.watch.inc.fcl");
+    std::cout << "[PASSED]: 11/11 config watcher tests" << std::endl;
+  }
 }
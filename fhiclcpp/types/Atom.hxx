@@ -1,19 +1,290 @@
 #pragma once
 
 #include "fhiclcpp/types/Base.hxx"
+#include "fhiclcpp/types/digest.hxx"
+#include "fhiclcpp/types/serialize.hxx"
 
+#include "fhiclcpp/string_parsers/from_chars.hxx"
 #include "fhiclcpp/string_parsers/from_string.hxx"
 #include "fhiclcpp/string_parsers/traits.hxx"
 
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <type_traits>
 
 namespace fhicl {
+// Arithmetic types that can be read directly from a decoded Atom. Character
+// types are excluded as str2T reads them as characters rather than numbers, as
+// is long double as the decoded value is only held at double precision.
+template <typename T>
+struct is_atom_decodable
+    : std::integral_constant<
+          bool, (std::is_integral<T>::value &&
+                 !std::is_same<T, char>::value &&
+                 !std::is_same<T, signed char>::value &&
+                 !std::is_same<T, unsigned char>::value &&
+                 !std::is_same<T, wchar_t>::value &&
+                 !std::is_same<T, char16_t>::value &&
+                 !std::is_same<T, char32_t>::value) ||
+                    std::is_same<T, float>::value ||
+                    std::is_same<T, double>::value> {};
+
 class Atom : public Base {
-  void from(std::string const &str) { internal_rep = str; }
-  void from(std::string &&str) { internal_rep = std::move(str); }
+public:
+  enum class value_kind : uint8_t {
+    kUndecoded = 0,
+    kNil,
+    kInteger,
+    kFloat,
+    kBool,
+    kString
+  };
+
+private:
+  // The string representation is decoded at most once, on first typed access.
+  // The kind is published after the value bits so that concurrent readers of a
+  // const Atom either see kUndecoded, and decode again to the same result, or a
+  // complete value.
+  mutable std::atomic<uint8_t> decoded_kind;
+  mutable std::atomic<uint64_t> decoded_bits;
+  // Cached digest(), 0 until computed. It depends only on internal_rep, so
+  // concurrent readers compute the same value.
+  mutable std::atomic<uint64_t> digest_cache;
+
+  void from(std::string const &str) {
+    internal_rep = str;
+    reset_decoded();
+    digest_cache.store(0, std::memory_order_relaxed);
+  }
+  void from(std::string &&str) {
+    internal_rep = std::move(str);
+    reset_decoded();
+    digest_cache.store(0, std::memory_order_relaxed);
+  }
+
+  void reset_decoded() {
+    decoded_bits.store(0, std::memory_order_relaxed);
+    decoded_kind.store(uint8_t(value_kind::kUndecoded),
+                       std::memory_order_release);
+  }
+  void copy_decoded(Atom const &other) {
+    uint8_t k = other.decoded_kind.load(std::memory_order_acquire);
+    decoded_bits.store(other.decoded_bits.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    decoded_kind.store(k, std::memory_order_release);
+  }
+
+  // Whether stod would read all of str, without the exception that it throws
+  // when it cannot.
+  static bool parses_as_double(std::string const &str) {
+    char const *begin = str.c_str();
+    char *end = nullptr;
+    int saved_errno = errno;
+    errno = 0;
+    (void)std::strtod(begin, &end);
+    bool range_error = (errno == ERANGE);
+    errno = saved_errno;
+    return (end != begin) && !range_error &&
+           (size_t(end - begin) == str.size());
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_unsigned<T>::value, bool>::type
+  integer_fits(int64_t i) {
+    return (i >= 0) && (uint64_t(i) <= uint64_t(std::numeric_limits<T>::max()));
+  }
+  template <typename T>
+  static typename std::enable_if<std::is_signed<T>::value, bool>::type
+  integer_fits(int64_t i) {
+    return (i >= int64_t(std::numeric_limits<T>::min())) &&
+           (i <= int64_t(std::numeric_limits<T>::max()));
+  }
+  // Reads d, which is zero or a normal double read from a decimal string, as
+  // reading that string as T would, returns false if that might differ. For
+  // float that is so if d is in range, the nearest float is normal, or zero
+  // when d is, and d does not lie exactly half way between two floats, where
+  // the string might have rounded the other way.
+  static bool float_as(double d, double &rtn) {
+    rtn = d;
+    return true;
+  }
+  static bool float_as(double d, float &rtn) {
+    if (std::fabs(d) > double(std::numeric_limits<float>::max())) {
+      return false;
+    }
+    float f = float(d);
+    if ((d == 0) || (double(f) == d)) {
+      rtn = f;
+      return true;
+    }
+    if (!std::isnormal(f)) {
+      return false;
+    }
+    float const away = std::numeric_limits<float>::max();
+    float g = std::nextafter(f, (double(f) < d) ? away : -away);
+    if (!std::isnormal(g) || ((double(f) + double(g)) == (2 * d))) {
+      return false;
+    }
+    rtn = f;
+    return true;
+  }
 
 public:
+  static uint64_t integer_to_bits(int64_t i) {
+    uint64_t bits;
+    std::memcpy(&bits, &i, sizeof(bits));
+    return bits;
+  }
+  static uint64_t float_to_bits(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return bits;
+  }
+
+  static int64_t bits_to_integer(uint64_t bits) {
+    int64_t i;
+    std::memcpy(&i, &bits, sizeof(i));
+    return i;
+  }
+  static double bits_to_float(uint64_t bits) {
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  value_kind decode() const {
+    uint8_t k = decoded_kind.load(std::memory_order_acquire);
+    if (k != uint8_t(value_kind::kUndecoded)) {
+      return value_kind(k);
+    }
+    value_kind kind = value_kind::kString;
+    uint64_t bits = 0;
+    if (is_nil()) {
+      kind = value_kind::kNil;
+    } else {
+      char const *first = internal_rep.data();
+      char const *last = first + internal_rep.size();
+      int64_t i;
+      double d;
+      bool b;
+      switch (string_parsers::parse_number(first, last, i, d)) {
+      case string_parsers::number_kind::kInteger: {
+        bool hex = ((last - first) > 2) && (first[0] == '0') &&
+                   ((first[1] == 'x') || (first[1] == 'X'));
+        if (hex && (uint64_t(i) > std::numeric_limits<unsigned>::max())) {
+          // str2T reads hex constants through an unsigned int, so those that
+          // do not fit one are left to it.
+          break;
+        }
+        if ((i == 0) && (first[0] == '-')) {
+          // Keeps the sign of -0 for floating point reads.
+          kind = value_kind::kFloat;
+          bits = float_to_bits(-0.0);
+          break;
+        }
+        kind = value_kind::kInteger;
+        bits = integer_to_bits(i);
+        break;
+      }
+      case string_parsers::number_kind::kFloat: {
+        kind = value_kind::kFloat;
+        bits = float_to_bits(d);
+        break;
+      }
+      default: {
+        if (string_parsers::parse_bool_literal(first, last, b)) {
+          kind = value_kind::kBool;
+          bits = b;
+        }
+      }
+      }
+    }
+    decoded_bits.store(bits, std::memory_order_relaxed);
+    decoded_kind.store(uint8_t(kind), std::memory_order_release);
+    return kind;
+  }
+  // The raw decoded value, only meaningful after decode() has returned a kind
+  // other than kUndecoded.
+  uint64_t decoded_value_bits() const {
+    return decoded_bits.load(std::memory_order_relaxed);
+  }
+
+  // Reads a decoded value of the given kind as T if that gives the same result
+  // as string_parsers::str2T<T> on the string representation. Returns false,
+  // leaving rtn untouched, if the caller should fall back to str2T.
+  template <typename T>
+  static typename std::enable_if<is_atom_decodable<T>::value &&
+                                     std::is_integral<T>::value &&
+                                     !std::is_same<T, bool>::value,
+                                 bool>::type
+  convert_decoded(value_kind kind, uint64_t bits, T &rtn) {
+    switch (kind) {
+    case value_kind::kNil: {
+      rtn = T{};
+      return true;
+    }
+    case value_kind::kInteger: {
+      int64_t i = bits_to_integer(bits);
+      if (!integer_fits<T>(i)) {
+        return false;
+      }
+      rtn = T(i);
+      return true;
+    }
+    default: {
+      // str2T reads a float as T from the digits before any '.' or 'e', or
+      // fails if there are none, so floats are always left to it.
+      return false;
+    }
+    }
+  }
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value &&
+                                     is_atom_decodable<T>::value,
+                                 bool>::type
+  convert_decoded(value_kind kind, uint64_t bits, T &rtn) {
+    switch (kind) {
+    case value_kind::kNil: {
+      rtn = T{};
+      return true;
+    }
+    case value_kind::kInteger: {
+      rtn = T(bits_to_integer(bits));
+      return true;
+    }
+    case value_kind::kFloat: {
+      return float_as(bits_to_float(bits), rtn);
+    }
+    default: { return false; }
+    }
+  }
+  template <typename T>
+  static typename std::enable_if<std::is_same<T, bool>::value, bool>::type
+  convert_decoded(value_kind kind, uint64_t bits, T &rtn) {
+    if (kind != value_kind::kBool) {
+      return false;
+    }
+    rtn = bool(bits);
+    return true;
+  }
+  template <typename T>
+  static typename std::enable_if<!is_atom_decodable<T>::value, bool>::type
+  convert_decoded(value_kind, uint64_t, T &) {
+    return false;
+  }
+
+  template <typename T> bool decoded_as(T &rtn) const {
+    value_kind kind = decode();
+    return convert_decoded(kind, decoded_value_bits(), rtn);
+  }
+
   template <typename T>
   typename std::enable_if<
       !is_seq<T>::value && !std::is_same<T, std::string>::value, T>::type
@@ -21,6 +292,10 @@ public:
     if (is_nil()) {
       return T{};
     }
+    T rtn;
+    if (decoded_as(rtn)) {
+      return rtn;
+    }
     return string_parsers::str2T<T>(internal_rep);
   };
   template <typename T>
@@ -29,19 +304,21 @@ public:
     if (is_nil()) {
       return "@nil";
     }
+    value_kind kind = decode();
+    if ((kind == value_kind::kInteger) || (kind == value_kind::kFloat) ||
+        (kind == value_kind::kBool)) {
+      // Numbers and boolean literals contain no whitespace, quotes or
+      // punctuation other than '.', and anything with a '.' that was decoded
+      // also parses with stod, so the string representation is returned as-is.
+      return internal_rep;
+    }
     std::string stringified = string_parsers::str2T<T>(internal_rep);
     size_t first_period = stringified.find_first_of(".");
     if (first_period !=
         std::string::npos) { // if you have found a period, test to see if it is
       // parseable to a double, if so, return without quotes.
-      try {
-        size_t pos;
-        (void)stod(internal_rep, &pos);
-        if(pos != internal_rep.size()){
-          throw pos;
-        }
+      if (parses_as_double(internal_rep)) {
         return stringified;
-      } catch (...) {
       }
     }
 
@@ -53,19 +330,103 @@ public:
     }
     return stringified;
   };
-  Atom(std::string const &str) { from(str); }
-  Atom(std::string &&str) { from(std::move(str)); }
-  Atom(Atom const &other) : Base() { internal_rep = other.internal_rep; }
-  Atom(Atom &&other) { internal_rep = std::move(other.internal_rep); }
-  Atom() { internal_rep = "@nil"; }
+  Atom(std::string const &str) : Base(node_kind::kAtom), digest_cache(0) {
+    from(str);
+  }
+  Atom(std::string &&str) : Base(node_kind::kAtom), digest_cache(0) {
+    from(std::move(str));
+  }
+  Atom(Atom const &other)
+      : Base(node_kind::kAtom), digest_cache(other.digest_cache.load()) {
+    internal_rep = other.internal_rep;
+    copy_decoded(other);
+  }
+  Atom(Atom &&other)
+      : Base(node_kind::kAtom), digest_cache(other.digest_cache.load()) {
+    internal_rep = std::move(other.internal_rep);
+    copy_decoded(other);
+    other.reset_decoded();
+    other.digest_cache = 0;
+  }
+  Atom() : Base(node_kind::kAtom), digest_cache(0) {
+    internal_rep = "@nil";
+    reset_decoded();
+  }
+
+  Atom &operator=(Atom const &other) {
+    internal_rep = other.internal_rep;
+    copy_decoded(other);
+    digest_cache = other.digest_cache.load();
+    return *this;
+  }
+  Atom &operator=(Atom &&other) {
+    internal_rep = std::move(other.internal_rep);
+    copy_decoded(other);
+    digest_cache = other.digest_cache.load();
+    other.reset_decoded();
+    other.digest_cache = 0;
+    return *this;
+  }
 
   std::string to_string() const { return as<std::string>(); }
+  // The string that the atom was built from, before any quoting by to_string.
+  std::string const &string_rep() const { return internal_rep; }
   std::string to_compact_string() const { return as<std::string>(); }
   std::string to_indented_string(size_t) const { return as<std::string>(); }
   std::string to_indented_string_with_src_info(size_t) const {
     return as<std::string>();
   }
 
+  void write(std::ostream &os) const {
+    value_kind kind = decode();
+    if ((kind == value_kind::kInteger) || (kind == value_kind::kFloat) ||
+        (kind == value_kind::kBool)) { // as as<std::string>, without a copy
+      os << internal_rep;
+      return;
+    }
+    os << as<std::string>();
+  }
+  void write_compact(std::ostream &os) const { write(os); }
+  void write_indented(std::ostream &os, size_t) const { write(os); }
+  void write_json(std::ostream &os) const {
+    switch (decode()) {
+    case value_kind::kNil: {
+      os << "null";
+      return;
+    }
+    case value_kind::kBool: {
+      os << (decoded_value_bits() ? "true" : "false");
+      return;
+    }
+    case value_kind::kInteger: {
+      write_json_number(os, internal_rep.data(), internal_rep.size(),
+                        bits_to_integer(decoded_value_bits()));
+      return;
+    }
+    case value_kind::kFloat: {
+      write_json_number(os, internal_rep.data(), internal_rep.size(),
+                        bits_to_float(decoded_value_bits()));
+      return;
+    }
+    default: {
+      write_json_string(os, string_parsers::str2T<std::string>(internal_rep));
+    }
+    }
+  }
+
+  // The digest of an atom with the given string representation.
+  static uint64_t string_digest(std::string const &str) {
+    return digest_nonzero(digest_bytes(str, kAtomDigestSeed));
+  }
+  uint64_t digest() const {
+    uint64_t h = digest_cache.load(std::memory_order_relaxed);
+    if (!h) {
+      h = string_digest(to_string());
+      digest_cache.store(h, std::memory_order_relaxed);
+    }
+    return h;
+  }
+
   bool is_nil() const { return internal_rep == "@nil"; }
 };
 } // namespace fhicl
@@ -1,20 +1,37 @@
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <string>
+#include <type_traits>
 
 namespace fhicl {
+class Atom;
+class Sequence;
+class ParameterSet;
+
+// The concrete type of a node. Every node carries its kind, so that code that
+// depends on the type of a value switches on it, or calls visit, instead of
+// trying dynamic_casts in turn.
+enum class node_kind : uint8_t { kAtom, kSequence, kTable };
+
 class Base {
+  node_kind kind_;
+
 protected:
+  // Callers may write through the returned reference, so it is reset on
+  // every call, and is per thread so that concurrent parses do not race on it.
   static std::shared_ptr<Base> &empty() {
-    static std::shared_ptr<Base> nullrtn(nullptr);
+    static thread_local std::shared_ptr<Base> nullrtn(nullptr);
     nullrtn = nullptr;
     return nullrtn;
   }
   std::string internal_rep;
-  Base() : internal_rep() {}
-  Base(std::string const &str) : internal_rep(str) {}
-  Base(std::string &&str) : internal_rep(std::move(str)) {}
+  explicit Base(node_kind k) : kind_(k), internal_rep() {}
+  Base(node_kind k, std::string const &str) : kind_(k), internal_rep(str) {}
+  Base(node_kind k, std::string &&str)
+      : kind_(k), internal_rep(std::move(str)) {}
 
   virtual ~Base(){};
   virtual void from(std::string const &) = 0;
@@ -25,5 +42,69 @@ public:
   virtual std::string to_indented_string(size_t indent_level) const = 0;
   virtual std::string
   to_indented_string_with_src_info(size_t indent_level) const = 0;
+  // Write to_string, to_compact_string and to_indented_string straight into
+  // os, which the string forms are built on, so that serializing a tree
+  // builds no intermediate strings.
+  virtual void write(std::ostream &os) const = 0;
+  virtual void write_compact(std::ostream &os) const = 0;
+  virtual void write_indented(std::ostream &os, size_t indent_level) const = 0;
+  // Writes the value as JSON: tables become objects, sequences arrays, @nil
+  // null, and numbers and booleans stay unquoted.
+  virtual void write_json(std::ostream &os) const = 0;
+  // A 64-bit hash of the value that two values share if their to_string
+  // representations are identical, see digest.hxx. Composite values cache it.
+  virtual uint64_t digest() const = 0;
+  // The number of values directly within this one that digest() would
+  // combine, 0 if the digest is cached, as an estimate of the work it would do.
+  virtual size_t uncached_digest_width() const { return 0; }
+
+  node_kind kind() const { return kind_; }
+
+  // Heap bytes held by the string representation, beyond the node itself.
+  size_t text_heap_bytes() const {
+    return (internal_rep.capacity() > std::string().capacity())
+               ? (internal_rep.capacity() + 1)
+               : 0;
+  }
 };
+
+template <typename T> struct node_kind_of;
+template <>
+struct node_kind_of<Atom>
+    : std::integral_constant<node_kind, node_kind::kAtom> {};
+template <>
+struct node_kind_of<Sequence>
+    : std::integral_constant<node_kind, node_kind::kSequence> {};
+template <>
+struct node_kind_of<ParameterSet>
+    : std::integral_constant<node_kind, node_kind::kTable> {};
+
+template <typename T>
+typename std::enable_if<std::is_same<T, Base>::value, bool>::type
+is_node(Base const *) {
+  return true;
+}
+template <typename T>
+typename std::enable_if<!std::is_same<T, Base>::value, bool>::type
+is_node(Base const *value) {
+  return value->kind() == node_kind_of<T>::value;
+}
+
+// As dynamic_cast and std::dynamic_pointer_cast for nodes, but answered from
+// the kind tag. The shared_ptr form does not touch the reference count unless
+// the cast succeeds.
+template <typename T> T const *node_cast(Base const *value) {
+  return (value && is_node<T>(value)) ? static_cast<T const *>(value)
+                                      : nullptr;
+}
+template <typename T> T *node_cast(Base *value) {
+  return (value && is_node<T>(value)) ? static_cast<T *>(value) : nullptr;
+}
+template <typename T, typename U>
+std::shared_ptr<T> node_pointer_cast(std::shared_ptr<U> const &value) {
+  return (value && is_node<typename std::remove_const<T>::type>(value.get()))
+             ? std::static_pointer_cast<T>(value)
+             : nullptr;
+}
+
 } // namespace fhicl
@@ -12,8 +12,10 @@
 #include "fhiclcpp/string_parsers/from_string.hxx"
 #include "fhiclcpp/string_parsers/to_string.hxx"
 
+#include <algorithm>
 #include <limits>
 #include <memory>
+#include <unordered_set>
 
 namespace fhicl {
 
@@ -44,6 +46,7 @@ void Sequence::from(std::string const &str) {
       internal_rep.push_back(std::make_shared<Atom>(outer_list_item));
     }
   }
+  pack();
 }
 
 void ParameterSet::from(std::string const &str) {
@@ -75,66 +78,225 @@ void ParameterSet::from(std::string const &str) {
         << std::quoted("key: value") << " pairs: " << std::quoted(tstr);
   }
 
+  unshare();
   for (size_t i = 0; i < k_v_list.size(); i += 2) {
 
     std::string const &k = k_v_list[i];
     std::string const &v = k_v_list[i + 1];
 
     if (string_parsers::is_table(v)) {
-      internal_rep.insert({k, std::make_shared<ParameterSet>(v)});
+      rep->internal_rep.insert({k, std::make_shared<ParameterSet>(v)});
     } else if (string_parsers::is_sequence(v)) {
-      internal_rep.insert({k, std::make_shared<Sequence>(v)});
+      rep->internal_rep.insert({k, std::make_shared<Sequence>(v)});
     } else {
-      internal_rep.insert({k, std::make_shared<Atom>(v)});
+      rep->internal_rep.insert({k, std::make_shared<Atom>(v)});
     }
   }
 }
 
-bool ParameterSet::is_key_to_sequence(key_t const &key) const {
-  if (!check_key(key)) {
-    return false;
+template <typename T>
+bool ParameterSet::get_decoded(Base const *value, T &rtn) {
+  if (is_seq<T>::value) {
+    Sequence const *seq = node_cast<Sequence>(value);
+    return seq && seq->decoded_as(rtn);
   }
-  std::shared_ptr<Sequence const> seq =
-      std::dynamic_pointer_cast<Sequence const>(get_value_recursive(key));
-  return bool(seq);
+  Atom const *atm = node_cast<Atom>(value);
+  return atm && atm->decoded_as(rtn);
 }
 
 template <typename T>
-typename std::enable_if<std::is_same<Base, T>::value, void>::type
-ParameterSet::put_into_internal_rep(key_t const &key, T const &value) {
-  try {
-    ParameterSet const &ps = dynamic_cast<ParameterSet const &>(value);
-    get_value_recursive(key, true, true) = std::make_shared<ParameterSet>(ps);
-    idCache = 0;
+bool ParameterSet::read_packed_element(walk_result const &w, T &rtn) {
+  return !is_seq<T>::value &&
+         w.packed_sequence->element_decoded_as(w.packed_index, rtn);
+}
+
+std::shared_ptr<Base> const &
+ParameterSet::packed_element(walk_result const &w) {
+  return w.packed_sequence->get(w.packed_index);
+}
+
+uint64_t ParameterSet::digest() const {
+  ParameterSetID h = rep->idCache;
+  if (h) {
+    return h;
+  }
+  size_t ncomposite = 0;
+  for (auto const &kv : rep->internal_rep) {
+    ncomposite += !node_cast<Atom>(kv.second.get());
+  }
+  if (ncomposite >= kParallelDigestMinValues) {
+    std::vector<Base const *> composite;
+    for (auto const &kv : rep->internal_rep) {
+      if (!node_cast<Atom>(kv.second.get())) {
+        composite.push_back(kv.second.get());
+      }
+    }
+    digest_in_parallel(composite);
+  }
+  h = digest_combine(kTableDigestSeed, rep->internal_rep.size());
+  for (auto const &kv : rep->internal_rep) {
+    h = digest_combine(h, digest_bytes(kv.first, kTableDigestSeed));
+    h = digest_combine(h, kv.second->digest());
+  }
+  h = digest_nonzero(h);
+  rep->idCache = h;
+  return h;
+}
+
+void ParameterSet::collect_pending(Base const *value,
+                                   std::vector<table_rep *> &pending) {
+  ParameterSet const *ps = node_cast<ParameterSet>(value);
+  if (ps) {
+    if (ps->rep.is_pending()) {
+      pending.push_back(&ps->rep.unparsed());
+      return;
+    }
+    for (auto const &kv : ps->rep->internal_rep) {
+      collect_pending(kv.second.get(), pending);
+    }
     return;
-  } catch (const std::bad_cast) {
   }
-  try {
-    Sequence const &seq = dynamic_cast<Sequence const &>(value);
-    get_value_recursive(key, true, true) = std::make_shared<Sequence>(seq);
-    idCache = 0;
+  Sequence const *seq = node_cast<Sequence>(value);
+  if (seq && !seq->is_packed()) { // packed sequences hold only numbers
+    for (size_t i = 0; i < seq->size(); ++i) {
+      collect_pending(seq->get(i).get(), pending);
+    }
+  }
+}
+
+// The pending tables do not overlap, as a table nested in one is only
+// deferred once that one is parsed. Parsing each of them eagerly, in
+// document order, therefore reports the error that an eager parse of the
+// whole document would have.
+void ParameterSet::validate_all() const {
+  std::vector<table_rep *> pending;
+  collect_pending(this, pending);
+  std::stable_sort(pending.begin(), pending.end(),
+                   [](table_rep const *a, table_rep const *b) {
+                     return a->deferred->position() <
+                            b->deferred->position();
+                   });
+  for (table_rep *contents : pending) {
+    contents->materialize(true);
+  }
+}
+
+void ParameterSet::add_memory_usage(Base const *value, memory_report &report,
+                                    std::unordered_set<void const *> &seen) {
+  if (!seen.insert(value).second) {
+    report.shared++;
     return;
-  } catch (const std::bad_cast) {
   }
-  try {
-    Atom const &atm = dynamic_cast<Atom const &>(value);
-    get_value_recursive(key, true, true) = std::make_shared<Atom>(atm);
-    idCache = 0;
+  report.bytes += value->text_heap_bytes();
+  ParameterSet const *ps = node_cast<ParameterSet>(value);
+  if (ps) {
+    report.tables++;
+    report.bytes += sizeof(ParameterSet);
+    table_rep const &contents = *ps->rep;
+    if (!seen.insert(&contents).second) { // a copy of a set counted already
+      report.shared++;
+      return;
+    }
+    report.bytes += sizeof(table_rep);
+    for (auto const &kv : contents.internal_rep) {
+      report.keys++;
+      report.bytes += sizeof(kv) +
+                      key_map<std::shared_ptr<Base>>::entry_overhead +
+                      ((kv.first.capacity() > std::string().capacity())
+                           ? (kv.first.capacity() + 1)
+                           : 0);
+      if (kv.second) {
+        add_memory_usage(kv.second.get(), report, seen);
+      }
+    }
+    for (auto const &kv : contents.history) {
+      report.history_records += kv.second.size();
+      report.bytes += sizeof(kv) + (4 * sizeof(void *)) +
+                      (kv.second.capacity() * sizeof(provenance_record));
+    }
+    report.bytes += contents.extended_keys.capacity() * sizeof(std::string);
+    for (std::string const &key : contents.extended_keys) {
+      if (key.capacity() > std::string().capacity()) {
+        report.bytes += key.capacity() + 1;
+      }
+    }
+    return;
+  }
+  Sequence const *seq = node_cast<Sequence>(value);
+  if (seq) {
+    report.sequences++;
+    report.bytes += sizeof(Sequence) + seq->storage_heap_bytes();
+    if (seq->is_packed()) { // the elements are held in the packed storage
+      report.atoms += seq->size();
+      return;
+    }
+    for (size_t i = 0; i < seq->size(); ++i) {
+      if (seq->get(i)) {
+        add_memory_usage(seq->get(i).get(), report, seen);
+      }
+    }
     return;
-  } catch (const std::bad_cast) {
   }
-  throw bizare_error() << "Failed to downcast internal representation to a "
-                          "fhicl type for interal representation = "
-                       << value.to_string();
+  report.atoms++;
+  report.bytes += sizeof(Atom);
+}
+
+memory_report ParameterSet::memory_usage() const {
+  memory_report report;
+  std::unordered_set<void const *> seen;
+  add_memory_usage(this, report, seen);
+  return report;
+}
+
+bool ParameterSet::is_sequence_value(Base const *value) {
+  return bool(node_cast<Sequence>(value));
+}
+
+template <typename T>
+span<T const> ParameterSet::get_span(key_path const &path) const {
+  std::shared_ptr<Base> const &value = get_value_recursive(path);
+  if (!value) {
+    throw nonexistant_key() << "[ERROR]: Key " << std::quoted(path.str())
+                            << " does not exist in parameter set.";
+  }
+  Sequence const *seq = node_cast<Sequence>(value.get());
+  if (!seq) {
+    throw wrong_fhicl_category()
+        << "[ERROR]: Attempted to view key: " << std::quoted(path.str())
+        << " as a packed fhicl sequence, but it corresponds to a "
+        << std::quoted(fhicl::get_fhicl_category_string(value));
+  }
+  return seq->as_span<T>();
+}
+
+bool ParameterSet::is_key_to_sequence(key_t const &key) const {
+  if (!check_key(key)) {
+    return false;
+  }
+  return bool(node_cast<Sequence>(get_value_recursive(key).get()));
+}
+
+template <typename T>
+typename std::enable_if<std::is_same<Base, T>::value, void>::type
+ParameterSet::put_into_internal_rep(key_t const &key, T const &value) {
+  // Copy before looking up the slot, value may be this set or within it
+  std::shared_ptr<Base> new_value = visit(value, [](auto const &node) {
+    return std::shared_ptr<Base>(
+        std::make_shared<typename std::decay<decltype(node)>::type>(node));
+  });
+  get_value_recursive(key, true, true) = std::move(new_value);
+  rep->idCache = 0;
 }
 template <typename T>
 typename std::enable_if<(!std::is_same<Base, T>::value) &&
                             std::is_base_of<Base, T>::value,
                         void>::type
 ParameterSet::put_into_internal_rep(key_t const &key, T const &value) {
-  get_value_recursive(key, true, true) =
+  // Copy before looking up the slot, value may be this set or within it
+  std::shared_ptr<Base> new_value =
       std::make_shared<typename fhicl_type<T>::type>(value);
-  idCache = 0;
+  get_value_recursive(key, true, true) = std::move(new_value);
+  rep->idCache = 0;
 }
 template <typename T>
 typename std::enable_if<(!std::is_base_of<Base, T>::value) &&
@@ -144,23 +306,20 @@ ParameterSet::put_into_internal_rep(key_t const &key, T const &value) {
   get_value_recursive(key, true, true) =
       std::make_shared<typename fhicl_type<T>::type>(
           string_parsers::T2Str<T>(value));
-  idCache = 0;
+  rep->idCache = 0;
 }
 
 template <typename T>
 void ParameterSet::put_with_custom_history(key_t const &key, T const &value,
                                            std::string const &hist_entry) {
-  std::stringstream ss("");
-  if (has_key(key)) {
-    ss << "Added a " << std::quoted(fhicl_type<T>::category_string())
-       << " from " << std::quoted(hist_entry);
-  } else {
-    ss << "Overriden with a " << std::quoted(fhicl_type<T>::category_string())
-       << " from " << std::quoted(hist_entry);
-  }
+  provenance_action action = has_key(key) ? provenance_action::kAddedFrom
+                                          : provenance_action::kOverridenFrom;
 
   put_into_internal_rep(key, value);
-  history[key].push_back(ss.str());
+  if (rep->track_history) {
+    record(key, provenance_record::from_location(
+                    action, uint8_t(fhicl_type<T>::category()), hist_entry));
+  }
 }
 
 template <typename T>
@@ -168,18 +327,60 @@ typename std::enable_if<std::is_base_of<Base, T>::value, void>::type
 ParameterSet::put_with_custom_history(key_t const &key,
                                       std::shared_ptr<T> &&value_ptr,
                                       std::string const &hist_entry) {
-  std::stringstream ss("");
-  if (has_key(key)) {
-    ss << "Added a " << std::quoted(fhicl_type<T>::category_string())
-       << " from " << std::quoted(hist_entry);
-  } else {
-    ss << "Overriden with a " << std::quoted(fhicl_type<T>::category_string())
-       << " from " << std::quoted(hist_entry);
-  }
+  provenance_action action = has_key(key) ? provenance_action::kAddedFrom
+                                          : provenance_action::kOverridenFrom;
 
   get_value_recursive(key, true, true) = std::move(value_ptr);
-  idCache = 0;
-  history[key].push_back(ss.str());
+  rep->idCache = 0;
+  if (rep->track_history) {
+    record(key, provenance_record::from_location(
+                    action, uint8_t(fhicl_type<T>::category()), hist_entry));
+  }
+}
+
+std::string
+ParameterSet::history_entry_string(provenance_record const &rec) const {
+  fhicl_category category = fhicl_category(rec.category);
+  std::stringstream ss("");
+  switch (rec.action) {
+  case provenance_action::kAdded: {
+    ss << "Added a " << std::quoted(fhicl::get_fhicl_category_string(category))
+       << " via ParameterSet interface";
+    break;
+  }
+  case provenance_action::kOverriden: {
+    ss << "Overriden with a "
+       << std::quoted(fhicl::get_fhicl_category_string(category))
+       << " via ParameterSet interface";
+    break;
+  }
+  case provenance_action::kOverrodeElement: {
+    ss << "Overrode element " << rec.number << " with a "
+       << std::quoted(fhicl::get_fhicl_category_string(category))
+       << " via ParameterSet interface";
+    break;
+  }
+  case provenance_action::kAddedForExtension: {
+    ss << "Added a " << std::quoted(fhicl::get_fhicl_category_string(category))
+       << " via ParameterSet interface for extension to key: "
+       << std::quoted(rep->extended_keys[rec.string_id]);
+    break;
+  }
+  case provenance_action::kAddedFrom:
+  case provenance_action::kOverridenFrom: {
+    std::stringstream cs(""), ls("");
+    cs << category;
+    ls << provenance_strings::instance().str(rec.string_id);
+    if (rec.number != provenance_record::no_number) {
+      ls << ":" << rec.number;
+    }
+    ss << ((rec.action == provenance_action::kAddedFrom) ? "Added a "
+                                                         : "Overriden with a ")
+       << std::quoted(cs.str()) << " from " << std::quoted(ls.str());
+    break;
+  }
+  }
+  return ss.str();
 }
 
 // #define DEBUG_GET_VALUE
@@ -197,6 +398,9 @@ std::shared_ptr<Base> &ParameterSet::get_value(key_t const &key,
             << std::endl;
 #endif
 
+  // The caller may modify the value through the returned reference
+  unshare();
+
   size_t first_period = key.find_first_of(".");
   if (first_period != std::string::npos) { // No recusion allowed
     throw bizare_error() << "[ERROR]: ParameterSet::get_value passed key "
@@ -205,12 +409,12 @@ std::shared_ptr<Base> &ParameterSet::get_value(key_t const &key,
   }
 
   auto ki_pair = get_key_index(key);
-  auto kvp_it = internal_rep.find(ki_pair.key);
-  if (kvp_it == internal_rep.end()) {
+  auto kvp_it = rep->internal_rep.find(ki_pair.key);
+  if (kvp_it == rep->internal_rep.end()) {
     if (allow_extend) {
       if (ki_pair.has_index()) { // if key is sequence-like
         std::shared_ptr<Sequence> seq = std::make_shared<Sequence>();
-        internal_rep[ki_pair.key] = seq;
+        rep->internal_rep[ki_pair.key] = seq;
 #ifdef DEBUG_GET_VALUE
         std::string oi = indent;
         indent = "+";
@@ -221,7 +425,7 @@ std::shared_ptr<Base> &ParameterSet::get_value(key_t const &key,
 #endif
         return seq->get_or_extend_get_value(ki_pair.index);
       } else {
-        internal_rep[ki_pair.key] = std::make_shared<Atom>();
+        rep->internal_rep[ki_pair.key] = std::make_shared<Atom>();
 #ifdef DEBUG_GET_VALUE
         std::string oi = indent;
         indent = "+";
@@ -230,7 +434,7 @@ std::shared_ptr<Base> &ParameterSet::get_value(key_t const &key,
 #ifdef DEBUG_GET_VALUE
         indent = oi;
 #endif
-        return internal_rep[ki_pair.key];
+        return rep->internal_rep[ki_pair.key];
       }
     } else {
       return Base::empty();
@@ -251,15 +455,16 @@ std::shared_ptr<Base> &ParameterSet::get_value(key_t const &key,
               << std::quoted(get_fhicl_category_string(key));
         }
         // if we can, flatten whatever used to live there with an empty sequence
-        internal_rep.at(ki_pair.key) = std::make_shared<Sequence>();
+        rep->internal_rep.at(ki_pair.key) = std::make_shared<Sequence>();
         overrode_key(ki_pair.key, ki_pair.index);
       }
 #ifdef DEBUG_GET_VALUE
       indent = oi;
 #endif
-      // get the sequence
-      std::shared_ptr<Sequence> seq =
-          std::dynamic_pointer_cast<Sequence>(internal_rep.at(ki_pair.key));
+      // get the sequence, which will be modified in place
+      unshare_value(rep->internal_rep.at(ki_pair.key));
+      std::shared_ptr<Sequence> seq = node_pointer_cast<Sequence>(
+          rep->internal_rep.at(ki_pair.key));
       // return the relevant index, request extension if allowed
       return allow_extend ? seq->get_or_extend_get_value(ki_pair.index)
                           : seq->get(ki_pair.index);
@@ -284,9 +489,9 @@ std::shared_ptr<Base> const &ParameterSet::get_value(key_t const &key) const {
   }
 
   auto ki_pair = get_key_index(key);
-  auto kvp_it = internal_rep.find(ki_pair.key);
+  auto kvp_it = rep->internal_rep.find(ki_pair.key);
   if (kvp_it ==
-      internal_rep.end()) { // if the key doesn't exist, we cannot make it
+      rep->internal_rep.end()) { // if the key doesn't exist, we cannot make it
     return Base::empty();
   }
 
@@ -310,7 +515,8 @@ std::shared_ptr<Base> const &ParameterSet::get_value(key_t const &key) const {
 #endif
     // if it is, get the sequence
     std::shared_ptr<Sequence const> const seq =
-        std::dynamic_pointer_cast<Sequence const>(internal_rep.at(ki_pair.key));
+        node_pointer_cast<Sequence const>(
+            rep->internal_rep.at(ki_pair.key));
     // return the relevant index or Base::empty if it doesn't exist.
     return seq->get(ki_pair.index);
   } else {
@@ -347,8 +553,10 @@ std::shared_ptr<Base> &ParameterSet::get_value_recursive(key_t const &key,
     return local_value;
   }
 
+  // The child table will be modified in place
+  unshare_value(local_value);
   std::shared_ptr<ParameterSet> child_table =
-      std::dynamic_pointer_cast<ParameterSet>(local_value);
+      node_pointer_cast<ParameterSet>(local_value);
 
   if (!child_table) {      // if the value is not of ParameterSet type
     if (!allow_override) { // and we aren't allowed to override, throw
@@ -361,7 +569,8 @@ std::shared_ptr<Base> &ParameterSet::get_value_recursive(key_t const &key,
     }
     // Flatten with a table.
     local_value = std::make_shared<ParameterSet>();
-    child_table = std::dynamic_pointer_cast<ParameterSet>(local_value);
+    child_table = node_pointer_cast<ParameterSet>(local_value);
+    child_table->set_track_history(rep->track_history);
   }
 
 #ifdef DEBUG_GET_VALUE
@@ -378,52 +587,98 @@ std::shared_ptr<Base> &ParameterSet::get_value_recursive(key_t const &key,
 
 std::shared_ptr<Base> const &
 ParameterSet::get_value_recursive(key_t const &key) const {
-  if (!key.size()) {
-    throw null_key();
-  }
-  if (!valid_key(key)) {
-    throw invalid_key() << "[ERROR]: Invalid key " << std::quoted(key);
-  }
+  return get_value_recursive(key_path(key));
+}
+
+std::shared_ptr<Base> const &
+ParameterSet::get_value_recursive(key_path const &path) const {
 
 #ifdef DEBUG_GET_VALUE
-  std::cout << indent << "[GVR cst]: Getting value of key: " << std::quoted(key)
-            << std::endl;
+  std::cout << indent << "[GVR cst]: Getting value of key: "
+            << std::quoted(path.str()) << std::endl;
 #endif
 
-  size_t first_period = key.find_first_of(".");
-  if (first_period == std::string::npos) { // No more recusion
-    return get_value(key);
+  walk_result w = walk(path);
+  if (w.value) {
+    return *w.value;
   }
-  // we must go deepr
-  std::string local_key = key.substr(0, first_period);
-  std::shared_ptr<Base> const &local_value = get_value(local_key);
-
-  if (!local_value) { // We didn't get a value, it doesn't exist and we aren't
-                      // allowed to create it
-    return local_value;
+  if (w.packed_sequence) {
+    return packed_element(w);
   }
-
-  std::shared_ptr<ParameterSet const> const child_table =
-      std::dynamic_pointer_cast<ParameterSet const>(local_value);
-
-  if (!child_table) { // if the value is not of ParameterSet type, we aren't
-                      // allowed to override, throw
+  size_t i = w.segment;
+  if (w.error == lookup_error::kNotASequence) {
     throw wrong_fhicl_category()
-        << "[ERROR]: Attempted to recurse into fhicl table: "
-        << std::quoted(local_key) << " for resolution of: " << std::quoted(key)
+        << "[ERROR]: Attempted to access index of a sequence with key: "
+        << std::quoted(path.prefix(i))
         << ", however the value is of fhicl type "
-        << std::quoted(get_fhicl_category_string(key));
+        << std::quoted(fhicl::get_fhicl_category_string(w.table->get_value(
+               std::string(path.name_data(i), path[i].name_length))));
   }
+  throw wrong_fhicl_category()
+      << "[ERROR]: Attempted to recurse into fhicl table: "
+      << std::quoted(path.prefix(i))
+      << " for resolution of: " << std::quoted(path.str())
+      << ", however the value is of fhicl type "
+      << std::quoted(fhicl::get_fhicl_category_string(
+             *w.table->find_segment(path, i)));
+}
 
-#ifdef DEBUG_GET_VALUE
-  indent += "  ";
-  std::shared_ptr<Base> const &rtn =
-      child_table->get_value_recursive(key.substr(first_period + 1));
-  indent = indent.substr(2);
-  return rtn;
-#else
-  return child_table->get_value_recursive(key.substr(first_period + 1));
-#endif
+ParameterSet::walk_result ParameterSet::walk(key_path const &path) const {
+  ParameterSet const *table = this;
+  for (size_t i = 0; i < path.size(); ++i) {
+    if (((i + 1) == path.size()) && path[i].has_index()) {
+      walk_result w{nullptr, lookup_error::kNone, i, table};
+      w.packed_sequence = table->find_packed_segment(path, i);
+      if (w.packed_sequence) {
+        w.packed_index = path[i].index;
+        return w;
+      }
+    }
+    std::shared_ptr<Base> const *value = table->find_segment(path, i);
+    if (!value) {
+      return {nullptr, lookup_error::kNotASequence, i, table};
+    }
+    if ((i + 1) == path.size() || !(*value)) {
+      return {value, lookup_error::kNone, i, table};
+    }
+    ParameterSet const *child = node_cast<ParameterSet>(value->get());
+    if (!child) {
+      return {nullptr, lookup_error::kNotATable, i, table};
+    }
+    table = child;
+  }
+  return {&Base::empty(), lookup_error::kNone, path.size(), table};
+}
+
+std::shared_ptr<Base> const *
+ParameterSet::find_segment(key_path const &path, size_t i) const {
+  key_path::segment const &seg = path[i];
+  auto kvp_it =
+      rep->internal_rep.find(path.name_data(i), seg.name_length, seg.hash);
+  if (kvp_it == rep->internal_rep.end()) {
+    return &Base::empty();
+  }
+  if (!seg.has_index()) {
+    return &kvp_it->second;
+  }
+  Sequence const *seq = node_cast<Sequence>(kvp_it->second.get());
+  if (!seq) {
+    return nullptr;
+  }
+  return &seq->get(seg.index);
+}
+
+Sequence const *ParameterSet::find_packed_segment(key_path const &path,
+                                                  size_t i) const {
+  key_path::segment const &seg = path[i];
+  auto kvp_it =
+      rep->internal_rep.find(path.name_data(i), seg.name_length, seg.hash);
+  if (kvp_it == rep->internal_rep.end()) {
+    return nullptr;
+  }
+  Sequence const *seq = node_cast<Sequence>(kvp_it->second.get());
+  return (seq && seq->is_packed() && (seg.index < seq->size())) ? seq
+                                                                 : nullptr;
 }
 
 } // namespace fhicl
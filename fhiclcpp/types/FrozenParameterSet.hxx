@@ -0,0 +1,136 @@
+#pragma once
+
+#include "fhiclcpp/types/Atom.hxx"
+#include "fhiclcpp/types/ParameterSet.hxx"
+#include "fhiclcpp/types/Sequence.hxx"
+
+#include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace fhicl {
+
+// An immutable ParameterSet that any number of threads may read at once.
+//
+// A ParameterSet is only safe to share between threads as long as nobody
+// modifies it, and its lookups fill caches on first use. Freezing takes a
+// copy, which shares structure with the original and is unaffected by later
+// changes to it (see ParameterSet::unshare), and fills those caches up front:
+// every digest, and so id(), is computed and every atom is decoded. The only
+// interface left is const. get, has_key, get_names and id then take no locks,
+// with one exception: an element of a packed sequence that is looked up by
+// index as something other than a number or bool is built as an Atom on first
+// use, under a lock held by that sequence alone.
+class FrozenParameterSet {
+  std::shared_ptr<ParameterSet const> ps;
+  ParameterSetID id_;
+
+  struct already_warm {};
+  FrozenParameterSet(ParameterSet &&p, already_warm)
+      : ps(std::make_shared<ParameterSet const>(std::move(p))),
+        id_(ps->id()) {}
+
+  static void warm(Base const *value) {
+    Atom const *atm = node_cast<Atom>(value);
+    if (atm) {
+      atm->decode();
+      return;
+    }
+    Sequence const *seq = node_cast<Sequence>(value);
+    if (seq) {
+      if (seq->is_packed()) { // already decoded
+        return;
+      }
+      for (size_t i = 0; i < seq->size(); ++i) {
+        warm(seq->get(i).get());
+      }
+      return;
+    }
+    ParameterSet const *table = node_cast<ParameterSet>(value);
+    if (table) {
+      for (auto const &kv : table->rep->internal_rep) {
+        warm(kv.second.get());
+      }
+    }
+  }
+
+public:
+  FrozenParameterSet() : FrozenParameterSet(ParameterSet()) {}
+  explicit FrozenParameterSet(ParameterSet p)
+      : ps(std::make_shared<ParameterSet const>(std::move(p))), id_(0) {
+    warm(ps.get());
+    id_ = ps->id();
+  }
+
+  ParameterSetID id() const { return id_; }
+  bool is_empty() const { return ps->is_empty(); }
+
+  bool has_key(key_t const &key) const { return ps->has_key(key); }
+  bool has_key(key_path const &path) const { return ps->has_key(path); }
+  bool is_key_to_atom(key_t const &key) const {
+    return ps->is_key_to_atom(key);
+  }
+  bool is_key_to_sequence(key_t const &key) const {
+    return ps->is_key_to_sequence(key);
+  }
+  bool is_key_to_table(key_t const &key) const {
+    return ps->is_key_to_table(key);
+  }
+  std::vector<key_t> get_names() const { return ps->get_names(); }
+  std::vector<key_t> get_pset_names() const { return ps->get_pset_names(); }
+
+  // get<FrozenParameterSet> returns the child table frozen in turn, without
+  // walking it again.
+  template <typename T>
+  typename std::enable_if<std::is_same<T, FrozenParameterSet>::value, T>::type
+  get(key_path const &path) const {
+    return FrozenParameterSet(ps->get<ParameterSet>(path), already_warm());
+  }
+  template <typename T>
+  typename std::enable_if<!std::is_same<T, FrozenParameterSet>::value, T>::type
+  get(key_path const &path) const {
+    return ps->get<T>(path);
+  }
+  template <typename T> T get(key_t const &key) const {
+    return get<T>(key_path(key));
+  }
+  template <typename T> T get(key_t const &key, T def) const {
+    return ps->get<T>(key, std::move(def));
+  }
+  template <typename T> find_result<T> find(key_path const &path) const {
+    return ps->find<T>(path);
+  }
+  template <typename T> find_result<T> find(key_t const &key) const {
+    return ps->find<T>(key);
+  }
+  template <typename T> bool get_if_present(key_t const &key, T &rtn) const {
+    return ps->get_if_present<T>(key, rtn);
+  }
+  template <typename T> span<T const> get_span(key_t const &key) const {
+    return ps->get_span<T>(key);
+  }
+
+  std::string to_string() const { return ps->to_string(); }
+  std::string to_indented_string(size_t indent_level = 0) const {
+    return ps->to_indented_string(indent_level);
+  }
+  std::string to_json() const { return ps->to_json(); }
+  void write(std::ostream &os) const { ps->write(os); }
+  void write_indented(std::ostream &os, size_t indent_level = 0) const {
+    ps->write_indented(os, indent_level);
+  }
+  void write_json(std::ostream &os) const { ps->write_json(os); }
+
+  // The frozen contents as a ParameterSet that may be modified, which
+  // shares structure with this set until it is.
+  ParameterSet thaw() const { return *ps; }
+};
+
+inline FrozenParameterSet ParameterSet::freeze() const {
+  return FrozenParameterSet(*this);
+}
+
+} // namespace fhicl
@@ -2,18 +2,28 @@
 
 #include "fhiclcpp/types/Atom.hxx"
 #include "fhiclcpp/types/Base.hxx"
+#include "fhiclcpp/types/digest.hxx"
 #include "fhiclcpp/types/exception.hxx"
+#include "fhiclcpp/types/find_result.hxx"
+#include "fhiclcpp/types/key_map.hxx"
+#include "fhiclcpp/types/key_path.hxx"
+#include "fhiclcpp/types/memory_usage.hxx"
+#include "fhiclcpp/types/provenance.hxx"
+#include "fhiclcpp/types/serialize.hxx"
+#include "fhiclcpp/types/span.hxx"
 
 #include "fhiclcpp/string_parsers/from_string.hxx"
-#include "fhiclcpp/string_parsers/md5.hxx"
 #include "fhiclcpp/string_parsers/to_string.hxx"
 #include "fhiclcpp/string_parsers/traits.hxx"
 
+#include <atomic>
 #include <cstdint>
 #include <iomanip>
 #include <istream>
 #include <memory>
 #include <limits>
+#include <mutex>
+#include <unordered_set>
 
 namespace linedoc {
 template <typename T> struct doc_range_;
@@ -36,61 +46,232 @@ namespace fhicl {
 enum class fhicl_category;
 
 // Forward declarations of functions found in utility.hxx
-std::shared_ptr<Base> deep_copy_value(std::shared_ptr<Base> const original);
-fhicl_category get_fhicl_category(std::shared_ptr<Base> const el);
-std::string get_fhicl_category_string(std::shared_ptr<Base> const el);
+std::shared_ptr<Base> copy_value(std::shared_ptr<Base> const &original);
+fhicl_category get_fhicl_category(std::shared_ptr<Base> const &el);
+std::string get_fhicl_category_string(std::shared_ptr<Base> const &el);
 
-typedef uint32_t ParameterSetID;
+typedef uint64_t ParameterSetID;
 typedef std::string key_t;
 
 class fhicl_doc;
+class parse_context;
+class snapshot;
+class FrozenParameterSet;
+class lazy_document;
+template <typename S> class binding;
+
+// The source of a table whose contents are only parsed when they are first
+// used, see parse_options::lazy. build fills an empty set exactly as parsing
+// the table eagerly would have, or throws what that would have thrown. If
+// eager, the tables nested in it are parsed too rather than deferred in turn.
+class deferred_table {
+public:
+  // Held while building, a build that throws leaves the table pending.
+  std::mutex building;
+
+  virtual ~deferred_table() {}
+  virtual void build(ParameterSet &into, bool eager) const = 0;
+  // Where the table starts in its document, so that validate_all parses
+  // pending tables in document order.
+  virtual uint64_t position() const = 0;
+};
 
 class ParameterSet : public Base {
 
-  friend ParameterSet parse_fhicl_document(fhicl_doc const &,
-                                           ParameterSet const &,
-                                           ParameterSet const &,
-                                           linedoc::doc_range, key_t const &);
+  friend class parse_context;
+  friend class snapshot;
+  friend class FrozenParameterSet;
+  friend class lazy_document;
+  friend class config_watcher;
+  friend class ParameterSetRegistry;
+  friend class ParameterSetOverlay;
+  template <typename S> friend class binding;
+  friend void parse_fhicl_document(fhicl_doc const &, parse_context &,
+                                   ParameterSet &, linedoc::doc_range,
+                                   key_t const &);
 
   template <typename T>
   friend std::shared_ptr<T>
-  deep_copy_resolved_reference_value(key_t const &, ParameterSet const &,
-                                     ParameterSet const &);
+  copy_resolved_reference_value(key_t const &, parse_context const &);
+
+  // The contents of a set. Copies of a ParameterSet share one table_rep, and
+  // their children, until one of them is modified, see unshare.
+  struct table_rep {
+    key_map<std::shared_ptr<Base>> internal_rep;
+    std::map<std::string, std::vector<provenance_record>> history;
+    // The full keys of the kAddedForExtension records in history, indexed by
+    // their string_id. They are kept with the set, rather than interned, as
+    // they are as many as the keys that were ever put.
+    std::vector<std::string> extended_keys;
+    bool track_history;
+
+    // Cached digest(), 0 until computed. Every mutable lookup resets it, so a
+    // modification through the ParameterSet interface invalidates only the
+    // tables and sequences on the path from this set to the modified value.
+    mutable std::atomic<ParameterSetID> idCache;
+
+    // Set while the contents are still to be parsed. The source is kept
+    // after that, as a thread that saw pending may still be about to wait
+    // on it.
+    std::shared_ptr<deferred_table> deferred;
+    std::atomic<bool> pending;
+
+    table_rep()
+        : internal_rep(), history(), extended_keys(), track_history(true),
+          idCache(0), deferred(), pending(false) {}
+    // Only ever copied once materialized, see rep_ptr.
+    table_rep(table_rep const &other)
+        : internal_rep(other.internal_rep), history(other.history),
+          extended_keys(other.extended_keys),
+          track_history(other.track_history), idCache(0), deferred(),
+          pending(false) {}
+
+    // Parses the contents, once, however many threads get here. A failed
+    // parse leaves the table pending, so that each use, on any thread,
+    // throws again.
+    void materialize(bool eager = false) {
+      std::lock_guard<std::mutex> lock(deferred->building);
+      if (!pending.load(std::memory_order_acquire)) {
+        return;
+      }
+      ParameterSet built;
+      deferred->build(built, eager);
+      table_rep &contents = *built.rep;
+      internal_rep = std::move(contents.internal_rep);
+      history = std::move(contents.history);
+      extended_keys = std::move(contents.extended_keys);
+      track_history = contents.track_history;
+      pending.store(false, std::memory_order_release);
+    }
+  };
+
+  // Holds the contents like a std::shared_ptr, but materializes a deferred
+  // table on first dereference, so that none of the code below needs to know
+  // whether a set was built lazily. Only copying a set or moving it around
+  // the tree leaves it unparsed.
+  class rep_ptr {
+    std::shared_ptr<table_rep> ptr;
+
+    table_rep &contents() const {
+      if (ptr->pending.load(std::memory_order_acquire)) {
+        ptr->materialize();
+      }
+      return *ptr;
+    }
+
+  public:
+    rep_ptr(std::shared_ptr<table_rep> const &p) : ptr(p) {}
+    rep_ptr(std::shared_ptr<table_rep> &&p) : ptr(std::move(p)) {}
 
-  std::map<std::string, std::shared_ptr<Base>> internal_rep;
-  std::map<std::string, std::vector<std::string>> history;
+    table_rep *operator->() const { return &contents(); }
+    table_rep &operator*() const { return contents(); }
+    operator std::shared_ptr<table_rep const>() const {
+      contents();
+      return ptr;
+    }
+    long use_count() const { return ptr.use_count(); }
+    bool is_pending() const {
+      return ptr->pending.load(std::memory_order_acquire);
+    }
+    // The contents without materializing them.
+    table_rep &unparsed() const { return *ptr; }
+  };
+
+  rep_ptr rep;
+
+  // A set whose contents are parsed from source when first used.
+  static ParameterSet deferred_set(std::shared_ptr<deferred_table> source,
+                                   bool track_history) {
+    std::shared_ptr<table_rep> r = std::make_shared<table_rep>();
+    r->track_history = track_history;
+    r->deferred = std::move(source);
+    r->pending = true;
+    ParameterSet ps;
+    ps.rep = std::move(r);
+    return ps;
+  }
 
-  ParameterSetID idCache;
+  // Shared by all empty sets so that constructing one does not allocate.
+  static std::shared_ptr<table_rep> const &empty_rep() {
+    static std::shared_ptr<table_rep> const empty =
+        std::make_shared<table_rep>();
+    return empty;
+  }
 
+  // Must be called before any modification of rep: gives this set its own
+  // copy of the contents if they are shared, the children stay shared.
+  void unshare() {
+    if (rep.use_count() > 1) {
+      rep = std::make_shared<table_rep>(*rep);
+    }
+    rep->idCache = 0;
+  }
+
+  // Gives slot its own copy of a table or sequence that is also referenced
+  // from elsewhere, before that value is modified in place.
+  static void unshare_value(std::shared_ptr<Base> &slot) {
+    if (slot.use_count() > 1) {
+      slot = copy_value(slot);
+    }
+  }
+
+  void record(key_t const &key, provenance_record const &rec) {
+    unshare();
+    rep->history[key].push_back(rec);
+  }
+  // Appends records, taken from the history of from, to the history of key.
+  void record_from(key_t const &key,
+                   std::vector<provenance_record> const &records,
+                   table_rep const &from) {
+    std::vector<provenance_record> &hist = rep->history[key];
+    for (provenance_record rec : records) {
+      if (rec.action == provenance_action::kAddedForExtension) {
+        std::string full_key = from.extended_keys[rec.string_id];
+        rec.string_id = uint32_t(rep->extended_keys.size());
+        rep->extended_keys.push_back(std::move(full_key));
+      }
+      hist.push_back(rec);
+    }
+  }
+  uint8_t get_fhicl_category_code(key_t const &key) const {
+    check_key(key, true);
+    return uint8_t(fhicl::get_fhicl_category(get_value_recursive(key)));
+  }
+
+  // The history is recorded as provenance records, the corresponding text is
+  // only built by history_entry_string when it is asked for.
   void added_key(key_t const &key) {
-    std::stringstream ss("");
-    ss << "Added a " << std::quoted(get_fhicl_category_string(key))
-       << " via ParameterSet interface";
-    history[key].push_back(ss.str());
+    if (rep->track_history) {
+      record(key, {provenance_action::kAdded, get_fhicl_category_code(key), 0,
+                   provenance_record::no_number});
+    }
   }
   void overrode_key(key_t const &key,
                     size_t seq_index = std::numeric_limits<size_t>::max()) {
-    std::stringstream ss("");
+    if (!rep->track_history) {
+      return;
+    }
     if (seq_index == std::numeric_limits<size_t>::max()) {
-      ss << "Overriden with a " << std::quoted(get_fhicl_category_string(key))
-         << " via ParameterSet interface";
+      record(key, {provenance_action::kOverriden,
+                   get_fhicl_category_code(key), 0,
+                   provenance_record::no_number});
     } else {
-      std::stringstream ss2("");
-      ss2 << key << "[" << seq_index << "]";
-      ss << "Overrode element " << seq_index << " with a "
-         << std::quoted(get_fhicl_category_string(ss2.str()))
-         << " via ParameterSet interface";
+      std::stringstream ss("");
+      ss << key << "[" << seq_index << "]";
+      record(key, {provenance_action::kOverrodeElement,
+                   get_fhicl_category_code(ss.str()), 0, seq_index});
     }
-
-    history[key].push_back(ss.str());
   }
   void added_key_for_extension(key_t const &key, key_t const &full_key) {
-    std::stringstream ss("");
-    ss << "Added a " << std::quoted(get_fhicl_category_string(key))
-       << " via ParameterSet interface for extension to key: "
-       << std::quoted(full_key);
-    history[key].push_back(ss.str());
+    if (rep->track_history) {
+      record(key, {provenance_action::kAddedForExtension,
+                   get_fhicl_category_code(key),
+                   uint32_t(rep->extended_keys.size()),
+                   provenance_record::no_number});
+      rep->extended_keys.push_back(full_key);
+    }
   }
+  inline std::string history_entry_string(provenance_record const &rec) const;
 
   template <typename T>
   inline typename std::enable_if<std::is_same<Base, T>::value, void>::type
@@ -117,37 +298,7 @@ class ParameterSet : public Base {
 
   inline void from(std::string const &str);
 
-  bool valid_key(key_t const &key) const {
-    char front = key.front();
-    if ((!std::isalpha(front)) && (front != '_')) {
-      return false;
-    }
-    if (key.back() == '.') {
-      return false;
-    }
-    if (key.find_first_of(" \":\'@(){}") != std::string::npos) {
-      return false;
-    }
-    size_t first_open_bracket = key.find_first_of("[");
-    size_t last_matching_bracket = 0;
-    while (first_open_bracket != std::string::npos) {
-      size_t matching_bracket = string_parsers::find_matching_bracket(
-          key, '[', ']', first_open_bracket);
-      if (matching_bracket > last_matching_bracket) {
-        last_matching_bracket = matching_bracket;
-      }
-      if (matching_bracket == std::string::npos) {
-        return false;
-      }
-      first_open_bracket = key.find_first_of("[", matching_bracket);
-    }
-    size_t last_close_bracket = key.find_last_of("]");
-    if ((last_close_bracket != std::string::npos) &&
-        (last_close_bracket > last_matching_bracket)) {
-      return false;
-    }
-    return true;
-  }
+  bool valid_key(key_t const &key) const { return key_path::is_valid(key); }
 
   struct key_index_pair_t {
     key_t key;
@@ -176,6 +327,34 @@ class ParameterSet : public Base {
                       bool allow_override = false);
   inline std::shared_ptr<Base> const &
   get_value_recursive(key_t const &key) const;
+  inline std::shared_ptr<Base> const &
+  get_value_recursive(key_path const &path) const;
+  // The value of segment i of path in this table, or an empty pointer if there
+  // is none. Returns nullptr, rather than throwing, if the segment has an index
+  // but its value is not a sequence.
+  inline std::shared_ptr<Base> const *find_segment(key_path const &path,
+                                                   size_t i) const;
+  // The sequence that segment i of path indexes in this table if it is packed
+  // and holds that index, otherwise nullptr.
+  inline Sequence const *find_packed_segment(key_path const &path,
+                                             size_t i) const;
+  // Where a walk down a key_path stopped, see walk.
+  struct walk_result {
+    // The slot holding the value, which is empty if the key does not exist,
+    // or nullptr if the walk failed or ended at a packed element.
+    std::shared_ptr<Base> const *value;
+    lookup_error error;
+    // If the walk failed, the segment that could not be followed and the
+    // table that holds it.
+    size_t segment;
+    ParameterSet const *table;
+    // If path ends at an existing element of a packed sequence, which has no
+    // node of its own until one is asked for, that sequence and the index.
+    Sequence const *packed_sequence = nullptr;
+    size_t packed_index = 0;
+  };
+  // Follows path from this table without throwing or building any strings.
+  inline walk_result walk(key_path const &path) const;
 
   bool check_key(key_t const &key, bool throw_on_not_exist = false) const {
     if (!key.size()) {
@@ -193,6 +372,34 @@ class ParameterSet : public Base {
     }
     return true;
   }
+  bool check_key(key_path const &path, bool throw_on_not_exist = false) const {
+    if (!get_value_recursive(path)) {
+      if (throw_on_not_exist) {
+        throw nonexistant_key() << "[ERROR]: Key " << std::quoted(path.str())
+                                << " does not exist in parameter set.";
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Reads value as T directly from a decoded Atom or Sequence, returns false
+  // if T must instead be parsed from the string representation.
+  template <typename T>
+  static inline bool get_decoded(Base const *value, T &rtn);
+  static inline bool is_sequence_value(Base const *value);
+  // Reads the packed element that w ended at as T, as get_decoded does.
+  template <typename T>
+  static inline bool read_packed_element(walk_result const &w, T &rtn);
+  // The node for the packed element that w ended at, built on first use.
+  static inline std::shared_ptr<Base> const &
+  packed_element(walk_result const &w);
+  // Appends the tables at or below value that are still to be parsed to
+  // pending, without parsing any.
+  static inline void collect_pending(Base const *value,
+                                     std::vector<table_rep *> &pending);
+  static inline void add_memory_usage(Base const *value, memory_report &report,
+                                      std::unordered_set<void const *> &seen);
 
   std::string get_fhicl_category_string(key_t const &key) const {
     check_key(key, true);
@@ -200,131 +407,146 @@ class ParameterSet : public Base {
   }
 
 public:
-  ParameterSet() : internal_rep(), history(), idCache(0) {}
-  ParameterSet(std::string const &str) : internal_rep(), idCache(0) {
+  ParameterSet() : Base(node_kind::kTable), rep(empty_rep()) {}
+  ParameterSet(std::string const &str)
+      : Base(node_kind::kTable), rep(empty_rep()) {
     from(str);
   }
-  ParameterSet(ParameterSet &&other) { (*this) = std::move(other); }
-  ParameterSet(ParameterSet const &other) : ParameterSet() { splice(other); }
+  // Copies share their contents with the original until either is modified.
+  ParameterSet(ParameterSet &&other)
+      : Base(node_kind::kTable), rep(std::move(other.rep)) {
+    other.rep = empty_rep();
+  }
+  ParameterSet(ParameterSet const &other)
+      : Base(node_kind::kTable), rep(other.rep) {}
 
   ParameterSet &operator=(ParameterSet const &other) {
-    // Get rid of any internal state
-    internal_rep.clear();
-    history.clear();
-
-    splice(other);
+    rep = other.rep;
     return *this;
   }
 
   ParameterSet &operator=(ParameterSet &&other) {
-    internal_rep = std::move(other.internal_rep);
-    history = std::move(other.history);
-    idCache = other.idCache;
+    std::swap(rep, other.rep);
     return *this;
   }
 
-  bool is_empty() const { return !internal_rep.size(); }
-
-  ParameterSetID id() {
-    if (idCache) {
-      return idCache;
-    }
-    idCache = dynamic_cast<ParameterSet const *>(this)->id();
-    return idCache;
-  }
-
-  ParameterSetID id() const {
-    if (idCache) {
-      return idCache;
-    }
-    // if we can't use the cache, we also cannot update it as this is a const
-    // method.
-    std::string md = md5(to_string());
-    ParameterSetID ID = 1;
-    while (md.size()) {
-      ID *= string_parsers::str2T<ParameterSetID>(std::string("0x") +
-                                                  md.substr(0, 4));
-      md = md.substr(4);
-    }
-    return ID;
+  bool is_empty() const { return !rep->internal_rep.size(); }
+
+  // False if this set was built lazily and has not been used yet, see
+  // parse_options::lazy.
+  bool is_materialized() const { return !rep.is_pending(); }
+  // Materializes every table below this one that has not been used yet,
+  // throwing what parsing it eagerly would have thrown for the first that
+  // fails, in key order.
+  inline void validate_all() const;
+
+  // Counts the nodes below this set and estimates the memory that they hold,
+  // see memory_report.
+  inline memory_report memory_usage() const;
+
+  // The ID is a hash of the contents of the set, computed from the cached
+  // digests of its children, see digest.hxx. Sets with identical to_string
+  // representations share an ID.
+  ParameterSetID id() const { return digest(); }
+  // An immutable copy that any number of threads may read at once, see
+  // FrozenParameterSet.
+  inline FrozenParameterSet freeze() const;
+
+  inline uint64_t digest() const;
+  size_t uncached_digest_width() const {
+    return rep->idCache ? 0 : rep->internal_rep.size();
   }
 
   std::string to_string() const {
-    std::stringstream ss("");
-    for (auto ip_it = internal_rep.begin(); ip_it != internal_rep.end();
-         ++ip_it) {
-      std::shared_ptr<ParameterSet> ps =
-          std::dynamic_pointer_cast<ParameterSet>(ip_it->second);
-      if (ps) {
-        ss << ip_it->first << ": { " << ip_it->second->to_string() << " } ";
+    string_ostream os;
+    write(os);
+    return os.take();
+  }
+  std::string to_compact_string() const {
+    string_ostream os;
+    write_compact(os);
+    return os.take();
+  }
+  std::string to_indented_string(size_t indent_level = 0) const {
+    string_ostream os;
+    write_indented(os, indent_level);
+    return os.take();
+  }
+  std::string to_json() const {
+    string_ostream os;
+    write_json(os);
+    return os.take();
+  }
+  void write(std::ostream &os) const {
+    bool first = true;
+    for (auto const &kv : rep->internal_rep) {
+      os << (first ? "" : " ") << kv.first << ": ";
+      first = false;
+      if (node_cast<ParameterSet>(kv.second.get())) {
+        os << "{ ";
+        kv.second->write(os);
+        os << " }";
       } else {
-        ss << ip_it->first << ": " << ip_it->second->to_string() << " ";
+        kv.second->write(os);
       }
     }
-    std::string str_rep = ss.str();
-    return str_rep.substr(0, str_rep.size() - 1);
   }
-  std::string to_compact_string() const {
-    std::stringstream ss("");
-    for (auto ip_it = internal_rep.cbegin(); ip_it != internal_rep.cend();
-         ++ip_it) {
-      std::shared_ptr<ParameterSet const> ps =
-          std::dynamic_pointer_cast<ParameterSet const>(ip_it->second);
+  void write_compact(std::ostream &os) const {
+    bool first = true;
+    for (auto const &kv : rep->internal_rep) {
+      os << (first ? "" : " ") << kv.first << ": ";
+      first = false;
+      ParameterSet const *ps =
+          node_cast<ParameterSet>(kv.second.get());
       if (ps) {
-        ss << ip_it->first << ": @id::" << ps->id() << " ";
+        os << "@id::" << ps->id();
       } else {
-        ss << ip_it->first << ": " << ip_it->second->to_compact_string() << " ";
+        kv.second->write_compact(os);
       }
     }
-    std::string str_rep = ss.str();
-    return str_rep.substr(0, str_rep.size() - 1);
   }
-  std::string to_indented_string(size_t indent_level = 0) const {
-    std::stringstream ss("");
+  // Children are told apart by their type rather than by looking their keys
+  // up again.
+  void write_indented(std::ostream &os, size_t indent_level = 0) const {
+    std::string const indent(indent_level, ' ');
     size_t nprinted = 0;
-    for (auto ip_it = internal_rep.cbegin(); ip_it != internal_rep.cend();
-         ++ip_it) {
-      for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-        ss << " ";
-      }
-      if (is_key_to_atom(ip_it->first)) {
-        ss << ip_it->first << ": " << ip_it->second->to_indented_string(0)
-           << ((nprinted + 1 == internal_rep.size()) ? "" : "\n");
-      } else if (is_key_to_sequence(ip_it->first)) {
-        ss << ip_it->first << ": [" << std::endl
-           << ip_it->second->to_indented_string(indent_level +
-                                                // ip_it->first.size() + 4)
-                                                4)
-           << std::endl;
-        // for (size_t i_it = 0; i_it < (indent_level + ip_it->first.size() +
-        // 2);
-        // for (size_t i_it = 0; i_it < (indent_level + 2); ++i_it) {
-        for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-          ss << " ";
-        }
-        ss << "]" << ((nprinted + 1 == internal_rep.size()) ? "" : "\n");
+    for (auto const &kv : rep->internal_rep) {
+      char const *sep =
+          (nprinted + 1 == rep->internal_rep.size()) ? "" : "\n";
+      Base const *value = kv.second.get();
+      os << indent << kv.first;
+      if (node_cast<Atom>(value)) {
+        os << ": ";
+        value->write_indented(os, 0);
+        os << sep;
+      } else if (node_cast<ParameterSet>(value)) {
+        os << ": {" << std::endl;
+        value->write_indented(os, indent_level + 4);
+        os << std::endl << indent << "}" << sep;
       } else {
-        ss << ip_it->first << ": {" << std::endl
-           << ip_it->second->to_indented_string(indent_level +
-                                                // ip_it->first.size() + 4)
-                                                4)
-           << std::endl;
-        // for (size_t i_it = 0; i_it < (indent_level + ip_it->first.size() +
-        // 2);
-        // for (size_t i_it = 0; i_it < (indent_level + 2); ++i_it) {
-        for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-          ss << " ";
-        }
-        ss << "}" << ((nprinted + 1 == internal_rep.size()) ? "" : "\n");
+        os << ": [" << std::endl;
+        value->write_indented(os, indent_level + 4);
+        os << std::endl << indent << "]" << sep;
       }
       nprinted++;
     }
-    return ss.str();
+  }
+  void write_json(std::ostream &os) const {
+    os << "{";
+    bool first = true;
+    for (auto const &kv : rep->internal_rep) {
+      os << (first ? "" : ",");
+      first = false;
+      write_json_string(os, kv.first);
+      os << ":";
+      kv.second->write_json(os);
+    }
+    os << "}";
   }
   std::string to_indented_string_with_src_info(size_t indent_level = 0) const {
     std::stringstream ss("");
-    for (auto ip_it = internal_rep.cbegin(); ip_it != internal_rep.cend();
-         ++ip_it) {
+    for (auto ip_it = rep->internal_rep.cbegin();
+         ip_it != rep->internal_rep.cend(); ++ip_it) {
       for (size_t i_it = 0; i_it < indent_level; ++i_it) {
         ss << " ";
       }
@@ -352,149 +574,261 @@ public:
   }
   std::vector<key_t> get_names() const {
     std::vector<key_t> names;
-    for (auto ip_it = internal_rep.cbegin(); ip_it != internal_rep.cend();
-         ++ip_it) {
+    for (auto ip_it = rep->internal_rep.cbegin();
+         ip_it != rep->internal_rep.cend(); ++ip_it) {
       names.push_back(ip_it->first);
     }
     return names;
   }
   std::vector<key_t> get_pset_names() const {
     std::vector<key_t> names;
-    for (auto ip_it = internal_rep.cbegin(); ip_it != internal_rep.cend();
-         ++ip_it) {
-      std::shared_ptr<ParameterSet const> ps =
-          std::dynamic_pointer_cast<ParameterSet const>(ip_it->second);
-      if (ps) {
+    for (auto ip_it = rep->internal_rep.cbegin();
+         ip_it != rep->internal_rep.cend(); ++ip_it) {
+      if (node_cast<ParameterSet>(ip_it->second.get())) {
         names.push_back(ip_it->first);
       }
     }
     return names;
   }
   std::string get_src_info(key_t const &key) const {
-    if (history.find(key) == history.end()) {
+    if (rep->history.find(key) == rep->history.end()) {
       return "";
     }
     std::stringstream ss("");
-    for (size_t h_it = 0; h_it < history.at(key).size(); ++h_it) {
-      ss << history.at(key)[h_it]
-         << ((h_it + 1 == history.at(key).size()) ? "" : ", ");
+    for (size_t h_it = 0; h_it < rep->history.at(key).size(); ++h_it) {
+      ss << history_entry_string(rep->history.at(key)[h_it])
+         << ((h_it + 1 == rep->history.at(key).size()) ? "" : ", ");
     }
     return ss.str();
   }
   std::string history_to_string() const {
     std::stringstream ss("");
-    for (auto &kvpair : history) {
+    for (auto &kvpair : rep->history) {
       ss << kvpair.first << ": ";
-      for (size_t h_it = 0; h_it < history.at(kvpair.first).size(); ++h_it) {
-        ss << history.at(kvpair.first)[h_it]
-           << ((h_it + 1 == history.at(kvpair.first).size()) ? "" : ", ");
+      for (size_t h_it = 0; h_it < kvpair.second.size(); ++h_it) {
+        ss << history_entry_string(kvpair.second[h_it])
+           << ((h_it + 1 == kvpair.second.size()) ? "" : ", ");
       }
       ss << std::endl;
     }
     return ss.str();
   }
 
+  // When disabled, no history is recorded for modifications of this set, and
+  // any that was already recorded is dropped. Tables added to this set by
+  // extending a key inherit the setting.
+  void set_track_history(bool track) {
+    if (rep->track_history == track) {
+      return;
+    }
+    unshare();
+    rep->track_history = track;
+    if (!track) {
+      rep->history.clear();
+      rep->extended_keys.clear();
+    }
+  }
+  bool tracks_history() const { return rep->track_history; }
+
   bool has_key(key_t const &key) const { return check_key(key); }
+  bool has_key(key_path const &path) const { return check_key(path); }
   bool is_key_to_atom(key_t const &key) const {
     if (!check_key(key)) {
       return false;
     }
-    std::shared_ptr<Atom const> atm =
-        std::dynamic_pointer_cast<Atom const>(get_value_recursive(key));
-    return bool(atm);
+    return bool(node_cast<Atom>(get_value_recursive(key).get()));
   }
   inline bool is_key_to_sequence(key_t const &key) const;
   bool is_key_to_table(key_t const &key) const {
     if (!check_key(key)) {
       return false;
     }
-    std::shared_ptr<ParameterSet const> ps =
-        std::dynamic_pointer_cast<ParameterSet const>(get_value_recursive(key));
-    return bool(ps);
+    return bool(node_cast<ParameterSet>(get_value_recursive(key).get()));
+  }
+  // A view of the values of a sequence of numbers that is held packed, see
+  // Sequence::as_span. Valid until this ParameterSet is modified or destroyed.
+  template <typename T> span<T const> get_span(key_t const &key) const {
+    return get_span<T>(key_path(key));
   }
-  // get table
   template <typename T>
-  typename std::enable_if<std::is_same<T, ParameterSet>::value, T>::type
-  get(key_t const &key) const {
-    check_key(key, true);
-    if (!is_key_to_table(key)) {
+  inline span<T const> get_span(key_path const &path) const;
+
+  // The key_t overloads below validate and split the key on every call, code
+  // that looks up the same key repeatedly can build a key_path once instead.
+
+  // Reads value, found at key, as a T. Throws as get does if value is null or
+  // of the wrong fhicl category for T.
+  template <typename T>
+  static typename std::enable_if<std::is_same<T, ParameterSet>::value, T>::type
+  value_as(std::shared_ptr<Base> const &value, key_t const &key) {
+    if (!value) {
+      throw nonexistant_key() << "[ERROR]: Key " << std::quoted(key)
+                              << " does not exist in parameter set.";
+    }
+    ParameterSet const *ps = node_cast<ParameterSet>(value.get());
+    if (!ps) {
       throw wrong_fhicl_category()
           << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
           << " as a fhicl table (fhicl::ParameterSet), but it corresponds to a "
-          << std::quoted(get_fhicl_category_string(key));
+          << std::quoted(fhicl::get_fhicl_category_string(value));
     }
-    std::shared_ptr<ParameterSet const> ps =
-        std::dynamic_pointer_cast<ParameterSet const>(get_value_recursive(key));
     return *ps;
   }
-  // get other
   template <typename T>
-  typename std::enable_if<!std::is_same<T, ParameterSet>::value, T>::type
-  get(key_t const &key) const {
-    check_key(key, true);
+  static typename std::enable_if<!std::is_same<T, ParameterSet>::value, T>::type
+  value_as(std::shared_ptr<Base> const &value, key_t const &key) {
+    if (!value) {
+      throw nonexistant_key() << "[ERROR]: Key " << std::quoted(key)
+                              << " does not exist in parameter set.";
+    }
 
-    if (is_seq<T>::value && !is_key_to_sequence(key)) {
+    // Decoded atoms and numeric sequences are returned without serializing
+    // and re-parsing their string representation.
+    T rtn;
+    if (get_decoded(value.get(), rtn)) {
+      return rtn;
+    }
+
+    bool is_sequence = is_sequence_value(value.get());
+    bool is_table = bool(node_cast<ParameterSet>(value.get()));
+
+    if (is_seq<T>::value && !is_sequence) {
       throw wrong_fhicl_category()
           << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
           << " as a fhicl sequence ("
           << std::quoted(is_seq<T>::get_sequence_type())
           << "), but it corresponds to a "
-          << std::quoted(get_fhicl_category_string(key));
+          << std::quoted(fhicl::get_fhicl_category_string(value));
     }
-    if (!is_seq<T>::value && is_key_to_sequence(key)) {
+    if (!is_seq<T>::value && is_sequence) {
       throw wrong_fhicl_category()
           << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
           << " as a fhicl atom, but it corresponds to a fhicl sequence";
     }
 
-    if (is_seq<T>::value && is_key_to_table(key)) {
+    if (is_seq<T>::value && is_table) {
       throw wrong_fhicl_category()
           << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
           << " as a fhicl sequence ("
           << std::quoted(is_seq<T>::get_sequence_type())
           << "), but it corresponds to a fhicl table (ParameterSet)";
     }
-    if (!is_seq<T>::value && is_key_to_table(key)) {
+    if (!is_seq<T>::value && is_table) {
       throw wrong_fhicl_category()
           << "[ERROR]: Attempted to retrieve key: " << std::quoted(key)
           << " as a fhicl atom, but it corresponds to a fhicl table "
              "(ParameterSet)";
     }
 
-    return string_parsers::str2T<T>(get_value_recursive(key)->to_string());
-  };
+    return string_parsers::str2T<T>(value->to_string());
+  }
 
-  template <typename T> T get(key_t const &key, T def) const {
+  template <typename T> T get(key_path const &path) const {
+    walk_result w = walk(path);
+    if (w.packed_sequence) {
+      T rtn;
+      if (read_packed_element(w, rtn)) {
+        return rtn;
+      }
+    }
+    return value_as<T>(w.value ? *w.value : get_value_recursive(path),
+                       path.str());
+  }
+  template <typename T> T get(key_t const &key) const {
+    return get<T>(key_path(key));
+  }
+
+  // Reads value as a T, as value_as does, but reports a null value, or one
+  // of the wrong category or that cannot be parsed as a T, as a lookup_error
+  // instead of throwing.
+  template <typename T>
+  static typename std::enable_if<std::is_same<T, ParameterSet>::value,
+                                 find_result<T>>::type
+  value_into(std::shared_ptr<Base> const &value) {
+    if (!value) {
+      return lookup_error::kNonexistantKey;
+    }
+    ParameterSet const *ps = node_cast<ParameterSet>(value.get());
+    if (!ps) {
+      return lookup_error::kWrongCategory;
+    }
+    return *ps;
+  }
+  template <typename T>
+  static typename std::enable_if<!std::is_same<T, ParameterSet>::value,
+                                 find_result<T>>::type
+  value_into(std::shared_ptr<Base> const &value) {
+    if (!value) {
+      return lookup_error::kNonexistantKey;
+    }
+    T rtn;
+    if (get_decoded(value.get(), rtn)) {
+      return find_result<T>(std::move(rtn));
+    }
+    if ((value->kind() == node_kind::kTable) ||
+        (is_seq<T>::value != is_sequence_value(value.get()))) {
+      return lookup_error::kWrongCategory;
+    }
+    // Only values that are not decoded, such as strings and tuples, are
+    // parsed from their string representation, which reports failure by
+    // throwing.
     try {
-      return get<T>(key);
-    } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) { // parser fail
-      return def;
-    } catch (fhicl::fhicl_cpp_simple_except &e) { // type fail
-      return def;
+      return find_result<T>(string_parsers::str2T<T>(value->to_string()));
+    } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) {
+      return lookup_error::kBadValue;
+    } catch (fhicl::fhicl_cpp_simple_except &e) {
+      return lookup_error::kBadValue;
     } catch (std::exception &e) {
       throw bizare_error()
-          << "[ERROR]: Caught unexpected exception in ParameterSet::get: "
+          << "[ERROR]: Caught unexpected exception in ParameterSet::find: "
           << std::quoted(e.what());
     }
-  };
+  }
 
-  template <typename T> bool get_if_present(key_t const &key, T &rtn) const {
-    if (!check_key(key)) {
-      return false;
+  // Looks up key and reads it as a T without throwing: a missing key, or a
+  // value that cannot be read as a T, is reported by the lookup_error of the
+  // result. For code that probes optional keys often, get(key, def) and
+  // get_if_present are built on this.
+  template <typename T> find_result<T> find(key_path const &path) const {
+    walk_result w = walk(path);
+    if (w.packed_sequence) {
+      T rtn;
+      if (read_packed_element(w, rtn)) {
+        return find_result<T>(std::move(rtn));
+      }
+      return value_into<T>(packed_element(w));
     }
-    try {
-      rtn = get<T>(key);
-    } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) { // parser fail
-      return false;
-    } catch (fhicl::fhicl_cpp_simple_except &e) { // type fail
+    if (!w.value) {
+      return w.error;
+    }
+    return value_into<T>(*w.value);
+  }
+  template <typename T> find_result<T> find(key_t const &key) const {
+    if (!key_path::is_valid(key)) {
+      return lookup_error::kInvalidKey;
+    }
+    return find<T>(key_path(key));
+  }
+
+  template <typename T> T get(key_path const &path, T def) const {
+    return find<T>(path).value_or(std::move(def));
+  };
+  template <typename T> T get(key_t const &key, T def) const {
+    return find<T>(key).value_or(std::move(def));
+  };
+
+  template <typename T>
+  bool get_if_present(key_path const &path, T &rtn) const {
+    find_result<T> found = find<T>(path);
+    if (!found) {
       return false;
-    } catch (std::exception &e) {
-      throw bizare_error()
-          << "[ERROR]: Caught unexpected exception in ParameterSet::get: "
-          << std::quoted(e.what());
     }
+    rtn = *std::move(found);
     return true;
   };
+  template <typename T> bool get_if_present(key_t const &key, T &rtn) const {
+    return get_if_present(key_path(key), rtn);
+  };
 
   template <typename T> void put(key_t const &key, T const &value) {
     if (has_key(key)) {
@@ -559,48 +893,52 @@ public:
   }
 
   void splice(ParameterSet const &other) {
-    if (!other.internal_rep.size()) {
+    if (!other.rep->internal_rep.size()) {
       return;
     }
-    for (auto const &kv_pair : other.internal_rep) {
+    // other may share its contents with this set, hold on to them unchanged
+    std::shared_ptr<table_rep const> other_rep = other.rep;
+    unshare();
+    for (auto const &kv_pair : other_rep->internal_rep) {
       bool had_key = has_key(kv_pair.first);
-      internal_rep[kv_pair.first] =
-          deep_copy_value(other.internal_rep.at(kv_pair.first));
+      rep->internal_rep[kv_pair.first] = copy_value(kv_pair.second);
       had_key ? overrode_key(kv_pair.first) : added_key(kv_pair.first);
-      if (other.history.find(kv_pair.first) != other.history.end()) {
-        for (auto const &h : other.history.at(kv_pair.first)) {
-          history[kv_pair.first].push_back(h);
-        }
+      auto other_hist = other_rep->history.find(kv_pair.first);
+      if (rep->track_history && (other_hist != other_rep->history.end())) {
+        record_from(kv_pair.first, other_hist->second, *other_rep);
       }
     }
-    idCache = 0;
+    rep->idCache = 0;
   }
 
   void splice(ParameterSet &&other) {
-    if (!other.internal_rep.size()) {
+    if (!other.rep->internal_rep.size()) {
       return;
     }
-    for (auto const &kv_pair : other.internal_rep) {
+    other.unshare();
+    unshare();
+    table_rep &other_rep = *other.rep;
+    for (auto &kv_pair : other_rep.internal_rep) {
       bool had_key = has_key(kv_pair.first);
-      internal_rep[kv_pair.first] =
-          std::move(other.internal_rep.at(kv_pair.first));
+      rep->internal_rep[kv_pair.first] = std::move(kv_pair.second);
       had_key ? overrode_key(kv_pair.first) : added_key(kv_pair.first);
-      if (other.history.find(kv_pair.first) != other.history.end()) {
-        history[kv_pair.first].insert(
-            history[kv_pair.first].end(),
-            std::make_move_iterator(other.history.at(kv_pair.first).begin()),
-            std::make_move_iterator(other.history.at(kv_pair.first).end()));
+      auto other_hist = other_rep.history.find(kv_pair.first);
+      if (rep->track_history && (other_hist != other_rep.history.end())) {
+        record_from(kv_pair.first, other_hist->second, other_rep);
       }
     }
-    idCache = 0;
+    rep->idCache = 0;
   }
 
   bool erase(key_t const &key) {
     if (!has_key(key)) {
       return false;
     }
-    internal_rep.erase(key);
-    history.erase(key);
+    unshare();
+    rep->internal_rep.erase(key);
+    rep->history.erase(key);
+    rep->idCache = 0;
+    return true;
   }
 
   template<typename T>
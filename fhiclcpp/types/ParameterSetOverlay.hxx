@@ -0,0 +1,324 @@
+#pragma once
+
+#include "fhiclcpp/types/Atom.hxx"
+#include "fhiclcpp/types/ParameterSet.hxx"
+#include "fhiclcpp/types/Sequence.hxx"
+
+#include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fhicl {
+
+// A ParameterSet seen through a stack of override layers, without copying or
+// modifying it. For example, to build many job variants from one base:
+//
+//   ParameterSetOverlay job(base);
+//   job.put_or_replace("physics.producers.gen.seed", 12);
+//   job.get<int>("physics.producers.gen.seed"); // 12
+//   ParameterSet flat = job.flatten();
+//
+// Each layer is itself a, usually small, ParameterSet, and layers added later
+// take precedence. A table in a layer is merged into the table under it, key
+// by key, any other value replaces the value under it as a whole, as a
+// sequence is not merged element by element. Overriding a sequence element,
+// as in put_or_replace("a.b[1]", 2), copies the sequence into the top layer
+// first.
+//
+// Copying an overlay, or creating a variant with with or put_or_replace,
+// shares the base and the layers, see ParameterSet::unshare, so it costs in
+// proportion to the number of overrides, not to the size of the base. get,
+// has_key and get_names look through the layers from the top without
+// building anything, other than the merged table for a get<ParameterSet> of a
+// table that is overridden. Serializing the overlay and id() see the result
+// of flatten, which copies only the tables on the paths to overridden values
+// and so recomputes only their digests.
+class ParameterSetOverlay {
+  ParameterSet base_;
+  // Bottom to top.
+  std::vector<ParameterSet> layers;
+
+  // What a key_path refers to through the layers: the values that make it up,
+  // topmost first, or the lookup_error that prevented finding any. There is
+  // more than one value only for a table that is overridden, and then each is
+  // a table.
+  struct resolved {
+    std::vector<std::shared_ptr<Base>> values;
+    lookup_error error;
+  };
+
+  static bool is_table(std::shared_ptr<Base> const &value) {
+    return value && (value->kind() == node_kind::kTable);
+  }
+
+  resolved resolve(key_path const &path) const {
+    std::vector<ParameterSet const *> tables;
+    for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+      tables.push_back(&(*it));
+    }
+    tables.push_back(&base_);
+
+    resolved res{{}, lookup_error::kNone};
+    for (size_t i = 0; i < path.size(); ++i) {
+      key_path::segment const &seg = path[i];
+      res.values.clear();
+      for (ParameterSet const *table : tables) {
+        auto const &rep = table->rep->internal_rep;
+        auto kvp_it = rep.find(path.name_data(i), seg.name_length, seg.hash);
+        if ((kvp_it == rep.end()) || !kvp_it->second) {
+          continue;
+        }
+        bool table_value = is_table(kvp_it->second);
+        // A value that is not a table hides everything under it, and is
+        // hidden by a table above it.
+        if (res.values.size() && !table_value) {
+          break;
+        }
+        res.values.push_back(kvp_it->second);
+        if (!table_value) {
+          break;
+        }
+      }
+      if (!res.values.size()) {
+        res.error = lookup_error::kNonexistantKey;
+        return res;
+      }
+      if (seg.has_index()) {
+        Sequence const *seq = node_cast<Sequence>(res.values.front().get());
+        if (!seq) {
+          res.values.clear();
+          res.error = lookup_error::kNotASequence;
+          return res;
+        }
+        std::shared_ptr<Base> el = seq->get(seg.index);
+        res.values.clear();
+        if (!el) {
+          res.error = lookup_error::kNonexistantKey;
+          return res;
+        }
+        res.values.push_back(std::move(el));
+      }
+      if ((i + 1) == path.size()) {
+        return res;
+      }
+      if (!is_table(res.values.front())) {
+        res.values.clear();
+        res.error = lookup_error::kNotATable;
+        return res;
+      }
+      tables.clear();
+      for (std::shared_ptr<Base> const &value : res.values) {
+        tables.push_back(static_cast<ParameterSet const *>(value.get()));
+      }
+    }
+    return res;
+  }
+
+  // The single value that res refers to, merging the tables of an overridden
+  // table into a new one.
+  static std::shared_ptr<Base> value_of(resolved const &res) {
+    if (res.values.size() == 1) {
+      return res.values.front();
+    }
+    std::shared_ptr<ParameterSet> merged = std::make_shared<ParameterSet>(
+        static_cast<ParameterSet const &>(*res.values.back()));
+    for (size_t i = res.values.size() - 1; i > 0; --i) {
+      merge_into(*merged,
+                 static_cast<ParameterSet const &>(*res.values[i - 1]));
+    }
+    return merged;
+  }
+
+  // Merges layer into into, as flatten does, sharing the values of layer.
+  static void merge_into(ParameterSet &into, ParameterSet const &layer) {
+    if (!layer.rep->internal_rep.size()) {
+      return;
+    }
+    into.unshare();
+    for (auto const &kv : layer.rep->internal_rep) {
+      std::shared_ptr<Base> &slot = into.rep->internal_rep[kv.first];
+      bool had_key = bool(slot);
+      if (is_table(slot) && is_table(kv.second)) {
+        ParameterSet::unshare_value(slot);
+        merge_into(static_cast<ParameterSet &>(*slot),
+                   static_cast<ParameterSet const &>(*kv.second));
+      } else {
+        slot = kv.second;
+      }
+      had_key ? into.overrode_key(kv.first) : into.added_key(kv.first);
+    }
+    into.rep->idCache = 0;
+  }
+
+  // Copies the sequence that segment i of path indexes into the top layer,
+  // unless that layer already holds it, so that an element of it can be
+  // overridden there.
+  void copy_sequence_to_top(key_path const &path, size_t i) {
+    std::string seq_key =
+        path.str().substr(0, path[i].name_begin + path[i].name_length);
+    key_path seq_path(seq_key);
+    ParameterSet::walk_result w = layers.back().walk(seq_path);
+    if (!w.value || *w.value) {
+      return;
+    }
+    resolved res = resolve(seq_path);
+    if (!res.values.size()) {
+      return;
+    }
+    std::shared_ptr<Base> seq = value_of(res);
+    layers.back().put_or_replace(seq_key, *seq);
+  }
+
+public:
+  ParameterSetOverlay() : base_(), layers() {}
+  explicit ParameterSetOverlay(ParameterSet base)
+      : base_(std::move(base)), layers() {}
+
+  ParameterSet const &base() const { return base_; }
+  size_t n_layers() const { return layers.size(); }
+
+  // A copy of this overlay with layer on top.
+  ParameterSetOverlay with(ParameterSet layer) const {
+    ParameterSetOverlay variant(*this);
+    variant.push_layer(std::move(layer));
+    return variant;
+  }
+  void push_layer(ParameterSet layer) { layers.push_back(std::move(layer)); }
+
+  // Overrides key in the top layer, which is added if there is none yet.
+  template <typename T> void put_or_replace(key_t const &key, T const &value) {
+    key_path path(key);
+    if (!layers.size()) {
+      layers.emplace_back();
+    }
+    for (size_t i = 0; i < path.size(); ++i) {
+      if (path[i].has_index()) {
+        copy_sequence_to_top(path, i);
+        break;
+      }
+    }
+    layers.back().put_or_replace(key, value);
+  }
+
+  bool is_empty() const { return !get_names().size(); }
+
+  bool has_key(key_path const &path) const {
+    return bool(resolve(path).values.size());
+  }
+  bool has_key(key_t const &key) const {
+    return key_path::is_valid(key) && has_key(key_path(key));
+  }
+  bool is_key_to_atom(key_t const &key) const {
+    resolved res = resolve(key_path(key));
+    return res.values.size() &&
+           (res.values.front()->kind() == node_kind::kAtom);
+  }
+  bool is_key_to_sequence(key_t const &key) const {
+    resolved res = resolve(key_path(key));
+    return res.values.size() &&
+           (res.values.front()->kind() == node_kind::kSequence);
+  }
+  bool is_key_to_table(key_t const &key) const {
+    resolved res = resolve(key_path(key));
+    return res.values.size() && is_table(res.values.front());
+  }
+
+  // The names of the top level keys in any layer or in the base, sorted.
+  std::vector<key_t> get_names() const {
+    std::vector<key_t> names = base_.get_names();
+    for (ParameterSet const &layer : layers) {
+      std::vector<key_t> layer_names = layer.get_names();
+      std::vector<key_t> merged;
+      std::set_union(names.begin(), names.end(), layer_names.begin(),
+                     layer_names.end(), std::back_inserter(merged));
+      names.swap(merged);
+    }
+    return names;
+  }
+  std::vector<key_t> get_pset_names() const {
+    std::vector<key_t> names;
+    for (key_t const &name : get_names()) {
+      if (is_key_to_table(name)) {
+        names.push_back(name);
+      }
+    }
+    return names;
+  }
+
+  template <typename T> T get(key_path const &path) const {
+    resolved res = resolve(path);
+    if (res.error == lookup_error::kNotATable) {
+      throw wrong_fhicl_category()
+          << "[ERROR]: Attempted to recurse into a value that is not a fhicl "
+             "table for resolution of: "
+          << std::quoted(path.str());
+    }
+    if (res.error == lookup_error::kNotASequence) {
+      throw wrong_fhicl_category()
+          << "[ERROR]: Attempted to access index of a value that is not a "
+             "fhicl sequence with key: "
+          << std::quoted(path.str());
+    }
+    return ParameterSet::value_as<T>(
+        res.values.size() ? value_of(res) : std::shared_ptr<Base>(),
+        path.str());
+  }
+  template <typename T> T get(key_t const &key) const {
+    return get<T>(key_path(key));
+  }
+  template <typename T> find_result<T> find(key_path const &path) const {
+    resolved res = resolve(path);
+    if (!res.values.size()) {
+      return res.error;
+    }
+    return ParameterSet::value_into<T>(value_of(res));
+  }
+  template <typename T> find_result<T> find(key_t const &key) const {
+    if (!key_path::is_valid(key)) {
+      return lookup_error::kInvalidKey;
+    }
+    return find<T>(key_path(key));
+  }
+  template <typename T> T get(key_t const &key, T def) const {
+    return find<T>(key).value_or(std::move(def));
+  }
+  template <typename T> bool get_if_present(key_t const &key, T &rtn) const {
+    find_result<T> found = find<T>(key);
+    if (!found) {
+      return false;
+    }
+    rtn = *std::move(found);
+    return true;
+  }
+
+  // The base with each layer merged into it in turn. Values that are not
+  // overridden are shared with the base.
+  ParameterSet flatten() const {
+    ParameterSet flat = base_;
+    for (ParameterSet const &layer : layers) {
+      merge_into(flat, layer);
+    }
+    return flat;
+  }
+
+  ParameterSetID id() const { return flatten().id(); }
+  std::string to_string() const { return flatten().to_string(); }
+  std::string to_compact_string() const {
+    return flatten().to_compact_string();
+  }
+  std::string to_indented_string(size_t indent_level = 0) const {
+    return flatten().to_indented_string(indent_level);
+  }
+  std::string to_json() const { return flatten().to_json(); }
+  void write(std::ostream &os) const { flatten().write(os); }
+  void write_indented(std::ostream &os, size_t indent_level = 0) const {
+    flatten().write_indented(os, indent_level);
+  }
+  void write_json(std::ostream &os) const { flatten().write_json(os); }
+};
+
+} // namespace fhicl
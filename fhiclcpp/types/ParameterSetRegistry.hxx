@@ -0,0 +1,259 @@
+#pragma once
+
+#include "fhiclcpp/types/Atom.hxx"
+#include "fhiclcpp/types/ParameterSet.hxx"
+#include "fhiclcpp/types/Sequence.hxx"
+
+#include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fhicl {
+
+// Interns ParameterSets by content, so that the tables, sequences and atoms
+// that are identical across any number of registered sets are held once. For
+// example:
+//
+//   ParameterSetID id = ParameterSetRegistry::instance().put(ps);
+//   ...
+//   std::shared_ptr<ParameterSet const> job =
+//       ParameterSetRegistry::instance().get(id);
+//
+// Values are looked up by their digest, which for a table is its id(), as
+// art's ParameterSetRegistry identifies sets by their hash. As the digest is
+// not cryptographic, a value is only replaced by a registered node with the
+// same digest once their contents are compared and found equal, and values
+// whose digests collide are each registered. Registering a set walks it from
+// the top: a value equal to a registered one is replaced by that node, and a
+// new table or sequence is copied, with its own values interned in turn, and
+// becomes the registered node. The registered nodes are shared, immutable,
+// and are never modified through the sets built on them, as ParameterSet
+// copies anything that is shared before modifying it. Identical tables share
+// the history of the first one registered.
+//
+// Registering and looking up are safe from any number of threads. The nodes
+// are spread across independently locked shards by digest, and get is a
+// single hash lookup. As get only has an id to go on, it returns the first
+// table registered with that id.
+class ParameterSetRegistry {
+  typedef std::vector<std::shared_ptr<Base>> bucket;
+  struct shard {
+    mutable std::mutex mtx;
+    std::unordered_map<uint64_t, bucket> nodes;
+  };
+  static constexpr size_t kShards = 16;
+  std::array<shard, kShards> shards;
+
+  shard &shard_for(uint64_t digest) { return shards[digest % kShards]; }
+  shard const &shard_for(uint64_t digest) const {
+    return shards[digest % kShards];
+  }
+
+  // Whether a and b hold the same values. Children that are the same node
+  // are not compared further, so a value is usually only compared down to the
+  // registered nodes that it shares.
+  static bool same_value(Base const *a, Base const *b) {
+    if (a == b) {
+      return true;
+    }
+    if (!a || !b || (a->kind() != b->kind()) || (a->digest() != b->digest())) {
+      return false;
+    }
+    switch (a->kind()) {
+    case node_kind::kAtom: {
+      return static_cast<Atom const &>(*a).string_rep() ==
+             static_cast<Atom const &>(*b).string_rep();
+    }
+    case node_kind::kSequence: {
+      Sequence const &sa = static_cast<Sequence const &>(*a);
+      Sequence const &sb = static_cast<Sequence const &>(*b);
+      if (sa.size() != sb.size()) {
+        return false;
+      }
+      if (sa.is_packed() || sb.is_packed()) { // the elements are numbers
+        return sa.to_string() == sb.to_string();
+      }
+      for (size_t i = 0; i < sa.size(); ++i) {
+        if (!same_value(sa.get(i).get(), sb.get(i).get())) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case node_kind::kTable: {
+      auto const &ra = static_cast<ParameterSet const &>(*a).rep->internal_rep;
+      auto const &rb = static_cast<ParameterSet const &>(*b).rep->internal_rep;
+      if (ra.size() != rb.size()) {
+        return false;
+      }
+      for (auto const &kv : ra) {
+        auto it = rb.find(kv.first);
+        if ((it == rb.end()) ||
+            !same_value(kv.second.get(), it->second.get())) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default: {
+      return false;
+    }
+    }
+  }
+
+  bucket find_bucket(uint64_t digest) const {
+    shard const &s = shard_for(digest);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.nodes.find(digest);
+    return (it == s.nodes.end()) ? bucket() : it->second;
+  }
+
+  // The registered node that holds the same values as value, or nullptr.
+  std::shared_ptr<Base> find_node(uint64_t digest, Base const &value) const {
+    for (std::shared_ptr<Base> const &node : find_bucket(digest)) {
+      if (same_value(node.get(), &value)) {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+  // The first registered node with digest and kind, or nullptr.
+  std::shared_ptr<Base> find_node(uint64_t digest, node_kind kind) const {
+    for (std::shared_ptr<Base> const &node : find_bucket(digest)) {
+      if (node->kind() == kind) {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+
+  // A copy of value whose tables and sequences refer to registered nodes.
+  std::shared_ptr<Base> build(std::shared_ptr<Base> const &value) {
+    switch (value->kind()) {
+    case node_kind::kSequence: {
+      std::shared_ptr<Sequence> seq =
+          std::make_shared<Sequence>(static_cast<Sequence const &>(*value));
+      if (!seq->is_packed()) { // packed numbers have nothing to share
+        for (size_t i = 0; i < seq->size(); ++i) {
+          std::shared_ptr<Base> &el = seq->get(i);
+          el = intern(el);
+        }
+      }
+      return seq;
+    }
+    case node_kind::kTable: {
+      std::shared_ptr<ParameterSet> ps = std::make_shared<ParameterSet>(
+          static_cast<ParameterSet const &>(*value));
+      ps->unshare();
+      for (auto &kv : ps->rep->internal_rep) {
+        kv.second = intern(kv.second);
+      }
+      return ps;
+    }
+    default: {
+      return value;
+    }
+    }
+  }
+
+  std::shared_ptr<Base> intern(std::shared_ptr<Base> const &value) {
+    if (!value) {
+      return value;
+    }
+    uint64_t digest = value->digest();
+    std::shared_ptr<Base> node = find_node(digest, *value);
+    if (node) {
+      return node;
+    }
+    node = build(value);
+    shard &s = shard_for(digest);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    bucket &b = s.nodes[digest];
+    // Another thread may have registered the same value meanwhile, those
+    // nodes are shared so compare equal without being walked.
+    for (size_t i = 0; i < b.size(); ++i) {
+      if (same_value(b[i].get(), node.get())) {
+        return b[i];
+      }
+    }
+    b.push_back(node);
+    return node;
+  }
+
+public:
+  ParameterSetRegistry() : shards() {}
+  ParameterSetRegistry(ParameterSetRegistry const &) = delete;
+  ParameterSetRegistry &operator=(ParameterSetRegistry const &) = delete;
+
+  static ParameterSetRegistry &instance() {
+    static ParameterSetRegistry registry;
+    return registry;
+  }
+
+  // Registers ps, and every table, sequence and atom in it, and returns the
+  // registered copy. A set assigned from it shares all of its contents:
+  //
+  //   ps = *registry.intern(ps);
+  std::shared_ptr<ParameterSet const> intern(ParameterSet const &ps) {
+    return std::static_pointer_cast<ParameterSet const>(
+        intern(std::make_shared<ParameterSet>(ps)));
+  }
+  ParameterSetID put(ParameterSet const &ps) { return intern(ps)->id(); }
+
+  // The registered table with id, or nullptr if there is none.
+  std::shared_ptr<ParameterSet const> get(ParameterSetID id) const {
+    return std::static_pointer_cast<ParameterSet const>(
+        find_node(id, node_kind::kTable));
+  }
+  bool get(ParameterSetID id, ParameterSet &ps) const {
+    std::shared_ptr<ParameterSet const> registered = get(id);
+    if (registered) {
+      ps = *registered;
+    }
+    return bool(registered);
+  }
+  bool has(ParameterSetID id) const {
+    return bool(find_node(id, node_kind::kTable));
+  }
+
+  // The number of distinct values registered.
+  size_t size() const {
+    size_t n = 0;
+    for (shard const &s : shards) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      for (auto const &kv : s.nodes) {
+        n += kv.second.size();
+      }
+    }
+    return n;
+  }
+
+  // What the registered values hold, counting each node once.
+  memory_report memory_usage() const {
+    memory_report report;
+    std::unordered_set<void const *> seen;
+    for (shard const &s : shards) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      for (auto const &kv : s.nodes) {
+        for (std::shared_ptr<Base> const &node : kv.second) {
+          ParameterSet::add_memory_usage(node.get(), report, seen);
+        }
+      }
+    }
+    return report;
+  }
+
+  void clear() {
+    for (shard &s : shards) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      s.nodes.clear();
+    }
+  }
+};
+
+} // namespace fhicl
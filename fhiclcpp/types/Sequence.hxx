@@ -1,25 +1,275 @@
 #pragma once
 
+#include "fhiclcpp/types/Atom.hxx"
 #include "fhiclcpp/types/Base.hxx"
+#include "fhiclcpp/types/exception.hxx"
+#include "fhiclcpp/types/serialize.hxx"
+#include "fhiclcpp/types/span.hxx"
 
 #include "fhiclcpp/string_parsers/from_string.hxx"
 #include "fhiclcpp/string_parsers/traits.hxx"
 
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <limits>
+#include <mutex>
+#include <ostream>
 
 namespace fhicl {
 class ParameterSet;
 // forward declaration for functions found in utility.hxx
-std::shared_ptr<Base> deep_copy_value(std::shared_ptr<Base> const original);
+std::shared_ptr<Base> copy_value(std::shared_ptr<Base> const &original);
+
+// std::vectors and std::arrays that can be read directly from a Sequence of
+// decoded Atoms.
+template <typename T, typename Enable = void>
+struct is_sequence_decodable : std::false_type {};
+template <typename T>
+struct is_sequence_decodable<
+    T, typename std::enable_if<is_vect<T>::value || is_array<T>::value>::type>
+    : std::integral_constant<
+          bool, is_atom_decodable<typename T::value_type>::value> {};
+
+// Contiguous storage for a sequence whose elements are all numeric atoms. The
+// decoded values are held in a single buffer, as int64_t if every element is
+// an integer and as double otherwise, and the element strings are concatenated
+// into another so that serialization is unchanged.
+class packed_numeric_sequence {
+  Atom::value_kind kind;
+  std::vector<int64_t> integers;
+  std::vector<double> floats;
+  std::string text;
+  std::vector<uint32_t> text_end;
+
+  packed_numeric_sequence() : kind(Atom::value_kind::kInteger) {}
+
+public:
+  // Returns nullptr if any element is not a numeric Atom, or if a mix of
+  // integers and floats contains an integer that a double cannot hold
+  // exactly.
+  static std::shared_ptr<packed_numeric_sequence const>
+  pack(std::vector<std::shared_ptr<Base>> const &elements) {
+    int64_t const max_exact_int = int64_t(1) << 53;
+    bool has_float = false;
+    bool has_inexact_int = false;
+    for (std::shared_ptr<Base> const &el : elements) {
+      Atom const *atm = node_cast<Atom>(el.get());
+      if (!atm) {
+        return nullptr;
+      }
+      Atom::value_kind el_kind = atm->decode();
+      if (el_kind == Atom::value_kind::kFloat) {
+        has_float = true;
+      } else if (el_kind == Atom::value_kind::kInteger) {
+        int64_t i = Atom::bits_to_integer(atm->decoded_value_bits());
+        if ((i > max_exact_int) || (i < -max_exact_int)) {
+          has_inexact_int = true;
+        }
+      } else {
+        return nullptr;
+      }
+    }
+    if (has_float && has_inexact_int) {
+      return nullptr;
+    }
+
+    std::shared_ptr<packed_numeric_sequence> packed(
+        new packed_numeric_sequence());
+    packed->kind =
+        has_float ? Atom::value_kind::kFloat : Atom::value_kind::kInteger;
+    if (has_float) {
+      packed->floats.reserve(elements.size());
+    } else {
+      packed->integers.reserve(elements.size());
+    }
+    packed->text_end.reserve(elements.size());
+    for (std::shared_ptr<Base> const &el : elements) {
+      Atom const &atm = static_cast<Atom const &>(*el);
+      uint64_t bits = atm.decoded_value_bits();
+      if (!has_float) {
+        packed->integers.push_back(Atom::bits_to_integer(bits));
+      } else if (atm.decode() == Atom::value_kind::kInteger) {
+        packed->floats.push_back(double(Atom::bits_to_integer(bits)));
+      } else {
+        packed->floats.push_back(Atom::bits_to_float(bits));
+      }
+      packed->text += atm.to_string();
+      if (packed->text.size() > std::numeric_limits<uint32_t>::max()) {
+        return nullptr;
+      }
+      packed->text_end.push_back(uint32_t(packed->text.size()));
+    }
+    packed->text.shrink_to_fit();
+    return packed;
+  }
+
+  size_t size() const { return text_end.size(); }
+  Atom::value_kind value_kind() const { return kind; }
+
+  std::string element_string(size_t i) const {
+    size_t begin = i ? text_end[i - 1] : 0;
+    return text.substr(begin, text_end[i] - begin);
+  }
+  void write_element(std::ostream &os, size_t i) const {
+    size_t begin = i ? text_end[i - 1] : 0;
+    os.write(text.data() + begin, std::streamsize(text_end[i] - begin));
+  }
+  void write_element_json(std::ostream &os, size_t i) const {
+    size_t begin = i ? text_end[i - 1] : 0;
+    if (kind == Atom::value_kind::kInteger) {
+      write_json_number(os, text.data() + begin, text_end[i] - begin,
+                        integers[i]);
+    } else {
+      write_json_number(os, text.data() + begin, text_end[i] - begin,
+                        floats[i]);
+    }
+  }
+  uint64_t element_bits(size_t i) const {
+    return (kind == Atom::value_kind::kInteger)
+               ? Atom::integer_to_bits(integers[i])
+               : Atom::float_to_bits(floats[i]);
+  }
+  template <typename T> bool element_as(size_t i, T &rtn) const {
+    return Atom::convert_decoded(kind, element_bits(i), rtn);
+  }
+
+  span<int64_t const> integer_span() const {
+    return span<int64_t const>(integers.data(), integers.size());
+  }
+  span<double const> float_span() const {
+    return span<double const>(floats.data(), floats.size());
+  }
+
+  size_t heap_bytes() const {
+    return (integers.capacity() * sizeof(int64_t)) +
+           (floats.capacity() * sizeof(double)) + text.capacity() +
+           (text_end.capacity() * sizeof(uint32_t));
+  }
+
+  std::vector<std::shared_ptr<Base>> box() const {
+    std::vector<std::shared_ptr<Base>> boxed;
+    boxed.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+      boxed.push_back(std::make_shared<Atom>(element_string(i)));
+    }
+    return boxed;
+  }
+};
 
 class Sequence : public Base {
   std::vector<std::shared_ptr<Base>> internal_rep;
+  // When set, the elements are held here and internal_rep is empty.
+  std::shared_ptr<packed_numeric_sequence const> packed;
+  // Atoms for the elements of a packed sequence that have been requested as
+  // nodes through the const accessor, each built on first request. Owned by
+  // this sequence and published with a single compare and swap, the map is
+  // then guarded by its own mutex.
+  struct boxed_elements {
+    std::mutex mtx;
+    std::map<size_t, std::shared_ptr<Base>> atoms;
+  };
+  mutable std::atomic<boxed_elements *> packed_boxed;
+  // Cached digest(), 0 until computed and reset by every mutable accessor.
+  mutable std::atomic<uint64_t> digest_cache;
+
+  void reset_digest() { digest_cache = 0; }
 
   inline void from(std::string const &str);
 
+  // Moves packed elements back into internal_rep as individual Atoms before an
+  // operation that may modify them.
+  void unpack() {
+    if (!packed) {
+      return;
+    }
+    internal_rep = packed->box();
+    // Elements already handed out as nodes keep their identity
+    boxed_elements *boxed = packed_boxed.exchange(nullptr);
+    if (boxed) {
+      for (auto const &kv : boxed->atoms) {
+        internal_rep[kv.first] = kv.second;
+      }
+      delete boxed;
+    }
+    packed.reset();
+  }
+
+  // The Atom for element idx of a packed sequence, built on first request.
+  std::shared_ptr<Base> const &boxed_element(size_t idx) const {
+    boxed_elements *boxed = packed_boxed.load(std::memory_order_acquire);
+    if (!boxed) {
+      boxed_elements *new_boxed = new boxed_elements();
+      if (packed_boxed.compare_exchange_strong(boxed, new_boxed,
+                                               std::memory_order_acq_rel)) {
+        boxed = new_boxed;
+      } else { // another reader published first, boxed now holds theirs
+        delete new_boxed;
+      }
+    }
+    std::lock_guard<std::mutex> lock(boxed->mtx);
+    std::shared_ptr<Base> &atm = boxed->atoms[idx];
+    if (!atm) {
+      atm = std::make_shared<Atom>(packed->element_string(idx));
+    }
+    return atm;
+  }
+
 public:
+  // Reads element idx, which must exist, as a T from its decoded value without
+  // building a node for it. Returns false if it is not a decoded Atom or
+  // cannot be held by a T.
+  template <typename T> bool element_decoded_as(size_t idx, T &rtn) const {
+    if (packed) {
+      return packed->element_as(idx, rtn);
+    }
+    Atom const *atm = node_cast<Atom>(internal_rep[idx].get());
+    return atm && atm->decoded_as(rtn);
+  }
+
+  // Switches to packed storage if every element is a numeric atom, this is
+  // done automatically for sequences that are parsed.
+  void pack() {
+    if (packed || internal_rep.empty()) {
+      return;
+    }
+    packed = packed_numeric_sequence::pack(internal_rep);
+    if (packed) {
+      internal_rep.clear();
+      internal_rep.shrink_to_fit();
+    }
+  }
+  bool is_packed() const { return bool(packed); }
+  // Heap bytes held for the elements, not counting the element nodes other
+  // than the Atoms built for packed elements.
+  size_t storage_heap_bytes() const {
+    size_t bytes =
+        (internal_rep.capacity() * sizeof(std::shared_ptr<Base>)) +
+        (packed ? (sizeof(packed_numeric_sequence) + packed->heap_bytes())
+                : 0);
+    boxed_elements *boxed = packed_boxed.load(std::memory_order_acquire);
+    if (boxed) {
+      std::lock_guard<std::mutex> lock(boxed->mtx);
+      bytes += sizeof(boxed_elements) +
+               (boxed->atoms.size() *
+                (sizeof(Atom) + sizeof(std::shared_ptr<Base>) +
+                 sizeof(size_t) + (4 * sizeof(void *))));
+    }
+    return bytes;
+  }
+  // For packed sequences, the storage kind, kInteger or kFloat, and the
+  // string representation of each element.
+  Atom::value_kind packed_kind() const {
+    return packed ? packed->value_kind() : Atom::value_kind::kUndecoded;
+  }
+  std::string packed_element_string(size_t idx) const {
+    return packed->element_string(idx);
+  }
+
   std::shared_ptr<Base> &get_or_extend_get_value(size_t idx) {
+    reset_digest();
+    unpack();
     if (idx >= internal_rep.size()) {
       while (idx >= internal_rep.size()) {
         internal_rep.push_back(std::make_shared<Atom>());
@@ -28,6 +278,8 @@ public:
     return internal_rep[idx];
   }
   std::shared_ptr<Base> &get(size_t idx) {
+    reset_digest();
+    unpack();
     if (idx >= internal_rep.size()) {
       return Base::empty();
     }
@@ -35,114 +287,291 @@ public:
   }
   std::shared_ptr<Base> const &get(size_t idx) const {
     static std::shared_ptr<Base> const nullrtn(nullptr);
-    if (idx >= internal_rep.size()) {
+    if (idx >= size()) {
       return nullrtn;
     }
-    return internal_rep[idx];
+    return packed ? boxed_element(idx) : internal_rep[idx];
   }
 
   void put(std::shared_ptr<Base> const &obj) {
-    internal_rep.push_back(deep_copy_value(obj));
+    reset_digest();
+    unpack();
+    internal_rep.push_back(copy_value(obj));
   }
 
   void put(std::shared_ptr<Base> &&obj) {
+    reset_digest();
+    unpack();
     internal_rep.push_back(std::move(obj));
   }
 
-  size_t size() const { return internal_rep.size(); }
+  size_t size() const {
+    return packed ? packed->size() : internal_rep.size();
+  }
 
   template <typename T> T at_as(size_t index) const {
-    if (internal_rep.size() <= index) {
+    if (size() <= index) {
       throw;
     }
+    if (packed) {
+      T rtn;
+      if (packed->element_as(index, rtn)) {
+        return rtn;
+      }
+      return string_parsers::str2T<T>(packed->element_string(index));
+    }
     return string_parsers::str2T<T>(internal_rep[index]->to_string());
   };
+
+  // Reads the sequence as a std::vector or std::array of numbers or bools
+  // directly from the decoded elements, without serializing. Returns false if
+  // the caller should fall back to parsing the string representation.
+  template <typename T>
+  typename std::enable_if<is_vect<T>::value && is_sequence_decodable<T>::value,
+                          bool>::type
+  decoded_as(T &rtn) const {
+    T decoded;
+    decoded.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+      typename T::value_type el;
+      if (!element_decoded_as(i, el)) {
+        return false;
+      }
+      decoded.push_back(el);
+    }
+    rtn = std::move(decoded);
+    return true;
+  }
+  template <typename T>
+  typename std::enable_if<is_array<T>::value && is_sequence_decodable<T>::value,
+                          bool>::type
+  decoded_as(T &rtn) const {
+    if (size() != std::tuple_size<T>::value) {
+      return false;
+    }
+    T decoded{};
+    for (size_t i = 0; i < size(); ++i) {
+      if (!element_decoded_as(i, decoded[i])) {
+        return false;
+      }
+    }
+    rtn = decoded;
+    return true;
+  }
+  template <typename T>
+  typename std::enable_if<!is_sequence_decodable<T>::value, bool>::type
+  decoded_as(T &) const {
+    return false;
+  }
+
   template <typename T>
   typename std::enable_if<is_seq<T>::value, T>::type as() const {
+    T rtn;
+    if (decoded_as(rtn)) {
+      return rtn;
+    }
     return string_parsers::str2T<T>(to_string());
   };
-  Sequence() : internal_rep() {}
-  Sequence(std::string const &str) : internal_rep() { from(str); }
-  Sequence(Sequence &&other) : internal_rep(std::move(other.internal_rep)) {}
-  Sequence(Sequence const &other) : Sequence() { splice(other); }
+
+  // A view of the packed values of this sequence, T must be the packed storage
+  // type: int64_t for sequences of integers, double if any element is a
+  // floating point number.
+  template <typename T>
+  typename std::enable_if<std::is_same<T, int64_t>::value, span<T const>>::type
+  as_span() const {
+    if (!packed || (packed->value_kind() != Atom::value_kind::kInteger)) {
+      throw wrong_fhicl_category()
+          << "[ERROR]: Attempted to view sequence " << std::quoted(to_string())
+          << " as a packed sequence of integers.";
+    }
+    return packed->integer_span();
+  }
+  template <typename T>
+  typename std::enable_if<std::is_same<T, double>::value, span<T const>>::type
+  as_span() const {
+    if (!packed || (packed->value_kind() != Atom::value_kind::kFloat)) {
+      throw wrong_fhicl_category()
+          << "[ERROR]: Attempted to view sequence " << std::quoted(to_string())
+          << " as a packed sequence of floating point numbers.";
+    }
+    return packed->float_span();
+  }
+
+  Sequence()
+      : Base(node_kind::kSequence), internal_rep(), packed_boxed(nullptr),
+        digest_cache(0) {}
+  Sequence(std::string const &str)
+      : Base(node_kind::kSequence), internal_rep(), packed_boxed(nullptr),
+        digest_cache(0) {
+    from(str);
+  }
+  Sequence(Sequence &&other)
+      : Base(node_kind::kSequence),
+        internal_rep(std::move(other.internal_rep)),
+        packed(std::move(other.packed)),
+        packed_boxed(other.packed_boxed.exchange(nullptr)),
+        digest_cache(other.digest_cache.load()) {}
+  Sequence(Sequence const &other) : Sequence() {
+    splice(other);
+    digest_cache = other.digest_cache.load();
+  }
+  ~Sequence() { delete packed_boxed.load(); }
+
+  size_t uncached_digest_width() const { return digest_cache ? 0 : size(); }
+  uint64_t digest() const {
+    uint64_t h = digest_cache;
+    if (h) {
+      return h;
+    }
+    h = digest_combine(kSequenceDigestSeed, size());
+    if (packed) {
+      for (size_t i = 0; i < packed->size(); ++i) {
+        h = digest_combine(h, Atom::string_digest(packed->element_string(i)));
+      }
+    } else {
+      size_t ncomposite = 0;
+      for (auto const &el : internal_rep) {
+        ncomposite += !node_cast<Atom>(el.get());
+      }
+      if (ncomposite >= kParallelDigestMinValues) {
+        std::vector<Base const *> composite;
+        for (auto const &el : internal_rep) {
+          if (!node_cast<Atom>(el.get())) {
+            composite.push_back(el.get());
+          }
+        }
+        digest_in_parallel(composite);
+      }
+      for (auto const &el : internal_rep) {
+        h = digest_combine(h, el->digest());
+      }
+    }
+    h = digest_nonzero(h);
+    digest_cache = h;
+    return h;
+  }
 
   std::string to_string() const {
-    std::stringstream ss("");
-    ss << "[";
+    string_ostream os;
+    write(os);
+    return os.take();
+  }
+  std::string to_compact_string() const {
+    string_ostream os;
+    write_compact(os);
+    return os.take();
+  }
+  std::string to_indented_string(size_t indent_level) const {
+    string_ostream os;
+    write_indented(os, indent_level);
+    return os.take();
+  }
+  void write(std::ostream &os) const {
+    os << "[";
+    if (packed) {
+      for (size_t i = 0; i < packed->size(); ++i) {
+        os << (i ? ", " : "");
+        packed->write_element(os, i);
+      }
+      os << "]";
+      return;
+    }
     for (size_t i = 0; i < internal_rep.size(); ++i) {
-      std::shared_ptr<ParameterSet> ps =
-          std::dynamic_pointer_cast<ParameterSet>(internal_rep[i]);
-      if (ps) {
-        ss << "{ " << internal_rep[i]->to_string() << "} "
-           << ((i + 1 == internal_rep.size()) ? "" : ", ");
+      char const *sep = (i + 1 == internal_rep.size()) ? "" : ", ";
+      if (node_cast<ParameterSet>(internal_rep[i].get())) {
+        os << "{ ";
+        internal_rep[i]->write(os);
+        os << "} " << sep;
       } else {
-        ss << internal_rep[i]->to_string()
-           << ((i + 1 == internal_rep.size()) ? "" : ", ");
+        internal_rep[i]->write(os);
+        os << sep;
       }
     }
-    ss << "]";
-    return ss.str();
+    os << "]";
   }
-  std::string to_compact_string() const {
-    std::stringstream ss("");
-    ss << "[";
+  void write_compact(std::ostream &os) const {
+    os << "[";
+    if (packed) {
+      for (size_t i = 0; i < packed->size(); ++i) {
+        os << (i ? "," : "");
+        packed->write_element(os, i);
+      }
+      os << "]";
+      return;
+    }
     for (size_t i = 0; i < internal_rep.size(); ++i) {
-      std::shared_ptr<ParameterSet> ps =
-          std::dynamic_pointer_cast<ParameterSet>(internal_rep[i]);
-      if (ps) {
-        ss << "{ " << internal_rep[i]->to_compact_string() << "}"
-           << ((i + 1 == internal_rep.size()) ? "" : ",");
+      char const *sep = (i + 1 == internal_rep.size()) ? "" : ",";
+      if (node_cast<ParameterSet>(internal_rep[i].get())) {
+        os << "{ ";
+        internal_rep[i]->write_compact(os);
+        os << "}" << sep;
       } else {
-        ss << internal_rep[i]->to_compact_string()
-           << ((i + 1 == internal_rep.size()) ? "" : ",");
+        internal_rep[i]->write_compact(os);
+        os << sep;
       }
     }
-    ss << "]";
-    return ss.str();
+    os << "]";
   }
-  std::string to_indented_string(size_t indent_level) const {
-    std::stringstream ss("");
-    for (size_t i = 0; i < internal_rep.size(); ++i) {
-      for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-        ss << " ";
+  void write_indented(std::ostream &os, size_t indent_level) const {
+    std::string const indent(indent_level, ' ');
+    if (packed) {
+      for (size_t i = 0; i < packed->size(); ++i) {
+        os << indent;
+        packed->write_element(os, i);
+        os << ((i + 1 == packed->size()) ? "" : ",\n");
       }
-      std::shared_ptr<ParameterSet> ps =
-          std::dynamic_pointer_cast<ParameterSet>(internal_rep[i]);
-      std::shared_ptr<Sequence> seq =
-          std::dynamic_pointer_cast<Sequence>(internal_rep[i]);
-      if (ps) {
-        ss << "{ " << std::endl
-           << internal_rep[i]->to_indented_string(indent_level + 2)
-           << std::endl;
-        for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-          ss << " ";
-        }
-        ss << "}" << ((i + 1 == internal_rep.size()) ? "" : ",\n");
-      } else if (seq) {
-        ss << "[ " << std::endl
-           << internal_rep[i]->to_indented_string(indent_level + 2)
-           << std::endl;
-        for (size_t i_it = 0; i_it < indent_level; ++i_it) {
-          ss << " ";
-        }
-        ss << "]" << ((i + 1 == internal_rep.size()) ? "" : ",\n");
+      return;
+    }
+    for (size_t i = 0; i < internal_rep.size(); ++i) {
+      char const *sep = (i + 1 == internal_rep.size()) ? "" : ",\n";
+      Base const *el = internal_rep[i].get();
+      os << indent;
+      if (node_cast<ParameterSet>(internal_rep[i].get())) {
+        os << "{ " << std::endl;
+        el->write_indented(os, indent_level + 2);
+        os << std::endl << indent << "}" << sep;
+      } else if (node_cast<Sequence>(el)) {
+        os << "[ " << std::endl;
+        el->write_indented(os, indent_level + 2);
+        os << std::endl << indent << "]" << sep;
       } else {
-        ss << internal_rep[i]->to_indented_string(indent_level + 2)
-           << ((i + 1 == internal_rep.size()) ? "" : ",\n");
+        el->write_indented(os, indent_level + 2);
+        os << sep;
       }
     }
-    return ss.str();
+  }
+  void write_json(std::ostream &os) const {
+    os << "[";
+    if (packed) {
+      for (size_t i = 0; i < packed->size(); ++i) {
+        os << (i ? "," : "");
+        packed->write_element_json(os, i);
+      }
+    } else {
+      for (size_t i = 0; i < internal_rep.size(); ++i) {
+        os << (i ? "," : "");
+        internal_rep[i]->write_json(os);
+      }
+    }
+    os << "]";
   }
   std::string to_indented_string_with_src_info(size_t indent_level) const {
     std::stringstream ss("");
     ss << "[" << std::endl;
+    if (packed) {
+      std::string const indent(indent_level + 2, ' ');
+      for (size_t i = 0; i < packed->size(); ++i) {
+        ss << indent << packed->element_string(i)
+           << ((i + 1 == packed->size()) ? "" : ",") << std::endl;
+      }
+      ss << std::string(indent_level, ' ') << "]";
+      return ss.str();
+    }
     for (size_t i = 0; i < internal_rep.size(); ++i) {
       for (size_t i_it = 0; i_it < indent_level + 2; ++i_it) {
         ss << " ";
       }
-      std::shared_ptr<ParameterSet> ps =
-          std::dynamic_pointer_cast<ParameterSet>(internal_rep[i]);
-      if (ps) {
+      if (node_cast<ParameterSet>(internal_rep[i].get())) {
         ss << "{ " << std::endl
            << internal_rep[i]->to_indented_string_with_src_info(indent_level +
                                                                 4)
@@ -168,6 +597,20 @@ public:
 
   void splice(Sequence const &other,
               size_t indx = std::numeric_limits<size_t>::max()) {
+    reset_digest();
+    // Packed storage is immutable, so it can be shared with an empty sequence
+    if (other.packed && !size()) {
+      packed = other.packed;
+      return;
+    }
+    unpack();
+    std::vector<std::shared_ptr<Base>> other_boxed;
+    if (other.packed) {
+      other_boxed = other.packed->box();
+    }
+    std::vector<std::shared_ptr<Base>> const &other_elements =
+        other.packed ? other_boxed : other.internal_rep;
+
     std::vector<std::shared_ptr<Base>>::iterator insert_it = internal_rep.end();
 
     if (indx <= internal_rep.size()) {
@@ -175,15 +618,24 @@ public:
       std::advance(insert_it, indx);
     }
 
-    for (size_t it = 0; it < other.internal_rep.size(); ++it) {
-      insert_it = internal_rep.insert(insert_it,
-                                      deep_copy_value(other.internal_rep[it]));
+    for (size_t it = 0; it < other_elements.size(); ++it) {
+      insert_it =
+          internal_rep.insert(insert_it, copy_value(other_elements[it]));
       std::advance(insert_it, 1);
     }
   }
 
   void splice(Sequence &&other,
               size_t indx = std::numeric_limits<size_t>::max()) {
+    reset_digest();
+    if (other.packed && !size()) {
+      packed = std::move(other.packed);
+      delete other.packed_boxed.exchange(nullptr);
+      return;
+    }
+    unpack();
+    other.unpack();
+
     std::vector<std::shared_ptr<Base>>::iterator insert_it = internal_rep.end();
 
     if (indx <= internal_rep.size()) {
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "fhiclcpp/types/ParameterSet.hxx"
+#include "fhiclcpp/types/Sequence.hxx"
+
+#include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+
+#include "fhiclcpp/string_parsers/exception.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fhicl {
+
+// Describes, once, how a struct S is filled from a ParameterSet: which key
+// each member is read from, as which type, and the default for optional
+// members. For example:
+//
+//   struct module_config {
+//     int n;
+//     double scale;
+//     std::vector<int> channels;
+//   };
+//   static binding<module_config> const config_binding =
+//       binding<module_config>()
+//           .field("n", &module_config::n)
+//           .field("scale", &module_config::scale, 1.0)
+//           .field("readout.channels", &module_config::channels);
+//   module_config cfg = config_binding.bind(ps);
+//
+// The keys are validated and split when the binding is built. bind then
+// visits the fields in key order, so that each table on the way to the keys
+// is looked up once for all of the fields below it, and a missing optional
+// key is defaulted without throwing. Every missing or mistyped key is
+// reported together in a single binding_error.
+template <typename S> class binding {
+  struct field_t {
+    key_path path;
+    // Reads value, found at path, into the member of the struct. Throws as
+    // ParameterSet::get if it is of the wrong type.
+    std::function<void(std::shared_ptr<Base> const &, key_t const &, S &)>
+        read;
+    // Reads element idx of a packed sequence, found at path, from its decoded
+    // value. Returns false if it must be read as a node instead.
+    std::function<bool(Sequence const &, size_t, S &)> read_packed;
+    // Sets the member to its default, empty for required fields.
+    std::function<void(S &)> fallback;
+  };
+
+  std::vector<field_t> fields;
+  // Indices into fields, sorted by key so that fields that share a table are
+  // adjacent.
+  std::vector<size_t> order;
+
+  static bool same_segment(key_path const &a, key_path const &b, size_t i) {
+    return (a[i].name_length == b[i].name_length) &&
+           (a[i].index == b[i].index) &&
+           !std::memcmp(a.name_data(i), b.name_data(i), a[i].name_length);
+  }
+  static bool segment_less(key_path const &a, key_path const &b, size_t i) {
+    int cmp = std::memcmp(a.name_data(i), b.name_data(i),
+                          std::min(a[i].name_length, b[i].name_length));
+    if (cmp || (a[i].name_length != b[i].name_length)) {
+      return cmp ? (cmp < 0) : (a[i].name_length < b[i].name_length);
+    }
+    return a[i].index < b[i].index;
+  }
+  static bool path_less(key_path const &a, key_path const &b) {
+    for (size_t i = 0; (i < a.size()) && (i < b.size()); ++i) {
+      if (!same_segment(a, b, i)) {
+        return segment_less(a, b, i);
+      }
+    }
+    return a.size() < b.size();
+  }
+
+  template <typename T>
+  binding &add(key_t const &key, T S::*member,
+               std::function<void(S &)> fallback) {
+    fields.push_back(
+        {key_path(key),
+         [member](std::shared_ptr<Base> const &value, key_t const &k, S &s) {
+           s.*member = ParameterSet::value_as<T>(value, k);
+         },
+         [member](Sequence const &seq, size_t idx, S &s) {
+           T value;
+           if (is_seq<T>::value || !seq.element_decoded_as(idx, value)) {
+             return false;
+           }
+           s.*member = std::move(value);
+           return true;
+         },
+         std::move(fallback)});
+    order.push_back(fields.size() - 1);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return path_less(fields[a].path, fields[b].path);
+    });
+    return *this;
+  }
+
+public:
+  // A required member, read from key as a T.
+  template <typename T> binding &field(key_t const &key, T S::*member) {
+    return add(key, member, nullptr);
+  }
+  // An optional member, set to def if key does not exist.
+  template <typename T>
+  binding &field(key_t const &key, T S::*member, T def) {
+    return add(key, member, [member, def](S &s) { s.*member = def; });
+  }
+
+  size_t size() const { return fields.size(); }
+
+  // Fills the bound members of s from ps, members of s that are not bound are
+  // left as they are. Throws binding_error listing every key that is
+  // required but missing, or that holds a value of the wrong type, in key
+  // order.
+  void bind(ParameterSet const &ps, S &s) const {
+    std::vector<std::string> errors;
+    // tables[d] is the table that holds segment d of the previous key, as far
+    // as the previous key could be resolved.
+    std::vector<ParameterSet const *> tables(1, &ps);
+    key_path const *previous = nullptr;
+    for (size_t idx : order) {
+      field_t const &f = fields[idx];
+      key_path const &path = f.path;
+
+      size_t depth = 0;
+      while (previous && (depth + 1 < path.size()) &&
+             (depth + 1 < tables.size()) && (depth < previous->size()) &&
+             same_segment(*previous, path, depth)) {
+        ++depth;
+      }
+      tables.resize(depth + 1);
+      previous = &path;
+
+      std::shared_ptr<Base> const *value = nullptr;
+      Sequence const *packed = nullptr;
+      std::string error;
+      for (;; ++depth) {
+        if ((depth + 1 == path.size()) && path[depth].has_index()) {
+          packed = tables[depth]->find_packed_segment(path, depth);
+          if (packed) {
+            break;
+          }
+        }
+        value = tables[depth]->find_segment(path, depth);
+        if (!value) {
+          error = "Key " + path.prefix(depth) + " is indexed but is not a "
+                  "fhicl sequence";
+          break;
+        }
+        if ((depth + 1 == path.size()) || !(*value)) {
+          break;
+        }
+        ParameterSet const *table =
+            node_cast<ParameterSet>(value->get());
+        if (!table) {
+          error = "Key " + path.prefix(depth) + " is not a fhicl table";
+          break;
+        }
+        tables.push_back(table);
+      }
+      if (packed) {
+        if (f.read_packed(*packed, path[depth].index, s)) {
+          continue;
+        }
+        value = &packed->get(path[depth].index);
+      }
+
+      if (!error.size() && !(*value)) {
+        if (f.fallback) {
+          f.fallback(s);
+          continue;
+        }
+        error = "Required key does not exist";
+      }
+      if (!error.size()) {
+        try {
+          f.read(*value, path.str(), s);
+          continue;
+        } catch (fhicl::string_parsers::fhicl_cpp_simple_except &e) {
+          error = e.what();
+        } catch (fhicl::fhicl_cpp_simple_except &e) {
+          error = e.what();
+        }
+      }
+      errors.push_back(path.str() + ": " + error);
+    }
+
+    if (errors.size()) {
+      binding_error e;
+      e << "[ERROR]: Failed to bind " << errors.size() << " of "
+        << fields.size() << " keys:";
+      for (std::string const &err : errors) {
+        e << "\n  " << err;
+      }
+      throw e;
+    }
+  }
+  S bind(ParameterSet const &ps) const {
+    S s{};
+    bind(ps, s);
+    return s;
+  }
+};
+
+} // namespace fhicl
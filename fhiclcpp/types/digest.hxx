@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fhicl {
+
+// A fast, non-cryptographic 64-bit hash used to build the content digests of
+// fhicl values, and so ParameterSet IDs. Input bytes are read little-endian so
+// that a digest does not depend on the host byte order.
+
+inline uint64_t digest_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+inline uint64_t digest_load(unsigned char const *p, size_t n) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; ++i) {
+    v |= uint64_t(p[i]) << (8 * i);
+  }
+  return v;
+}
+
+inline uint64_t digest_bytes(char const *data, size_t len, uint64_t seed) {
+  unsigned char const *p = reinterpret_cast<unsigned char const *>(data);
+  uint64_t h = seed ^ (uint64_t(len) * 0x9e3779b97f4a7c15ull);
+  for (; len >= 8; len -= 8, p += 8) {
+    h ^= digest_mix(digest_load(p, 8));
+    h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729ull;
+  }
+  h ^= digest_mix(digest_load(p, len) ^ uint64_t(len));
+  return digest_mix(h);
+}
+inline uint64_t digest_bytes(std::string const &str, uint64_t seed) {
+  return digest_bytes(str.data(), str.size(), seed);
+}
+
+// Order-dependent combination of a running digest with the next value.
+inline uint64_t digest_combine(uint64_t h, uint64_t v) {
+  return digest_mix((h ^ v) * 0x9e3779b97f4a7c15ull + (h >> 29));
+}
+
+// Seeds that keep atoms, sequences and tables with the same contents apart.
+constexpr uint64_t kAtomDigestSeed = 0x61746f6d00000001ull;
+constexpr uint64_t kSequenceDigestSeed = 0x7365710000000002ull;
+constexpr uint64_t kTableDigestSeed = 0x7461626c65000003ull;
+
+// Digests are cached with 0 meaning "not yet computed", so a computed digest
+// must never be 0.
+inline uint64_t digest_nonzero(uint64_t h) { return h ? h : 1; }
+
+// Composite values with at least this many composite children consider
+// computing the children's digests on several threads.
+constexpr size_t kParallelDigestMinValues = 16;
+// Each thread that digests in parallel must have at least this many values,
+// directly within children whose digests are not cached, to digest. A digest
+// costs some hundreds of nanoseconds per value and starting a thread some tens
+// of microseconds, so below this a thread would cost more than it saves.
+constexpr size_t kParallelDigestMinWidth = 8192;
+
+inline bool &parallel_digest_active() {
+  static thread_local bool active = false;
+  return active;
+}
+
+// Marks the current thread as digesting for digest_in_parallel until the end
+// of the scope, including when a digest throws, as a lazy table that fails to
+// parse does.
+class parallel_digest_scope {
+  bool was_active;
+
+public:
+  parallel_digest_scope() : was_active(parallel_digest_active()) {
+    parallel_digest_active() = true;
+  }
+  ~parallel_digest_scope() { parallel_digest_active() = was_active; }
+  parallel_digest_scope(parallel_digest_scope const &) = delete;
+  parallel_digest_scope &operator=(parallel_digest_scope const &) = delete;
+};
+
+// Computes, and so caches, the digests of values across the available hardware
+// threads, if there is enough work to go round, see kParallelDigestMinWidth.
+// Values are assigned to threads round-robin as neighbouring subtrees tend to
+// be of similar size. Digests requested from within a worker thread are
+// computed serially, so only the outermost large value fans out.
+template <typename T>
+void digest_in_parallel(std::vector<T const *> const &values) {
+  if (parallel_digest_active()) {
+    return;
+  }
+  size_t width = 0;
+  for (T const *value : values) {
+    width += value->uncached_digest_width();
+  }
+  size_t nthreads =
+      std::min({size_t(std::thread::hardware_concurrency()), values.size(),
+                width / kParallelDigestMinWidth});
+  if (nthreads < 2) {
+    return;
+  }
+  auto work = [&values, nthreads](size_t first) {
+    parallel_digest_scope scope;
+    for (size_t i = first; i < values.size(); i += nthreads) {
+      values[i]->digest();
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (size_t t = 1; t < nthreads; ++t) {
+    try {
+      workers.push_back(std::async(std::launch::async, work, t));
+    } catch (std::system_error &) {
+      // Any values left over are digested serially by the caller
+      break;
+    }
+  }
+  work(0);
+  for (auto &w : workers) {
+    w.get();
+  }
+}
+
+} // namespace fhicl
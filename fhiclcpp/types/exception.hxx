@@ -41,6 +41,7 @@ NEW_EXCEPT(nonexistant_key);
 NEW_EXCEPT(cant_insert);
 NEW_EXCEPT(wrong_fhicl_category);
 NEW_EXCEPT(bizare_error);
+NEW_EXCEPT(binding_error);
 
 #undef NEW_EXCEPT
 
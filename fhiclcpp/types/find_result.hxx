@@ -0,0 +1,103 @@
+#pragma once
+
+#include "fhiclcpp/types/exception.hxx"
+
+#include <cstdint>
+#include <utility>
+
+namespace fhicl {
+
+// Why a ParameterSet::find did not produce a value.
+enum class lookup_error : uint8_t {
+  kNone,
+  kInvalidKey,
+  // The key is valid but no value is stored under it.
+  kNonexistantKey,
+  // A segment of the key that has children is not a table.
+  kNotATable,
+  // A segment of the key that has an index is not a sequence.
+  kNotASequence,
+  // The value is a sequence requested as an atom, or vice versa, or a table
+  // requested as anything but a ParameterSet.
+  kWrongCategory,
+  // The value is of the right category but could not be parsed as the
+  // requested type.
+  kBadValue
+};
+
+inline char const *lookup_error_string(lookup_error err) {
+  switch (err) {
+  case lookup_error::kNone: {
+    return "no error";
+  }
+  case lookup_error::kInvalidKey: {
+    return "invalid key";
+  }
+  case lookup_error::kNonexistantKey: {
+    return "key does not exist";
+  }
+  case lookup_error::kNotATable: {
+    return "key recurses into a value that is not a fhicl table";
+  }
+  case lookup_error::kNotASequence: {
+    return "key indexes a value that is not a fhicl sequence";
+  }
+  case lookup_error::kWrongCategory: {
+    return "value is of the wrong fhicl category for the requested type";
+  }
+  case lookup_error::kBadValue: {
+    return "value could not be parsed as the requested type";
+  }
+  }
+  return "unknown error";
+}
+
+// The result of ParameterSet::find<T>: either a T or the lookup_error that
+// prevented reading one. Building an error result neither throws nor formats
+// a message.
+template <typename T> class find_result {
+  T val;
+  lookup_error err;
+
+public:
+  find_result(T v) : val(std::move(v)), err(lookup_error::kNone) {}
+  find_result(lookup_error e) : val(), err(e) {}
+
+  bool has_value() const { return err == lookup_error::kNone; }
+  explicit operator bool() const { return has_value(); }
+  lookup_error error() const { return err; }
+
+  // Throws if there is no value, prefer checking first or value_or.
+  T const &value() const & {
+    check();
+    return val;
+  }
+  T &&value() && {
+    check();
+    return std::move(val);
+  }
+  T const &operator*() const & { return val; }
+  T &&operator*() && { return std::move(val); }
+  T const *operator->() const { return &val; }
+
+  T value_or(T def) const & { return has_value() ? val : std::move(def); }
+  T value_or(T def) && { return has_value() ? std::move(val) : std::move(def); }
+
+private:
+  void check() const {
+    if (err == lookup_error::kInvalidKey) {
+      throw invalid_key() << "[ERROR]: find_result holds no value: "
+                          << lookup_error_string(err);
+    }
+    if (err == lookup_error::kNonexistantKey) {
+      throw nonexistant_key() << "[ERROR]: find_result holds no value: "
+                              << lookup_error_string(err);
+    }
+    if (err != lookup_error::kNone) {
+      throw wrong_fhicl_category() << "[ERROR]: find_result holds no value: "
+                                   << lookup_error_string(err);
+    }
+  }
+};
+
+} // namespace fhicl
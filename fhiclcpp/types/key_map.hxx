@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fhicl {
+
+// FNV-1a, used for all key hashing so that precomputed hashes held by a
+// key_path match those of the keys stored in a key_map.
+inline size_t hash_key(char const *str, size_t len) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= uint64_t(static_cast<unsigned char>(str[i]));
+    h *= 1099511628211ull;
+  }
+  return size_t(h);
+}
+inline size_t hash_key(std::string const &str) {
+  return hash_key(str.data(), str.size());
+}
+
+// A string-keyed associative container with an interface modelled on the parts
+// of std::map that ParameterSet uses. Entries are held in a std::map, so that
+// iteration visits them in sorted key order and, as with std::map, references
+// to mapped values stay valid when other keys are inserted or erased. Lookups
+// go through an open-addressed hash table of iterators into it instead of
+// comparing strings down the tree.
+//
+// Inserting and erasing a key cost O(log n), for the std::map, and O(1) on
+// average for the hash table, erasing shifts back the entries that follow in
+// the probe sequence rather than leaving tombstones. Copying rebuilds the
+// hash table.
+template <typename V> class key_map {
+public:
+  typedef std::string key_type;
+  typedef V mapped_type;
+  typedef std::pair<std::string const, V> value_type;
+  typedef typename std::map<std::string, V>::iterator iterator;
+  typedef typename std::map<std::string, V>::const_iterator const_iterator;
+
+private:
+  struct slot {
+    size_t hash;
+    iterator it;
+    bool full;
+  };
+
+  std::map<std::string, V> entries;
+  std::vector<slot> slots;
+
+  static size_t npos() { return size_t(-1); }
+
+  size_t find_slot(char const *key, size_t len, size_t hash) const {
+    if (slots.empty()) {
+      return npos();
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t s = hash & mask; slots[s].full; s = (s + 1) & mask) {
+      std::string const &sk = slots[s].it->first;
+      if ((slots[s].hash == hash) && (sk.size() == len) &&
+          !std::memcmp(sk.data(), key, len)) {
+        return s;
+      }
+    }
+    return npos();
+  }
+
+  void insert_slot(size_t hash, iterator it) {
+    size_t mask = slots.size() - 1;
+    size_t s = hash & mask;
+    while (slots[s].full) {
+      s = (s + 1) & mask;
+    }
+    slots[s] = slot{hash, it, true};
+  }
+
+  void rehash(size_t min_slots) {
+    size_t n = 8;
+    while (n < min_slots) {
+      n <<= 1;
+    }
+    slots.assign(n, slot{0, iterator(), false});
+    for (iterator it = entries.begin(); it != entries.end(); ++it) {
+      insert_slot(hash_key(it->first), it);
+    }
+  }
+
+  iterator emplace_entry(std::string const &key, size_t hash, V &&value) {
+    iterator it = entries.emplace(key, std::move(value)).first;
+    if ((2 * entries.size()) > slots.size()) {
+      rehash(4 * entries.size());
+    } else {
+      insert_slot(hash, it);
+    }
+    return it;
+  }
+
+  // Empties slot s, then moves back each entry after it in the probe
+  // sequence that would no longer be reachable from its home slot.
+  void erase_slot(size_t s) {
+    size_t mask = slots.size() - 1;
+    slots[s].full = false;
+    for (size_t j = (s + 1) & mask; slots[j].full; j = (j + 1) & mask) {
+      size_t home = slots[j].hash & mask;
+      bool reachable = (s <= j) ? ((s < home) && (home <= j))
+                                : ((s < home) || (home <= j));
+      if (reachable) {
+        continue;
+      }
+      slots[s] = slots[j];
+      slots[j].full = false;
+      s = j;
+    }
+  }
+
+public:
+  // Approximate heap bytes held per entry besides the key and value, for
+  // memory_usage.
+  static constexpr size_t entry_overhead =
+      (4 * sizeof(void *)) + (2 * sizeof(slot));
+
+  key_map() : entries(), slots() {}
+  key_map(key_map const &other) : entries(other.entries), slots() {
+    if (entries.size()) {
+      rehash(4 * entries.size());
+    }
+  }
+  // Moving a std::map keeps iterators to its elements valid.
+  key_map(key_map &&) = default;
+  key_map &operator=(key_map &&) = default;
+  key_map &operator=(key_map const &other) {
+    key_map cpy(other);
+    *this = std::move(cpy);
+    return *this;
+  }
+
+  iterator begin() { return entries.begin(); }
+  iterator end() { return entries.end(); }
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+  const_iterator cbegin() const { return entries.cbegin(); }
+  const_iterator cend() const { return entries.cend(); }
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+  // Lookup with a precomputed hash, as held by key_path segments.
+  iterator find(char const *key, size_t len, size_t hash) {
+    size_t s = find_slot(key, len, hash);
+    return (s == npos()) ? end() : slots[s].it;
+  }
+  const_iterator find(char const *key, size_t len, size_t hash) const {
+    size_t s = find_slot(key, len, hash);
+    return (s == npos()) ? end() : const_iterator(slots[s].it);
+  }
+  iterator find(std::string const &key) {
+    return find(key.data(), key.size(), hash_key(key));
+  }
+  const_iterator find(std::string const &key) const {
+    return find(key.data(), key.size(), hash_key(key));
+  }
+  size_t count(std::string const &key) const { return find(key) != end(); }
+
+  V &at(std::string const &key) {
+    iterator it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("key_map::at");
+    }
+    return it->second;
+  }
+  V const &at(std::string const &key) const {
+    const_iterator it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("key_map::at");
+    }
+    return it->second;
+  }
+
+  V &operator[](std::string const &key) {
+    size_t hash = hash_key(key);
+    size_t s = find_slot(key.data(), key.size(), hash);
+    if (s != npos()) {
+      return slots[s].it->second;
+    }
+    return emplace_entry(key, hash, V())->second;
+  }
+
+  std::pair<iterator, bool> insert(value_type const &kv) {
+    size_t hash = hash_key(kv.first);
+    size_t s = find_slot(kv.first.data(), kv.first.size(), hash);
+    if (s != npos()) {
+      return {slots[s].it, false};
+    }
+    return {emplace_entry(kv.first, hash, V(kv.second)), true};
+  }
+
+  size_t erase(std::string const &key) {
+    size_t s = find_slot(key.data(), key.size(), hash_key(key));
+    if (s == npos()) {
+      return 0;
+    }
+    iterator it = slots[s].it;
+    erase_slot(s);
+    entries.erase(it);
+    return 1;
+  }
+
+  void clear() {
+    entries.clear();
+    slots.clear();
+  }
+};
+
+} // namespace fhicl
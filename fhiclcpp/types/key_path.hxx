@@ -0,0 +1,131 @@
+#pragma once
+
+#include "fhiclcpp/types/exception.hxx"
+#include "fhiclcpp/types/key_map.hxx"
+
+#include "fhiclcpp/string_parsers/utility.hxx"
+
+#include <cctype>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace fhicl {
+
+// A fhicl key, such as "a.b[2].c", validated and split into its table segments
+// once so that it can be used for any number of lookups. Each segment is a
+// handle into the key string with the hash of its name precomputed, so a
+// lookup through a key_path is a single walk with one hash probe per level and
+// no string processing.
+class key_path {
+public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  struct segment {
+    size_t name_begin;
+    size_t name_length;
+    size_t hash;
+    size_t index;
+    bool has_index() const { return index != npos; }
+  };
+
+  static bool is_valid(std::string const &key) {
+    if (!key.size()) {
+      return false;
+    }
+    char front = key.front();
+    if ((!std::isalpha(front)) && (front != '_')) {
+      return false;
+    }
+    if (key.back() == '.') {
+      return false;
+    }
+    if (key.find_first_of(" \":\'@(){}") != std::string::npos) {
+      return false;
+    }
+    size_t first_open_bracket = key.find_first_of("[");
+    size_t last_matching_bracket = 0;
+    while (first_open_bracket != std::string::npos) {
+      size_t matching_bracket = string_parsers::find_matching_bracket(
+          key, '[', ']', first_open_bracket);
+      if (matching_bracket > last_matching_bracket) {
+        last_matching_bracket = matching_bracket;
+      }
+      if (matching_bracket == std::string::npos) {
+        return false;
+      }
+      // Sequence indices must be non-negative integers
+      if ((matching_bracket == (first_open_bracket + 1)) ||
+          (key.find_first_not_of("0123456789", first_open_bracket + 1) !=
+           matching_bracket)) {
+        return false;
+      }
+      first_open_bracket = key.find_first_of("[", matching_bracket);
+    }
+    size_t last_close_bracket = key.find_last_of("]");
+    if ((last_close_bracket != std::string::npos) &&
+        (last_close_bracket > last_matching_bracket)) {
+      return false;
+    }
+    return true;
+  }
+
+  explicit key_path(std::string const &key) : key_str(key) {
+    if (!key_str.size()) {
+      throw null_key();
+    }
+    if (!is_valid(key_str)) {
+      throw invalid_key() << "[ERROR]: Invalid key " << std::quoted(key_str);
+    }
+    size_t begin = 0;
+    while (begin <= key_str.size()) {
+      size_t end = key_str.find_first_of(".", begin);
+      if (end == std::string::npos) {
+        end = key_str.size();
+      }
+      segments.push_back(make_segment(begin, end));
+      begin = end + 1;
+    }
+  }
+  explicit key_path(char const *key) : key_path(std::string(key)) {}
+
+  std::string const &str() const { return key_str; }
+  size_t size() const { return segments.size(); }
+  segment const &operator[](size_t i) const { return segments[i]; }
+  char const *name_data(size_t i) const {
+    return key_str.data() + segments[i].name_begin;
+  }
+
+  // The key up to and including segment i.
+  std::string prefix(size_t i) const {
+    size_t end = key_str.find_first_of(".", segments[i].name_begin);
+    return key_str.substr(0, end);
+  }
+
+private:
+  std::string key_str;
+  std::vector<segment> segments;
+
+  // Like ParameterSet::get_key_index, only the first index of a segment is
+  // significant. is_valid guarantees that it is a run of digits.
+  segment make_segment(size_t begin, size_t end) const {
+    segment seg;
+    seg.name_begin = begin;
+    seg.index = npos;
+    size_t open_bracket = key_str.find_first_of("[", begin);
+    if ((open_bracket == std::string::npos) || (open_bracket >= end)) {
+      seg.name_length = end - begin;
+    } else {
+      seg.name_length = open_bracket - begin;
+      seg.index = 0;
+      for (size_t i = open_bracket + 1; std::isdigit(key_str[i]); ++i) {
+        seg.index = (seg.index * 10) + size_t(key_str[i] - '0');
+      }
+    }
+    seg.hash = hash_key(key_str.data() + begin, seg.name_length);
+    return seg;
+  }
+};
+
+} // namespace fhicl
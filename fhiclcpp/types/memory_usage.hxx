@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace fhicl {
+
+// The nodes reachable from a ParameterSet and an estimate of the heap memory
+// they hold, see ParameterSet::memory_usage. A node or table contents that is
+// shared by several parents, for example after a copy or when atoms are
+// interned by a node_arena, is counted once.
+struct memory_report {
+  uint64_t tables = 0;
+  uint64_t sequences = 0;
+  uint64_t atoms = 0;
+  // Nodes, or table contents, reached again through another parent.
+  uint64_t shared = 0;
+  uint64_t keys = 0;
+  uint64_t history_records = 0;
+  // Bytes held by the distinct nodes, their keys, elements and history,
+  // not counting allocator overheads.
+  uint64_t bytes = 0;
+
+  uint64_t nodes() const { return tables + sequences + atoms; }
+
+  std::string to_string() const {
+    std::stringstream ss;
+    ss << nodes() << " nodes (" << tables << " tables, " << sequences
+       << " sequences, " << atoms << " atoms), " << shared
+       << " shared references, " << keys << " keys, " << history_records
+       << " history records, " << bytes << " bytes";
+    return ss.str();
+  }
+};
+
+} // namespace fhicl
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "fhiclcpp/types/Atom.hxx"
+#include "fhiclcpp/types/ParameterSet.hxx"
+#include "fhiclcpp/types/Sequence.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fhicl {
+
+// Allocates the nodes of the trees built from one document, see
+// parse_options::arena.
+//
+// Only the ParameterSet, Sequence and Atom objects themselves, each together
+// with its reference count as for std::make_shared, are carved out of large
+// blocks. What they own is still allocated from the heap one piece at a time:
+// the keys and maps of tables, the element vectors of sequences, the text of
+// atoms, and the history of tracked tables. So the arena saves only the
+// per-node allocations, and allocation counts fall by only a sixth to two
+// fifths, depending on how many atoms are shared.
+//
+// Destroying a node is not free either: it takes the arena's lock and looks
+// its block up, so tearing a tree down is still one such step per node, plus
+// the frees of whatever the node owned.
+//
+// The space of a destroyed node is not reused: a block is freed once every
+// node carved out of it has been destroyed, and until then it is held whole.
+// So a tree that is edited heavily after it is parsed, replacing nodes by
+// copy-on-write, or of which only a few nodes are kept, may hold more memory
+// than a tree allocated node by node would.
+//
+// Atoms are immutable once built and are already shared between copies of a
+// tree (see copy_value), so the arena also interns them: every atom with the
+// same text is the same node. The interning table belongs to the arena, and
+// is dropped with it once the document has been parsed, the blocks live on
+// with the nodes.
+class node_arena {
+  class storage {
+    struct block {
+      std::unique_ptr<char[]> mem;
+      size_t size;
+      // The nodes allocated from it that are not destroyed yet.
+      size_t live;
+    };
+
+    std::mutex mtx;
+    // By address, so that the block a node came from can be found.
+    std::map<char const *, block> blocks;
+    // The block being carved up, nullptr before the first.
+    char *current;
+    size_t block_size;
+    size_t block_used;
+    size_t reserved;
+    size_t used;
+
+    char *add_block(size_t size) {
+      char *mem = new char[size];
+      blocks[mem] = block{std::unique_ptr<char[]>(mem), size, 1};
+      reserved += size;
+      return mem;
+    }
+    void release(std::map<char const *, block>::iterator it) {
+      reserved -= it->second.size;
+      blocks.erase(it);
+    }
+
+  public:
+    explicit storage(size_t bsize)
+        : mtx(), blocks(), current(nullptr), block_size(bsize),
+          block_used(bsize), reserved(0), used(0) {}
+
+    void *allocate(size_t bytes, size_t align) {
+      std::lock_guard<std::mutex> lock(mtx);
+      used += bytes;
+      if (bytes > (block_size / 4)) { // too large to share, gets its own block
+        return add_block(bytes);
+      }
+      size_t begin = (block_used + align - 1) & ~(align - 1);
+      if ((begin + bytes) > block_size) {
+        if (current) {
+          auto it = blocks.find(current);
+          if (!it->second.live) {
+            release(it);
+          }
+        }
+        current = add_block(block_size);
+        block_used = bytes;
+        return current;
+      }
+      blocks.find(current)->second.live++;
+      block_used = begin + bytes;
+      return current + begin;
+    }
+    void deallocate(void *ptr, size_t bytes) {
+      std::lock_guard<std::mutex> lock(mtx);
+      used -= bytes;
+      auto it = std::prev(blocks.upper_bound(static_cast<char const *>(ptr)));
+      if (!--it->second.live && (it->first != current)) {
+        release(it);
+      }
+    }
+
+    size_t bytes_reserved() {
+      std::lock_guard<std::mutex> lock(mtx);
+      return reserved;
+    }
+    size_t bytes_used() {
+      std::lock_guard<std::mutex> lock(mtx);
+      return used;
+    }
+  };
+
+  // Handed to std::allocate_shared, a copy is kept with each node so that the
+  // blocks outlive every node allocated from them.
+  template <typename T> struct allocator {
+    typedef T value_type;
+    std::shared_ptr<storage> blocks;
+
+    explicit allocator(std::shared_ptr<storage> b) : blocks(std::move(b)) {}
+    template <typename U>
+    allocator(allocator<U> const &other) : blocks(other.blocks) {}
+
+    T *allocate(size_t n) {
+      return static_cast<T *>(blocks->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *ptr, size_t n) {
+      blocks->deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U> bool operator==(allocator<U> const &other) const {
+      return blocks == other.blocks;
+    }
+    template <typename U> bool operator!=(allocator<U> const &other) const {
+      return blocks != other.blocks;
+    }
+  };
+
+  std::shared_ptr<storage> blocks;
+  mutable std::mutex mtx;
+  std::unordered_map<std::string, std::shared_ptr<Atom>> atoms;
+  size_t atoms_reused;
+
+public:
+  explicit node_arena(size_t block_size = 64 * 1024)
+      : blocks(std::make_shared<storage>(block_size)), mtx(), atoms(),
+        atoms_reused(0) {}
+  node_arena(node_arena const &) = delete;
+  node_arena &operator=(node_arena const &) = delete;
+
+  std::shared_ptr<ParameterSet> table() {
+    return std::allocate_shared<ParameterSet>(
+        allocator<ParameterSet>(blocks));
+  }
+  std::shared_ptr<Sequence> sequence() {
+    return std::allocate_shared<Sequence>(allocator<Sequence>(blocks));
+  }
+  // The atom for text, shared with every other atom built from the same text
+  // by this arena.
+  std::shared_ptr<Atom> atom(std::string const &text) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<Atom> &atm = atoms[text];
+    if (atm) {
+      atoms_reused++;
+    } else {
+      atm = std::allocate_shared<Atom>(allocator<Atom>(blocks), text);
+    }
+    return atm;
+  }
+
+  size_t bytes_reserved() const { return blocks->bytes_reserved(); }
+  size_t bytes_used() const { return blocks->bytes_used(); }
+  size_t atoms_interned() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return atoms.size();
+  }
+  // Atoms that were asked for again and shared instead of built.
+  size_t atoms_shared() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return atoms_reused;
+  }
+};
+
+} // namespace fhicl
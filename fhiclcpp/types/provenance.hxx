@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fhicl {
+
+// The names of the files, or other sources, that values were read from are
+// interned once per process and referred to by index from provenance records.
+// Interned strings are never removed, so references to them stay valid, and so
+// only this small set of names is interned.
+class provenance_strings {
+  std::mutex mtx;
+  std::deque<std::string> strings;
+  std::unordered_map<std::string, uint32_t> ids;
+
+  provenance_strings() {}
+
+public:
+  static provenance_strings &instance() {
+    static provenance_strings ps;
+    return ps;
+  }
+
+  uint32_t intern(std::string const &str) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = ids.find(str);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    uint32_t id = uint32_t(strings.size());
+    strings.push_back(str);
+    ids.emplace(str, id);
+    return id;
+  }
+
+  std::string const &str(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return strings[id];
+  }
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return strings.size();
+  }
+};
+
+enum class provenance_action : uint8_t {
+  kAdded,             // Added via the ParameterSet interface
+  kOverriden,         // Overriden via the ParameterSet interface
+  kOverrodeElement,   // A sequence element overriden via the interface
+  kAddedForExtension, // Added as a parent of a longer key that was put
+  kAddedFrom,         // Added from a document location
+  kOverridenFrom,     // Overriden from a document location
+};
+
+// One entry in the history of a key. The text that describes it is only built
+// when the history is printed, see ParameterSet::history_entry_string.
+struct provenance_record {
+  static constexpr uint64_t no_number = std::numeric_limits<uint64_t>::max();
+
+  provenance_action action;
+  // A fhicl_category
+  uint8_t category;
+  // The interned document name for kAddedFrom and kOverridenFrom, or, for
+  // kAddedForExtension, the index of the full key being extended in the
+  // extended_keys of the set that holds the record.
+  uint32_t string_id;
+  // The line number for kAddedFrom and kOverridenFrom, if known, or the
+  // element index for kOverrodeElement.
+  uint64_t number;
+
+  // Records a document location in the "name:line" form produced by
+  // linedoc::doc::get_line_info.
+  static provenance_record from_location(provenance_action action,
+                                         uint8_t category,
+                                         std::string const &location) {
+    size_t colon = location.find_last_of(':');
+    size_t ndigits =
+        (colon == std::string::npos) ? 0 : (location.size() - colon - 1);
+    // Only split off the line number if the location can be rebuilt exactly
+    bool has_line = ndigits && (ndigits < 20) &&
+                    (location.find_first_not_of("0123456789", colon + 1) ==
+                     std::string::npos) &&
+                    ((location[colon + 1] != '0') || (ndigits == 1));
+    if (!has_line) {
+      return {action, category,
+              provenance_strings::instance().intern(location), no_number};
+    }
+    uint64_t line = 0;
+    for (size_t i = colon + 1; i < location.size(); ++i) {
+      line = (line * 10) + uint64_t(location[i] - '0');
+    }
+    return {action, category,
+            provenance_strings::instance().intern(location.substr(0, colon)),
+            line};
+  }
+};
+
+} // namespace fhicl
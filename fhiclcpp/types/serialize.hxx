@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace fhicl {
+
+// An output stream that appends to a std::string, which can be taken without
+// the copy that std::stringstream::str makes. It can be kept and reused as a
+// growable buffer by clearing str() between uses.
+class string_ostream : private std::streambuf, public std::ostream {
+  std::string buffer;
+
+  typedef std::streambuf::traits_type traits;
+
+  std::streambuf::int_type overflow(std::streambuf::int_type c) {
+    if (!traits::eq_int_type(c, traits::eof())) {
+      buffer.push_back(traits::to_char_type(c));
+    }
+    return traits::not_eof(c);
+  }
+  std::streamsize xsputn(char const *s, std::streamsize n) {
+    buffer.append(s, size_t(n));
+    return n;
+  }
+
+public:
+  string_ostream() : std::streambuf(), std::ostream(this), buffer() {}
+  string_ostream(string_ostream const &) = delete;
+  string_ostream &operator=(string_ostream const &) = delete;
+
+  std::string &str() { return buffer; }
+  std::string take() { return std::move(buffer); }
+};
+
+// Writes str as a quoted JSON string.
+inline void write_json_string(std::ostream &os, std::string const &str) {
+  static char const hex[] = "0123456789abcdef";
+  os.put('\"');
+  size_t run = 0; // start of the characters that need no escaping
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    if ((c >= 0x20) && (c != '\"') && (c != '\\')) {
+      continue;
+    }
+    os.write(str.data() + run, std::streamsize(i - run));
+    run = i + 1;
+    switch (c) {
+    case '\"': {
+      os << "\\\"";
+      break;
+    }
+    case '\\': {
+      os << "\\\\";
+      break;
+    }
+    case '\n': {
+      os << "\\n";
+      break;
+    }
+    case '\t': {
+      os << "\\t";
+      break;
+    }
+    case '\r': {
+      os << "\\r";
+      break;
+    }
+    default: {
+      char esc[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      os.write(esc, sizeof(esc));
+    }
+    }
+  }
+  os.write(str.data() + run, std::streamsize(str.size() - run));
+  os.put('\"');
+}
+
+// Whether the characters [first, last) are a number as JSON spells them.
+inline bool is_json_number(char const *first, char const *last) {
+  auto digits = [&]() {
+    char const *start = first;
+    while ((first != last) && (*first >= '0') && (*first <= '9')) {
+      ++first;
+    }
+    return first != start;
+  };
+  if ((first != last) && (*first == '-')) {
+    ++first;
+  }
+  if ((first != last) && (*first == '0')) {
+    ++first;
+  } else if (!digits()) {
+    return false;
+  }
+  if ((first != last) && (*first == '.')) {
+    ++first;
+    if (!digits()) {
+      return false;
+    }
+  }
+  if ((first != last) && ((*first == 'e') || (*first == 'E'))) {
+    ++first;
+    if ((first != last) && ((*first == '+') || (*first == '-'))) {
+      ++first;
+    }
+    if (!digits()) {
+      return false;
+    }
+  }
+  return first == last;
+}
+
+// Writes a number that was read from text. The text is kept if JSON accepts
+// it, otherwise the value is written in a form that it does. Values that
+// JSON cannot hold, infinities and NaNs, are written as the string text.
+inline void write_json_number(std::ostream &os, char const *text, size_t len,
+                              int64_t value) {
+  if (is_json_number(text, text + len)) {
+    os.write(text, std::streamsize(len));
+    return;
+  }
+  os << value;
+}
+inline void write_json_number(std::ostream &os, char const *text, size_t len,
+                              double value) {
+  if (is_json_number(text, text + len)) {
+    os.write(text, std::streamsize(len));
+    return;
+  }
+  if (!std::isfinite(value)) {
+    write_json_string(os, std::string(text, len));
+    return;
+  }
+  char buf[32];
+  int n = std::snprintf(buf, sizeof(buf), "%.17g", value);
+  os.write(buf, n);
+}
+
+} // namespace fhicl
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace fhicl {
+
+// A minimal non-owning view of a contiguous range of T, valid for as long as
+// the object that handed it out is neither modified nor destroyed.
+template <typename T> class span {
+  T *ptr;
+  size_t n;
+
+public:
+  typedef T element_type;
+  typedef typename std::remove_cv<T>::type value_type;
+  typedef T *iterator;
+
+  span() : ptr(nullptr), n(0) {}
+  span(T *p, size_t size) : ptr(p), n(size) {}
+
+  T *data() const { return ptr; }
+  size_t size() const { return n; }
+  bool empty() const { return !n; }
+
+  T &operator[](size_t i) const { return ptr[i]; }
+  T &front() const { return ptr[0]; }
+  T &back() const { return ptr[n - 1]; }
+
+  iterator begin() const { return ptr; }
+  iterator end() const { return ptr + n; }
+};
+
+} // namespace fhicl
@@ -1,14 +1,64 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 
 #include "fhiclcpp/types/Atom.hxx"
 #include "fhiclcpp/types/ParameterSet.hxx"
 #include "fhiclcpp/types/Sequence.hxx"
 
 #include "fhiclcpp/types/CompositeTypesSharedImpl.hxx"
+#include "fhiclcpp/types/FrozenParameterSet.hxx"
+#include "fhiclcpp/types/ParameterSetOverlay.hxx"
+#include "fhiclcpp/types/ParameterSetRegistry.hxx"
+#include "fhiclcpp/types/binding.hxx"
+#include "fhiclcpp/types/node_arena.hxx"
 
 using namespace fhicl;
 
+// Whether reading atm as T gives exactly what str2T gives for its string
+// representation, including the sign of zero, or both throw.
+template <typename T> bool same_as_str2T(Atom const &atm) {
+  T decoded{}, parsed{};
+  bool decoded_threw = false, parsed_threw = false;
+  try {
+    decoded = atm.as<T>();
+  } catch (string_parsers::parser_fail &e) {
+    decoded_threw = true;
+  }
+  try {
+    parsed = string_parsers::str2T<T>(atm.to_string());
+  } catch (string_parsers::parser_fail &e) {
+    parsed_threw = true;
+  }
+  return (decoded_threw == parsed_threw) &&
+         (decoded_threw || !std::memcmp(&decoded, &parsed, sizeof(T)));
+}
+
+// Whether reading packed and boxed as T gives the same result, or both throw,
+// and whether that is what str2T gives for their string representation.
+template <typename T>
+bool same_packed_and_boxed(Sequence const &packed, Sequence const &boxed) {
+  std::vector<T> results(3);
+  std::vector<bool> threw(3, false);
+  for (size_t i = 0; i < 3; ++i) {
+    try {
+      results[i] = (i == 0) ? packed.as<T>()
+                            : (i == 1) ? boxed.as<T>()
+                                       : string_parsers::str2T<T>(
+                                             boxed.to_string());
+    } catch (string_parsers::parser_fail &e) {
+      threw[i] = true;
+    }
+  }
+  return (threw[0] == threw[1]) && (threw[1] == threw[2]) &&
+         (results[0] == results[1]) && (results[1] == results[2]);
+}
+
 int main() {
   {
     Atom a("5");
@@ -19,6 +69,63 @@ int main() {
     assert((filename.as<std::string>() == "\"/path/to/file\""));
     std::cout << "[PASSED] 3/3 Atom parse tests" << std::endl;
   }
+  {
+    Atom i("-42");
+    assert((i.decode() == Atom::value_kind::kInteger));
+    assert((i.as<int>() == -42));
+    assert((i.as<double>() == -42));
+    Atom h("0x1F");
+    assert((h.as<unsigned>() == 0x1F));
+    Atom b("0b101");
+    assert((b.as<int>() == 5));
+    Atom f("-1.5e2");
+    assert((f.decode() == Atom::value_kind::kFloat));
+    assert((f.as<double>() == -150));
+    assert((same_as_str2T<int>(f)));
+    assert((f.as<std::string>() == "-1.5e2"));
+    Atom t("True");
+    assert((t.decode() == Atom::value_kind::kBool));
+    assert((t.as<bool>() == true));
+    Atom q("\"5\"");
+    assert((q.decode() == Atom::value_kind::kString));
+    Atom c(f);
+    assert((c.decode() == Atom::value_kind::kFloat));
+    assert((c.as<float>() == -150));
+    std::cout << "[PASSED] 7/7 Atom decode tests" << std::endl;
+  }
+  {
+    bool threw = false;
+    try {
+      Atom("1e308").as<float>();
+    } catch (string_parsers::parser_fail &e) {
+      threw = true;
+    }
+    assert(threw);
+    threw = false;
+    try {
+      Atom(".5").as<int>();
+    } catch (string_parsers::parser_fail &e) {
+      threw = true;
+    }
+    assert(threw);
+    assert(std::signbit(Atom("-0").as<double>()));
+
+    std::vector<std::string> strs{
+        "0",          "-0",          "-0.0",       "+1",
+        ".5",         "1.5",         "2.0",        "-1.5e2",
+        "1E2",        "1e308",       "1e-40",      "3.4028235e38",
+        "0.1",        "16777217",    "2147483648", "-9223372036854775808",
+        "0xFFFFFFFF", "0x1FFFFFFFF", "0b101",      "0b1000"};
+    for (std::string const &str : strs) {
+      Atom atm(str);
+      assert((same_as_str2T<int>(atm)));
+      assert((same_as_str2T<long>(atm)));
+      assert((same_as_str2T<unsigned>(atm)));
+      assert((same_as_str2T<float>(atm)));
+      assert((same_as_str2T<double>(atm)));
+    }
+    std::cout << "[PASSED] 4/4 Atom decode range tests" << std::endl;
+  }
   {
     Sequence a("[5]");
     assert((a.as<std::array<double, 1>>() == std::array<double, 1>{5}));
@@ -34,6 +141,73 @@ int main() {
             std::vector<std::string>{"a", "b"}));
     std::cout << "[PASSED] 5/5 Sequence parse tests" << std::endl;
   }
+  {
+    Sequence a("[1, 2.5, 0x3]");
+    assert(a.is_packed());
+    assert((a.to_string() == "[1, 2.5, 0x3]"));
+    assert((a.as<std::vector<double>>() == std::vector<double>{1, 2.5, 3}));
+    assert((a.as<std::array<int, 3>>() == std::array<int, 3>{1, 2, 3}));
+    assert((a.at_as<int>(2) == 3));
+    span<double const> a_span = a.as_span<double>();
+    assert((a_span.size() == 3) && (a_span[1] == 2.5));
+    Sequence b("[1, a, 3]");
+    assert(!b.is_packed());
+    Sequence c(a);
+    c.get_or_extend_get_value(3) = std::make_shared<Atom>("b");
+    assert(a.is_packed() && !c.is_packed());
+    assert((c.to_string() == "[1, 2.5, 0x3, b]"));
+    assert((a.size() == 3));
+    ParameterSet ps;
+    ps.put("ints", std::vector<int>{4, 5, 6});
+    assert((ps.get_span<int64_t>("ints").back() == 6));
+
+    // Indexed reads of a packed sequence do not box all of its elements
+    std::vector<double> values(10000, 0.5);
+    values[5] = 5.5;
+    ps.put("values", values);
+    size_t bytes = ps.memory_usage().bytes;
+    assert((ps.get<double>("values[5]") == 5.5));
+    assert((ps.find<double>("values[5]").value_or(0) == 5.5));
+    assert((ps.memory_usage().bytes == bytes));
+    assert((ps.get<std::string>("values[5]") == "5.5"));
+    assert((ps.get<std::string>("values[5]") == "5.5"));
+    assert((ps.memory_usage().bytes < (bytes + 1000)));
+    std::cout << "[PASSED] 7/7 packed Sequence tests" << std::endl;
+  }
+  {
+    std::vector<std::vector<std::string>> seqs{
+        {"-0", "+1", ".5"},         {"1", "2", "3"},
+        {"1", "2.0", "3"},          {"-1.5e2", "1E2", "7"},
+        {"0xFFFFFFFF", "1", "2.5"}, {"0x1FFFFFFFF", "1", "2"},
+        {"1e308", "1", "0.1"},      {"9007199254740993", "1", "2"}};
+    for (std::vector<std::string> const &els : seqs) {
+      Sequence packed, boxed;
+      for (std::string const &el : els) {
+        packed.put(std::make_shared<Atom>(el));
+        boxed.put(std::make_shared<Atom>(el));
+      }
+      packed.pack();
+      assert((packed.to_string() == boxed.to_string()));
+      assert((same_packed_and_boxed<std::vector<int>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::vector<long>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::vector<unsigned>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::vector<float>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::vector<double>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::array<int, 3>>(packed, boxed)));
+      assert((same_packed_and_boxed<std::array<double, 3>>(packed, boxed)));
+    }
+    Sequence mixed("[-0, +1, .5]");
+    assert(mixed.is_packed());
+    bool threw = false;
+    try {
+      mixed.as<std::vector<int>>();
+    } catch (string_parsers::parser_fail &e) {
+      threw = true;
+    }
+    assert(threw);
+    std::cout << "[PASSED] 3/3 packed and boxed Sequence read tests"
+              << std::endl;
+  }
   ParameterSet a;
 
   {
@@ -158,6 +332,491 @@ int main() {
     assert((c.id() == e.id()));
     std::cout << "[PASSED] 3/3 get ParameterSet tests" << std::endl;
   }
+  {
+    ParameterSet c("{z: 1 a: {b: [{c: 2}, {c: 3}]} m: 4 b: 5}");
+    key_path p("a.b[1].c");
+    assert((c.get<int>(p) == 3));
+    assert((c.get<int>(p) == c.get<int>("a.b[1].c")));
+    assert(c.has_key(key_path("a.b[0]")) && !c.has_key(key_path("a.b[2]")));
+    assert((c.get<int>(key_path("a.x"), 7) == 7));
+    // Iteration order, and so serialization, is still sorted by key
+    std::string str = c.to_string();
+    assert((str.find("a:") == 0) && (str.find("b: 5") < str.find("m: 4")) &&
+           (str.find("m: 4") < str.find("z: 1")));
+    bool threw = false;
+    try {
+      key_path bad("a[x]");
+    } catch (invalid_key &e) {
+      threw = true;
+    }
+    assert(threw);
+    std::cout << "[PASSED] 6/6 key_path tests" << std::endl;
+  }
+  {
+    ParameterSet c("{a: 1 b: [1, 2] c: {d: \"str\"} e: [a, 1]}");
+    find_result<int> a = c.find<int>("a");
+    assert(a && (*a == 1) && (a.value() == 1));
+    assert((c.find<std::vector<int>>(key_path("b")).value() ==
+            std::vector<int>{1, 2}));
+    assert((c.find<std::string>("c.d").value_or("") == "str"));
+    assert((c.find<ParameterSet>("c")->get<std::string>("d") == "str"));
+
+    assert((c.find<int>("z").error() == lookup_error::kNonexistantKey));
+    assert((c.find<int>("c.z").error() == lookup_error::kNonexistantKey));
+    assert((c.find<int>("a[x]").error() == lookup_error::kInvalidKey));
+    assert((c.find<int>("a.b").error() == lookup_error::kNotATable));
+    assert((c.find<int>("c[0]").error() == lookup_error::kNotASequence));
+    assert((c.find<int>("b").error() == lookup_error::kWrongCategory));
+    assert((c.find<std::vector<int>>("a").error() ==
+            lookup_error::kWrongCategory));
+    assert((c.find<ParameterSet>("a").error() == lookup_error::kWrongCategory));
+    assert((c.find<int>("c.d").error() == lookup_error::kBadValue));
+    assert((c.find<std::vector<int>>("e").error() == lookup_error::kBadValue));
+
+    // get with a default and get_if_present do not throw for any of these.
+    assert((c.get<int>("a.b", 7) == 7) && (c.get<int>("c.d", 7) == 7));
+    int i = 7;
+    assert(!c.get_if_present("a.b", i) && !c.get_if_present("c[0]", i) &&
+           (i == 7));
+    assert(c.get_if_present("b[1]", i) && (i == 2));
+
+    bool threw = false;
+    try {
+      c.find<int>("z").value();
+    } catch (nonexistant_key &e) {
+      threw = true;
+    }
+    assert(threw);
+    std::cout << "[PASSED] 5/5 find tests" << std::endl;
+  }
+  {
+    ParameterSet c("{a: {b: {c: 1} d: [1, 2]} e: {f: 2}}");
+    ParameterSetID id0 = c.id();
+    ParameterSetID e_id = c.get<ParameterSet>("e").id();
+    c.put_or_replace("a.b.c", 3);
+    assert((c.id() != id0));
+    assert((c.get<ParameterSet>("e").id() == e_id));
+    c.put_or_replace("a.b.c", 1);
+    assert((c.id() == id0));
+    c.put_or_replace("a.d[1]", 3);
+    assert((c.id() != id0));
+    assert(c.erase("e") && (c.id() != id0));
+
+    // Wide tables of large children digest them in parallel, which must
+    // agree with computing them in turn
+    ParameterSet w;
+    for (int i = 0; i < 40; ++i) {
+      ParameterSet t;
+      for (int j = 0; j < 512; ++j) {
+        t.put("v" + std::to_string(j), std::vector<int>{i, j});
+      }
+      w.put("t" + std::to_string(i), t);
+    }
+    assert((w.uncached_digest_width() == 40));
+    ParameterSet w_serial(w);
+    parallel_digest_active() = true;
+    ParameterSetID serial_id = w_serial.id();
+    parallel_digest_active() = false;
+    assert((w.id() == serial_id));
+    try {
+      parallel_digest_scope scope;
+      throw std::runtime_error("digest failed");
+    } catch (std::runtime_error const &) {
+    }
+    assert(!parallel_digest_active());
+
+    // Atom digests are cached, carried by copies and dropped on assignment
+    Atom quoted(std::string("\"a, b\""));
+    uint64_t quoted_digest = Atom::string_digest(quoted.to_string());
+    assert((quoted.digest() == quoted_digest) &&
+           (quoted.digest() == quoted_digest));
+    Atom quoted_copy(quoted);
+    assert((quoted_copy.digest() == quoted_digest));
+    quoted_copy = Atom(std::string("1"));
+    assert((quoted_copy.digest() == Atom::string_digest("1")));
+    std::cout << "[PASSED] 9/9 ParameterSet digest tests" << std::endl;
+  }
+  {
+    ParameterSet a("{b: {c: 1 d: [{e: 2}, {e: 3}]} f: [1, 2]}");
+    ParameterSet copy = a;
+    ParameterSet sub = a.get<ParameterSet>("b");
+    std::string a_str = a.to_string();
+    copy.put_or_replace("b.c", 5);
+    copy.put_or_replace("b.d[1].e", 6);
+    copy.put_or_replace("f[0]", 7);
+    assert((a.to_string() == a_str));
+    assert((copy.get<int>("b.c") == 5) && (copy.get<int>("b.d[1].e") == 6));
+    assert((copy.get<std::vector<int>>("f") == std::vector<int>{7, 2}));
+    a.put_or_replace("b.d[0].e", 8);
+    assert((sub.get<int>("d[0].e") == 2) && (copy.get<int>("b.d[0].e") == 2));
+    // A set put into itself holds its contents from before the put
+    a.put("g", a);
+    assert(!a.has_key("g.g") && (a.get<int>("g.b.d[0].e") == 8));
+    a.splice(a);
+    assert((a.get<int>("b.d[0].e") == 8));
+    std::cout << "[PASSED] 5/5 copy-on-write tests" << std::endl;
+  }
+  {
+    ParameterSet ps;
+    ps.put("a", 1);
+    ps.put_or_replace("b.c", std::vector<int>{1, 2});
+    assert((ps.get_src_info("a") ==
+            "Added a \"@nil\" via ParameterSet interface for extension to "
+            "key: \"a\", Overriden with a \"Atom\" via ParameterSet "
+            "interface"));
+    assert((ps.get_src_info("b.c") ==
+            "Overriden with a \"Sequence\" via ParameterSet interface"));
+    ParameterSet quiet;
+    quiet.set_track_history(false);
+    quiet.put("a", 1);
+    quiet.put_or_replace("b.c", std::vector<int>{1, 2});
+    assert(!quiet.get<ParameterSet>("b").tracks_history());
+    quiet.splice(ps);
+    assert(!quiet.history_to_string().size());
+    assert((quiet.to_string() == ps.to_string()));
+    // Extended keys are kept with the set, and carried over by splice.
+    size_t n_interned = provenance_strings::instance().size();
+    ParameterSet wide;
+    for (size_t i = 0; i < 1000; ++i) {
+      wide.put("t" + std::to_string(i) + ".v", 1);
+    }
+    assert((provenance_strings::instance().size() == n_interned));
+    ParameterSet spliced;
+    spliced.put("x", 1);
+    spliced.splice(std::move(wide));
+    spliced.splice(ps);
+    assert((spliced.get_src_info("t999").find("key: \"t999\"") !=
+            std::string::npos));
+    assert((spliced.get_src_info("a").find(ps.get_src_info("a")) !=
+            std::string::npos));
+    std::cout << "[PASSED] 6/6 history tracking tests" << std::endl;
+  }
+  {
+    ParameterSet ps;
+    ps.put("a", 1);
+    ps.put("b.c", std::vector<double>{1.5, 2.5, 3.5});
+    ps.put("b.d", std::string("str"));
+    ps.put("e", std::vector<std::string>{"x", "y"});
+    FrozenParameterSet frozen = ps.freeze();
+    ParameterSetID id = ps.id();
+    ps.put_or_replace("a", 2);
+    assert((frozen.id() == id) && (frozen.get<int>("a") == 1));
+
+    std::atomic<size_t> failures(0);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < 8; ++t) {
+      readers.emplace_back([&frozen, &failures, id] {
+        for (size_t i = 0; i < 200; ++i) {
+          bool ok = (frozen.get<int>("a") == 1) &&
+                    (frozen.get<double>("b.c[1]") == 2.5) &&
+                    (frozen.get<std::string>("b.c[2]") == "3.5") &&
+                    (frozen.get<FrozenParameterSet>("b").get<std::string>(
+                         "d") == "str") &&
+                    (frozen.get<std::vector<std::string>>("e")[1] == "y") &&
+                    frozen.has_key("b.d") && !frozen.has_key("b.z") &&
+                    (frozen.get_names().size() == 3) && (frozen.id() == id);
+          if (!ok) {
+            ++failures;
+          }
+        }
+      });
+    }
+    for (std::thread &r : readers) {
+      r.join();
+    }
+    assert(!failures);
+    assert((frozen.thaw().get<int>("a") == 1));
+    std::cout << "[PASSED] 3/3 frozen ParameterSet tests" << std::endl;
+  }
+  {
+    ParameterSet ps;
+    ps.put("a", 1);
+    ps.put("b.c", std::vector<double>{1.5, 2});
+    ps.put("e", std::vector<std::string>{"x", "y z"});
+    ps.put("t", true);
+    assert((ps.to_json() ==
+            "{\"a\":1,\"b\":{\"c\":[1.5,2]},\"e\":[\"x\",\"y z\"],"
+            "\"t\":true}"));
+
+    // Numbers that JSON does not accept are rewritten, or quoted if JSON
+    // cannot hold them.
+    std::string const atoms[][2] = {
+        {"+1", "1"},         {".5", "0.5"},   {"0x1F", "31"},
+        {"inf", "\"inf\""},  {"@nil", "null"}, {"a\tb", "\"a\\tb\""},
+        {"1e5", "1e5"}};
+    for (auto const &a_json : atoms) {
+      string_ostream os;
+      Atom(a_json[0]).write_json(os);
+      assert((os.str() == a_json[1]));
+    }
+
+    // A stream can be reused as a buffer.
+    string_ostream os;
+    ps.write_indented(os, 2);
+    assert((os.str() == ps.to_indented_string(2)));
+    os.str().clear();
+    ps.write(os);
+    assert((os.str() == ps.to_string()));
+    std::cout << "[PASSED] 4/4 streaming serializer tests" << std::endl;
+  }
+  {
+    struct module_config {
+      int n;
+      double scale;
+      std::string label;
+      std::vector<int> channels;
+      ParameterSet tool;
+    };
+    binding<module_config> const config_binding =
+        binding<module_config>()
+            .field("readout.channels", &module_config::channels)
+            .field("n", &module_config::n)
+            .field("scale", &module_config::scale, 1.5)
+            .field("readout.label", &module_config::label,
+                   std::string("none"))
+            .field("tools[1]", &module_config::tool);
+
+    ParameterSet ps;
+    ps.put("n", 3);
+    ps.put("readout.channels", std::vector<int>{1, 2, 3});
+    ParameterSet tool;
+    tool.put("a", 1);
+    ps.put<std::vector<ParameterSet>>("tools", {ParameterSet(), tool});
+    module_config cfg = config_binding.bind(ps);
+    assert((cfg.n == 3) && (cfg.scale == 1.5) && (cfg.label == "none"));
+    assert((cfg.channels.size() == 3) && (cfg.channels[2] == 3));
+    assert((cfg.tool.get<int>("a") == 1));
+
+    // Elements of a packed sequence, read decoded or as a string.
+    binding<module_config> const element_binding =
+        binding<module_config>()
+            .field("readout.channels[1]", &module_config::n)
+            .field("readout.channels[2]", &module_config::label);
+    element_binding.bind(ps, cfg);
+    assert((cfg.n == 2) && (cfg.label == "3"));
+
+    // Every failure is reported at once.
+    ps.erase("n");
+    ps.put_or_replace("readout.label", std::vector<int>{1});
+    ps.put_or_replace("tools", 1);
+    std::string error;
+    try {
+      config_binding.bind(ps);
+    } catch (binding_error &e) {
+      error = e.what();
+    }
+    assert((error.find("3 of 5 keys") != std::string::npos));
+    assert((error.find("\n  n: ") != std::string::npos));
+    assert((error.find("\n  readout.label: ") != std::string::npos));
+    assert((error.find("\n  tools[1]: ") != std::string::npos));
+    std::cout << "[PASSED] 5/5 struct binding tests" << std::endl;
+  }
+  {
+    std::shared_ptr<Atom> kept;
+    std::shared_ptr<Sequence> seq;
+    {
+      node_arena arena(256);
+      kept = arena.atom("1");
+      assert((arena.atom("1") == kept) && (arena.atom("2") != kept));
+      assert((arena.atoms_interned() == 2) && (arena.atoms_shared() == 1));
+      seq = arena.sequence();
+      for (size_t i = 0; i < 20; ++i) { // spans several blocks
+        seq->put(arena.atom(std::to_string(i)));
+      }
+      assert((arena.bytes_reserved() >= arena.bytes_used()));
+    }
+    // The nodes outlive the arena.
+    assert((kept->as<int>() == 1) && (seq->to_string().size() > 40));
+    {
+      // Blocks are freed as soon as all of their nodes are.
+      node_arena arena(256);
+      std::vector<std::shared_ptr<Sequence>> seqs;
+      for (size_t i = 0; i < 20; ++i) {
+        seqs.push_back(arena.sequence());
+      }
+      size_t reserved = arena.bytes_reserved();
+      seqs.erase(seqs.begin(), seqs.begin() + 10);
+      assert((arena.bytes_reserved() < reserved));
+    }
+
+    ParameterSet table;
+    table.put("a", 1);
+    table.put("b.c", std::vector<int>{1, 2});
+    ParameterSet ps;
+    ps.put("x", table);
+    ps.put("y", table);
+    memory_report one = table.memory_usage();
+    memory_report two = ps.memory_usage();
+    assert((one.tables == 2) && (one.sequences == 1) && (one.keys == 3));
+    // The copies share their contents, which are only counted once.
+    assert((two.shared == 1) && (two.keys == (one.keys + 2)));
+    assert((two.bytes < (2 * one.bytes)));
+    std::cout << "[PASSED] 4/4 node arena and memory usage tests" << std::endl;
+  }
+  {
+    ParameterSet ps;
+    ps.put("a", 1);
+    ps.put("b", std::vector<int>{1, 2});
+    ps.put("c.d", "str");
+    std::shared_ptr<Base> a = std::make_shared<Atom>("1");
+    std::shared_ptr<Base> b = std::make_shared<Sequence>("[1, 2]");
+    std::shared_ptr<Base> c = std::make_shared<ParameterSet>(ps);
+    assert((a->kind() == node_kind::kAtom) &&
+           (b->kind() == node_kind::kSequence) &&
+           (c->kind() == node_kind::kTable));
+
+    assert(node_cast<Atom>(a.get()) && !node_cast<Sequence>(a.get()) &&
+           !node_cast<ParameterSet>(b.get()) && node_cast<Base>(c.get()));
+    assert(!node_cast<Atom>(static_cast<Base *>(nullptr)));
+    std::shared_ptr<ParameterSet const> table =
+        node_pointer_cast<ParameterSet const>(c);
+    assert(table && table->has_key("c.d") && (c.use_count() == 2) &&
+           !node_pointer_cast<Sequence>(c));
+
+    auto names = [](Base const &value) -> std::string {
+      return visit(value, [](auto const &node) {
+        return std::string(
+            std::is_same<decltype(node), Atom const &>::value
+                ? "atom"
+                : std::is_same<decltype(node), Sequence const &>::value
+                      ? "sequence"
+                      : "table");
+      });
+    };
+    assert((names(*a) == "atom") && (names(*b) == "sequence") &&
+           (names(*c) == "table"));
+    assert((get_fhicl_category(a) == fhicl_category::kAtom) &&
+           (get_fhicl_category(std::make_shared<Atom>("@nil")) ==
+            fhicl_category::kNil) &&
+           (get_fhicl_category(c) == fhicl_category::kTable));
+    std::cout << "[PASSED] 4/4 node kind tests" << std::endl;
+  }
+  {
+    ParameterSetRegistry registry;
+    ParameterSet module("{label: \"tracker\" gains: [1, 2, 3] cuts: {pt: 5}}");
+    std::vector<ParameterSet> jobs(8);
+    std::vector<std::thread> loaders;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      loaders.emplace_back([&, i] {
+        // Equal copies, built separately so that they share nothing.
+        ParameterSet job;
+        job.put("run", int(i));
+        job.put("producers.trk", ParameterSet("{" + module.to_string() + "}"));
+        job.put("producers.trk2",
+                ParameterSet("{" + module.to_string() + "}"));
+        jobs[i] = *registry.intern(job);
+      });
+    }
+    for (std::thread &t : loaders) {
+      t.join();
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      assert((registry.get(jobs[i].id())->id() == jobs[i].id()));
+      assert((jobs[i].get<int>("run") == int(i)));
+    }
+    assert(registry.has(module.id()) && !registry.has(module.id() + 1));
+    ParameterSet trk;
+    assert(registry.get(module.id(), trk) && (trk.id() == module.id()));
+
+    // The module tables, their contents and the producers tables are held
+    // once for all jobs, only the top-level tables differ.
+    memory_report each = jobs[0].memory_usage();
+    memory_report all = registry.memory_usage();
+    assert((all.tables < (each.tables * jobs.size())));
+    assert((all.bytes < ((each.bytes * jobs.size()) / 2)));
+
+    // Registered nodes are not modified through the sets built on them.
+    jobs[0].put_or_replace("producers.trk.cuts.pt", 6);
+    assert((registry.get(jobs[1].id())->get<int>("producers.trk.cuts.pt") ==
+            5));
+    assert((registry.get(module.id())->get<int>("cuts.pt") == 5));
+
+    // Sets whose digests collide are compared, not merged.
+    struct colliding_atom : Atom {
+      explicit colliding_atom(std::string const &str) : Atom(str) {}
+      uint64_t digest() const { return 42; }
+    };
+    ParameterSet one, two;
+    Sequence s1, s2;
+    s1.put(std::make_shared<colliding_atom>("1"));
+    s2.put(std::make_shared<colliding_atom>("2"));
+    one.put("s", s1);
+    two.put("s", s2);
+    assert((one.id() == two.id()));
+    assert((registry.intern(one)->get<int>("s[0]") == 1));
+    assert((registry.intern(two)->get<int>("s[0]") == 2));
+    assert((registry.intern(two)->get<int>("s[0]") == 2));
+    std::cout << "[PASSED] 5/5 ParameterSet registry tests" << std::endl;
+  }
+  {
+    // Wide enough that inserting or erasing in linear time would take
+    // minutes rather than milliseconds.
+    size_t const n_keys = 100000;
+    ParameterSet wide;
+    for (size_t i = 0; i < n_keys; ++i) {
+      wide.put("key" + std::to_string(i), int(i));
+    }
+    for (size_t i = 0; i < n_keys; i += 1000) {
+      assert(wide.erase("key" + std::to_string(i)));
+    }
+    std::vector<std::string> names = wide.get_names();
+    assert((names.size() == (n_keys - (n_keys / 1000))) &&
+           std::is_sorted(names.begin(), names.end()));
+    assert(!wide.has_key("key1000") && (wide.get<int>("key1001") == 1001) &&
+           (wide.get<int>("key99999") == 99999));
+    wide.put("key1000", -1);
+    assert((wide.get<int>("key1000") == -1) &&
+           (wide.get_names().size() == (names.size() + 1)));
+    std::cout << "[PASSED] 3/3 wide table tests" << std::endl;
+  }
+  {
+    ParameterSet base("{run: 1 gains: [1, 2, 3] "
+                      "trk: {label: \"tracker\" cuts: {pt: 5 eta: 2.5}}}");
+    std::string base_str = base.to_string();
+    ParameterSetOverlay job(base);
+    job.put_or_replace("trk.cuts.pt", 6);
+    job.put_or_replace("gains[1]", 20);
+    job.put_or_replace("extra", "yes");
+    ParameterSetOverlay variant = job.with(ParameterSet("{trk: {label: 7}}"));
+    variant.put_or_replace("run", 2);
+
+    assert((job.get<int>("trk.cuts.pt") == 6) &&
+           (job.get<double>("trk.cuts.eta") == 2.5) &&
+           (job.get<std::string>("trk.label") == "tracker") &&
+           (job.get<std::vector<int>>("gains") ==
+            std::vector<int>({1, 20, 3})) &&
+           (job.get<int>("run") == 1) &&
+           (job.get<ParameterSet>("trk.cuts").get<int>("pt") == 6));
+    assert((variant.get<int>("trk.label") == 7) &&
+           (variant.get<int>("trk.cuts.pt") == 6) &&
+           (variant.get<int>("run") == 2) && (variant.n_layers() == 2));
+    assert(job.has_key("trk.cuts.eta") && job.has_key("extra") &&
+           !job.has_key("trk.cuts.z") && !job.has_key("run.x") &&
+           (job.get_names() ==
+            std::vector<std::string>({"extra", "gains", "run", "trk"})) &&
+           !job.find<int>("trk.label") &&
+           (job.find<int>("run.x").error() == lookup_error::kNotATable) &&
+           (job.get<int>("missing", 3) == 3));
+
+    // The merged result is what applying the overrides to a copy gives.
+    ParameterSet expected = base;
+    expected.put_or_replace("trk.cuts.pt", 6);
+    expected.put_or_replace("gains", std::vector<int>{1, 20, 3});
+    expected.put_or_replace("extra", "yes");
+    assert((job.flatten().to_string() == expected.to_string()) &&
+           (job.to_string() == expected.to_string()) &&
+           (job.id() == expected.id()));
+
+    // The base is neither copied nor modified.
+    ParameterSet flat = variant.flatten();
+    assert((base.to_string() == base_str) &&
+           (flat.get<ParameterSet>("trk").get<ParameterSet>("cuts").id() ==
+            job.get<ParameterSet>("trk.cuts").id()) &&
+           (base.get<std::vector<int>>("gains") ==
+            std::vector<int>({1, 2, 3})));
+    std::cout << "[PASSED] 5/5 ParameterSet overlay tests" << std::endl;
+  }
   {
     ParameterSet b;
     b.put("a", std::vector<double>{1, 2, 3});
@@ -11,34 +11,48 @@
 
 namespace fhicl {
 
-fhicl_category inline get_fhicl_category(std::shared_ptr<Base> const el) {
+// Calls v with value as the Atom, Sequence or ParameterSet that it is, see
+// node_kind, and returns what v returns.
+template <typename Visitor>
+auto visit(Base const &value, Visitor &&v)
+    -> decltype(v(std::declval<Atom const &>())) {
+  switch (value.kind()) {
+  case node_kind::kAtom: {
+    return v(static_cast<Atom const &>(value));
+  }
+  case node_kind::kSequence: {
+    return v(static_cast<Sequence const &>(value));
+  }
+  case node_kind::kTable: {
+    return v(static_cast<ParameterSet const &>(value));
+  }
+  }
+  throw bizare_error() << "[ERROR]: Found a fhicl value of unknown kind "
+                       << int(value.kind());
+}
+
+fhicl_category inline get_fhicl_category(std::shared_ptr<Base> const &el) {
   if (!el) {
     return fhicl_category::kInvalidInstance;
   }
-  std::shared_ptr<Atom const> atm = std::dynamic_pointer_cast<Atom const>(el);
-  if (atm) {
-    if (atm->is_nil()) {
-      return fhicl_category::kNil;
-    }
-    return fhicl_category::kAtom;
+  switch (el->kind()) {
+  case node_kind::kAtom: {
+    return static_cast<Atom const &>(*el).is_nil() ? fhicl_category::kNil
+                                                   : fhicl_category::kAtom;
   }
-  std::shared_ptr<Sequence const> seq =
-      std::dynamic_pointer_cast<Sequence const>(el);
-  if (seq) {
+  case node_kind::kSequence: {
     return fhicl_category::kSequence;
   }
-  std::shared_ptr<ParameterSet const> ps =
-      std::dynamic_pointer_cast<ParameterSet const>(el);
-  if (ps) {
+  case node_kind::kTable: {
     return fhicl_category::kTable;
   }
+  }
   throw bizare_error()
-      << "[ERROR]: When attempting to get fhicl category, failed to cast as "
-         "any known type.";
+      << "[ERROR]: When attempting to get fhicl category, found a value of "
+         "unknown kind.";
 }
 
-std::string inline get_fhicl_category_string(std::shared_ptr<Base> const el) {
-  fhicl_category fc = get_fhicl_category(el);
+std::string inline get_fhicl_category_string(fhicl_category fc) {
   switch (fc) {
   case fhicl_category::kInvalidInstance: {
     return "nullptr";
@@ -62,29 +76,35 @@ std::string inline get_fhicl_category_string(std::shared_ptr<Base> const el) {
   }
 }
 
-inline std::shared_ptr<Base>
-deep_copy_value(std::shared_ptr<Base> const original) {
+std::string inline get_fhicl_category_string(std::shared_ptr<Base> const &el) {
+  return get_fhicl_category_string(get_fhicl_category(el));
+}
+
+// Copies a fhicl value for insertion elsewhere in a tree. The copy shares
+// structure with the original: atoms are never modified in place so are
+// shared outright, tables share their contents until either copy is modified,
+// and sequences share their elements. Mutable accessors unshare values on the
+// way down, so the copy behaves as if it were deep.
+inline std::shared_ptr<Base> copy_value(std::shared_ptr<Base> const &original) {
   if (!original) {
     return nullptr;
   }
-  std::shared_ptr<Atom const> atm =
-      std::dynamic_pointer_cast<Atom const>(original);
-  if (atm) {
-    return std::make_shared<Atom>(*atm);
+  switch (original->kind()) {
+  case node_kind::kAtom: {
+    return original;
+  }
+  case node_kind::kSequence: {
+    return std::make_shared<Sequence>(
+        static_cast<Sequence const &>(*original));
   }
-  std::shared_ptr<Sequence const> seq =
-      std::dynamic_pointer_cast<Sequence const>(original);
-  if (seq) {
-    return std::make_shared<Sequence>(*seq);
+  case node_kind::kTable: {
+    return std::make_shared<ParameterSet>(
+        static_cast<ParameterSet const &>(*original));
   }
-  std::shared_ptr<ParameterSet const> ps =
-      std::dynamic_pointer_cast<ParameterSet const>(original);
-  if (ps) {
-    return std::make_shared<ParameterSet>(*ps);
   }
   throw bizare_error()
-      << "[ERROR]: When attempting to copy a fhicl value, failed to cast as "
-         "any known type. This is an internal error, please send a full "
+      << "[ERROR]: When attempting to copy a fhicl value, found a value of "
+         "unknown kind. This is an internal error, please send a full "
          "backtrace to the maintainer.";
 }
 